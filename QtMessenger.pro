@@ -2,6 +2,13 @@ TEMPLATE = subdirs
 
 SUBDIRS += \
     client \
-    server
+    server \
+    tools
+
+# qmake CONFIG+=benchmarks adds the QtTest microbenchmarks
+benchmarks: SUBDIRS += benchmarks
+
+# qmake CONFIG+=tests adds the QtTest server tests, "make check" runs them
+tests: SUBDIRS += tests
 
 CONFIG += ordered
\ No newline at end of file
@@ -0,0 +1,50 @@
+QT += core network sql gui testlib
+
+TARGET = QtMessengerBenchmarks
+TEMPLATE = app
+
+CONFIG += c++17 console
+CONFIG -= app_bundle
+
+DEFINES += QT_MESSAGELOGCONTEXT
+
+# Benchmarks link the server sources directly, everything but its main()
+INCLUDEPATH += ../server
+
+SOURCES += \
+    serverbenchmark.cpp \
+    ../server/server.cpp \
+    ../server/database.cpp \
+    ../server/user.cpp \
+    ../server/message.cpp \
+    ../server/sessionstore.cpp \
+    ../server/latencyhistogram.cpp \
+    ../server/metrics.cpp \
+    ../server/tracer.cpp \
+    ../server/logger.cpp \
+    ../server/trafficrecorder.cpp \
+    ../server/loopmonitor.cpp \
+    ../server/recentmessageids.cpp \
+    ../server/userdirectory.cpp \
+    ../server/filestore.cpp \
+    ../server/filestreamer.cpp \
+    ../server/thumbnailer.cpp
+
+HEADERS += \
+    ../server/server.h \
+    ../server/database.h \
+    ../server/user.h \
+    ../server/message.h \
+    ../server/attachment.h \
+    ../server/sessionstore.h \
+    ../server/latencyhistogram.h \
+    ../server/metrics.h \
+    ../server/tracer.h \
+    ../server/logger.h \
+    ../server/trafficrecorder.h \
+    ../server/loopmonitor.h \
+    ../server/recentmessageids.h \
+    ../server/userdirectory.h \
+    ../server/filestore.h \
+    ../server/filestreamer.h \
+    ../server/thumbnailer.h
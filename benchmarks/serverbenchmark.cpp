@@ -0,0 +1,603 @@
+#include <QtTest>
+#include <QDir>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QLoggingCategory>
+#include <QRandomGenerator>
+#include <QSqlDatabase>
+#include <QSqlQuery>
+#include <QTcpSocket>
+#include <QTemporaryDir>
+
+#include "server.h"
+#include "database.h"
+
+// Socket that swallows everything written to it, so dispatch can be timed
+// without a peer draining the other end
+class NullSocket : public QTcpSocket
+{
+public:
+    NullSocket() { setOpenMode(QIODevice::ReadWrite); }
+
+protected:
+    qint64 writeData(const char *, qint64 length) override { return length; }
+};
+
+// Microbenchmarks for the protocol and database hot paths. Run with
+// "-o results.csv,csv" (or ",xml") to get machine-readable results.
+// Database fixtures are generated once and cached in the temp directory;
+// the 10M message fixture is only used with QTMESSENGER_BENCH_LARGE=1.
+class ServerBenchmark : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void cleanupTestCase();
+
+    // Protocol
+    void encodeFrame_data();
+    void encodeFrame();
+    void decodeFrame_data();
+    void decodeFrame();
+    void handleRequest_data();
+    void handleRequest();
+
+    // Database
+    void addUser_data() { messageCounts(); }
+    void addUser();
+    void authenticateUser_data() { messageCounts(); }
+    void authenticateUser();
+    void getUserById_data() { messageCounts(); }
+    void getUserById();
+    void getUserByUsername_data() { messageCounts(); }
+    void getUserByUsername();
+    void usernameExists_data() { messageCounts(); }
+    void usernameExists();
+    void emailExists_data() { messageCounts(); }
+    void emailExists();
+    void getContacts_data() { messageCounts(); }
+    void getContacts();
+    void getUserContacts_data() { messageCounts(); }
+    void getUserContacts();
+    void isContactExists_data() { messageCounts(); }
+    void isContactExists();
+    void addAndRemoveContact_data() { messageCounts(); }
+    void addAndRemoveContact();
+    void addMessage_data() { messageCounts(); }
+    void addMessage();
+    void getChatHistory_data() { messageCounts(); }
+    void getChatHistory();
+    void searchMessages_data() { messageCounts(); }
+    void searchMessages();
+    void markMessagesAsRead_data() { messageCounts(); }
+    void markMessagesAsRead();
+    void getUnreadMessageCount_data() { messageCounts(); }
+    void getUnreadMessageCount();
+
+private:
+    static constexpr int ContactsPerUser = 20;      // ring neighbours, both directions
+
+    void messageCounts();
+    void typicalFrames();
+    bool useFixture(qint64 messages);
+    bool buildFixture(const QString &path, qint64 messages);
+    void closeDatabase();
+
+    static int userCount(qint64 messages) { return qMax(100, int(messages / 1000)); }
+
+    QTemporaryDir workDir;
+    Database *database = nullptr;
+    qint64 openMessages = -1;
+    int nextUser = 0;
+};
+
+void ServerBenchmark::initTestCase()
+{
+    QVERIFY(workDir.isValid());
+
+    // Per-request logging would dominate the dispatch numbers
+    QLoggingCategory::setFilterRules("messenger.request.debug=false\nmessenger.request.info=false");
+}
+
+void ServerBenchmark::cleanupTestCase()
+{
+    closeDatabase();
+}
+
+void ServerBenchmark::messageCounts()
+{
+    QTest::addColumn<qint64>("messages");
+
+    QTest::newRow("10k") << qint64(10000);
+    QTest::newRow("1M") << qint64(1000000);
+    if (qEnvironmentVariableIsSet("QTMESSENGER_BENCH_LARGE")) {
+        QTest::newRow("10M") << qint64(10000000);
+    }
+}
+
+void ServerBenchmark::closeDatabase()
+{
+    if (!database) {
+        return;
+    }
+
+    delete database;
+    database = nullptr;
+    openMessages = -1;
+    QSqlDatabase::removeDatabase(QSqlDatabase::defaultConnection);
+}
+
+bool ServerBenchmark::useFixture(qint64 messages)
+{
+    if (openMessages == messages) {
+        return true;
+    }
+
+    closeDatabase();
+
+    QDir cacheDir(QDir::tempPath() + "/qtmessenger-bench");
+    cacheDir.mkpath(".");
+    QString pristine = cacheDir.filePath(QString("messages-%1.db").arg(messages));
+    if (!QFile::exists(pristine) && !buildFixture(pristine, messages)) {
+        return false;
+    }
+
+    // Write benchmarks modify the database, keep the cached copy pristine
+    QString working = workDir.filePath(QString("messages-%1.db").arg(messages));
+    if (!QFile::exists(working) && !QFile::copy(pristine, working)) {
+        return false;
+    }
+
+    database = new Database;
+    if (!database->initialize(working)) {
+        closeDatabase();
+        return false;
+    }
+
+    openMessages = messages;
+    return true;
+}
+
+bool ServerBenchmark::buildFixture(const QString &path, qint64 messages)
+{
+    qInfo() << "Generating fixture with" << messages << "messages in" << path;
+
+    QString building = path + ".part";
+    QFile::remove(building);
+
+    {
+        Database fixture;
+        if (!fixture.initialize(building)) {
+            return false;
+        }
+
+        QSqlDatabase db = QSqlDatabase::database();
+        QSqlQuery query(db);
+        query.exec("PRAGMA journal_mode = OFF");
+        query.exec("PRAGMA synchronous = OFF");
+
+        int users = userCount(messages);
+
+        db.transaction();
+        query.prepare("INSERT INTO users (username, email, password) VALUES (?, ?, ?)");
+        for (int i = 0; i < users; ++i) {
+            query.addBindValue(QString("user%1").arg(i));
+            query.addBindValue(QString("user%1@bench.localhost").arg(i));
+            query.addBindValue("password");
+            if (!query.exec()) {
+                qWarning() << "Fixture user insert failed:" << query.lastError().text();
+                db.rollback();
+                return false;
+            }
+        }
+
+        // User i knows i +- 1..ContactsPerUser/2, ids start at 1
+        query.prepare("INSERT INTO contacts (user_id, contact_id) VALUES (?, ?)");
+        for (int i = 0; i < users; ++i) {
+            for (int k = 1; k <= ContactsPerUser / 2; ++k) {
+                int other = (i + k) % users;
+                query.addBindValue(i + 1);
+                query.addBindValue(other + 1);
+                query.exec();
+                query.addBindValue(other + 1);
+                query.addBindValue(i + 1);
+                query.exec();
+            }
+        }
+        db.commit();
+
+        // Fixed seed so every machine benchmarks the same data
+        QRandomGenerator random(20240101);
+        QDateTime timestamp = QDateTime::fromString("2024-01-01T00:00:00", Qt::ISODate);
+        QString filler(256, QChar('m'));
+
+        query.prepare("INSERT INTO messages (sender_id, receiver_id, content, type, read, timestamp) "
+                      "VALUES (?, ?, ?, 'text', ?, ?)");
+        db.transaction();
+        for (qint64 n = 0; n < messages; ++n) {
+            int sender = random.bounded(users);
+            int receiver = (sender + 1 + random.bounded(ContactsPerUser / 2)) % users;
+            if (random.bounded(2)) {
+                qSwap(sender, receiver);
+            }
+
+            query.addBindValue(sender + 1);
+            query.addBindValue(receiver + 1);
+            query.addBindValue(filler.left(16 + random.bounded(200)));
+            query.addBindValue(n < messages - messages / 100 ? 1 : 0);  // newest 1% unread
+            query.addBindValue(timestamp.addSecs(n));
+            if (!query.exec()) {
+                qWarning() << "Fixture message insert failed:" << query.lastError().text();
+                db.rollback();
+                return false;
+            }
+
+            if ((n + 1) % 100000 == 0) {
+                db.commit();
+                db.transaction();
+            }
+        }
+        db.commit();
+    }
+    QSqlDatabase::removeDatabase(QSqlDatabase::defaultConnection);
+
+    return QFile::rename(building, path);
+}
+
+void ServerBenchmark::typicalFrames()
+{
+    QTest::addColumn<QJsonObject>("frame");
+
+    QJsonObject login;
+    login["action"] = "login";
+    login["username"] = "user42";
+    login["password"] = "5e884898da28047151d0e56f8dc6292773603d0d6aabbdd62a11ef721d1542d8";
+    QTest::newRow("login request") << login;
+
+    QJsonObject sendMessage;
+    sendMessage["action"] = "sendMessage";
+    sendMessage["senderId"] = 42;
+    sendMessage["receiverId"] = 43;
+    sendMessage["content"] = "See you at the station at half past six, I'll bring the tickets.";
+    sendMessage["type"] = "text";
+    sendMessage["timestamp"] = "2024-01-01T18:30:00";
+    QTest::newRow("sendMessage request") << sendMessage;
+
+    QJsonArray contacts;
+    for (int i = 0; i < ContactsPerUser; ++i) {
+        QJsonObject contact;
+        contact["id"] = 100 + i;
+        contact["username"] = QString("user%1").arg(100 + i);
+        contact["email"] = QString("user%1@example.com").arg(100 + i);
+        contact["online"] = i % 3 == 0;
+        contact["unreadCount"] = i % 4;
+        contact["lastMessage"] = sendMessage;
+        contacts.append(contact);
+    }
+    QJsonObject contactsResponse;
+    contactsResponse["action"] = "getContacts";
+    contactsResponse["status"] = "success";
+    contactsResponse["contacts"] = contacts;
+    QTest::newRow("getContacts response") << contactsResponse;
+
+    QJsonArray messages;
+    for (int i = 0; i < 50; ++i) {
+        QJsonObject message = sendMessage;
+        message.remove("action");
+        message["id"] = 1000 + i;
+        message["read"] = true;
+        messages.append(message);
+    }
+    QJsonObject historyResponse;
+    historyResponse["action"] = "getChatHistory";
+    historyResponse["status"] = "success";
+    historyResponse["contactId"] = 43;
+    historyResponse["messages"] = messages;
+    QTest::newRow("getChatHistory response") << historyResponse;
+}
+
+void ServerBenchmark::encodeFrame_data()
+{
+    typicalFrames();
+}
+
+void ServerBenchmark::encodeFrame()
+{
+    QFETCH(QJsonObject, frame);
+
+    QByteArray data;
+    QBENCHMARK {
+        data = QJsonDocument(frame).toJson(QJsonDocument::Compact);
+        data.append('\n');
+    }
+    QVERIFY(!data.isEmpty());
+}
+
+void ServerBenchmark::decodeFrame_data()
+{
+    typicalFrames();
+}
+
+void ServerBenchmark::decodeFrame()
+{
+    QFETCH(QJsonObject, frame);
+    QByteArray data = QJsonDocument(frame).toJson(QJsonDocument::Compact);
+
+    QJsonObject decoded;
+    QBENCHMARK {
+        QJsonParseError error;
+        decoded = QJsonDocument::fromJson(data, &error).object();
+    }
+    QCOMPARE(decoded, frame);
+}
+
+void ServerBenchmark::handleRequest_data()
+{
+    QTest::addColumn<QJsonObject>("request");
+
+    QJsonObject login;
+    login["action"] = "login";
+    login["username"] = "user1";
+    login["password"] = "password";
+    QTest::newRow("login") << login;
+
+    QJsonObject getContacts;
+    getContacts["action"] = "getContacts";
+    getContacts["userId"] = 2;
+    QTest::newRow("getContacts") << getContacts;
+
+    QJsonObject getChatHistory;
+    getChatHistory["action"] = "getChatHistory";
+    getChatHistory["userId"] = 2;
+    getChatHistory["contactId"] = 3;
+    QTest::newRow("getChatHistory") << getChatHistory;
+
+    QJsonObject sendMessage;
+    sendMessage["action"] = "sendMessage";
+    sendMessage["senderId"] = 2;
+    sendMessage["receiverId"] = 3;
+    sendMessage["content"] = "benchmark";
+    sendMessage["timestamp"] = "2024-06-01T12:00:00";
+    QTest::newRow("sendMessage") << sendMessage;
+
+    QJsonObject searchUsers;
+    searchUsers["action"] = "searchUsers";
+    searchUsers["userId"] = 2;
+    searchUsers["prefix"] = "user1";
+    QTest::newRow("searchUsers") << searchUsers;
+
+    // Address book import: a mix of known names, emails and strangers
+    QJsonArray addressBook;
+    for (int i = 0; i < 100; ++i) {
+        addressBook.append(i % 3 == 0 ? QString("user%1@bench.localhost").arg(i)
+                                      : i % 3 == 1 ? QString("user%1").arg(i)
+                                                   : QString("stranger%1").arg(i));
+    }
+    QJsonObject matchContacts;
+    matchContacts["action"] = "matchContacts";
+    matchContacts["userId"] = 2;
+    matchContacts["contacts"] = addressBook;
+    QTest::newRow("matchContacts") << matchContacts;
+
+    // Startup pattern: contacts plus a few open conversations in one frame
+    QJsonArray startupRequests;
+    startupRequests.append(getContacts);
+    for (int contactId = 3; contactId < 8; ++contactId) {
+        QJsonObject history = getChatHistory;
+        history["contactId"] = contactId;
+        startupRequests.append(history);
+    }
+    QJsonObject batch;
+    batch["action"] = "batch";
+    batch["requests"] = startupRequests;
+    QTest::newRow("batch startup") << batch;
+
+    QJsonObject unknown;
+    unknown["action"] = "noSuchAction";
+    QTest::newRow("unknown action") << unknown;
+}
+
+void ServerBenchmark::handleRequest()
+{
+    QFETCH(QJsonObject, request);
+    QVERIFY(useFixture(10000));
+
+    Server server(0, database);
+    NullSocket client;
+
+    QBENCHMARK {
+        server.handleRequest(&client, request);
+    }
+}
+
+void ServerBenchmark::addUser()
+{
+    QFETCH(qint64, messages);
+    QVERIFY(useFixture(messages));
+
+    QBENCHMARK {
+        User user;
+        user.username = QString("bench%1").arg(nextUser);
+        user.email = QString("bench%1@bench.localhost").arg(nextUser);
+        user.password = "password";
+        ++nextUser;
+        database->addUser(user);
+    }
+}
+
+void ServerBenchmark::authenticateUser()
+{
+    QFETCH(qint64, messages);
+    QVERIFY(useFixture(messages));
+
+    User user;
+    QBENCHMARK {
+        database->authenticateUser("user7", "password", user);
+    }
+    QCOMPARE(user.id, 8);
+}
+
+void ServerBenchmark::getUserById()
+{
+    QFETCH(qint64, messages);
+    QVERIFY(useFixture(messages));
+
+    User user;
+    QBENCHMARK {
+        database->getUserById(8, user);
+    }
+    QCOMPARE(user.username, QString("user7"));
+}
+
+void ServerBenchmark::getUserByUsername()
+{
+    QFETCH(qint64, messages);
+    QVERIFY(useFixture(messages));
+
+    User user;
+    QBENCHMARK {
+        database->getUserByUsername("user7", user);
+    }
+    QCOMPARE(user.id, 8);
+}
+
+void ServerBenchmark::usernameExists()
+{
+    QFETCH(qint64, messages);
+    QVERIFY(useFixture(messages));
+
+    bool exists = false;
+    QBENCHMARK {
+        exists = database->usernameExists("user7");
+    }
+    QVERIFY(exists);
+}
+
+void ServerBenchmark::emailExists()
+{
+    QFETCH(qint64, messages);
+    QVERIFY(useFixture(messages));
+
+    bool exists = false;
+    QBENCHMARK {
+        exists = database->emailExists("user7@bench.localhost");
+    }
+    QVERIFY(exists);
+}
+
+void ServerBenchmark::getContacts()
+{
+    QFETCH(qint64, messages);
+    QVERIFY(useFixture(messages));
+
+    QList<User> contacts;
+    QBENCHMARK {
+        contacts = database->getContacts(8);
+    }
+    QCOMPARE(contacts.size(), ContactsPerUser);
+}
+
+void ServerBenchmark::getUserContacts()
+{
+    QFETCH(qint64, messages);
+    QVERIFY(useFixture(messages));
+
+    int count = 0;
+    QBENCHMARK {
+        count = database->getUserContacts(8).size();
+    }
+    QCOMPARE(count, ContactsPerUser);
+}
+
+void ServerBenchmark::isContactExists()
+{
+    QFETCH(qint64, messages);
+    QVERIFY(useFixture(messages));
+
+    bool exists = false;
+    QBENCHMARK {
+        exists = database->isContactExists(8, 9);
+    }
+    QVERIFY(exists);
+}
+
+void ServerBenchmark::addAndRemoveContact()
+{
+    QFETCH(qint64, messages);
+    QVERIFY(useFixture(messages));
+
+    // Users 1 and 51 are never neighbours, so the pair can be added again
+    QBENCHMARK {
+        database->addContact(1, 51);
+        database->removeContact(1, 51);
+    }
+}
+
+void ServerBenchmark::addMessage()
+{
+    QFETCH(qint64, messages);
+    QVERIFY(useFixture(messages));
+
+    QBENCHMARK {
+        Message message;
+        message.senderId = 8;
+        message.receiverId = 9;
+        message.content = "benchmark";
+        message.type = "text";
+        message.timestamp = QDateTime::currentDateTime();
+        database->addMessage(message);
+    }
+}
+
+void ServerBenchmark::getChatHistory()
+{
+    QFETCH(qint64, messages);
+    QVERIFY(useFixture(messages));
+
+    QList<Message> history;
+    QBENCHMARK {
+        history = database->getChatHistory(8, 9);
+    }
+    QVERIFY(!history.isEmpty());
+}
+
+void ServerBenchmark::searchMessages()
+{
+    QFETCH(qint64, messages);
+    QVERIFY(useFixture(messages));
+    QVERIFY(database->isSearchAvailable());
+
+    // Fixture text is all one letter, so the prefix matches every message of
+    // the user: the worst case for ranking one page of a very common term
+    QList<QPair<Message, QString>> hits;
+    QBENCHMARK {
+        hits = database->searchMessages(8, -1, "mmm", 20, 0);
+    }
+    QVERIFY(!hits.isEmpty());
+}
+
+void ServerBenchmark::markMessagesAsRead()
+{
+    QFETCH(qint64, messages);
+    QVERIFY(useFixture(messages));
+
+    QBENCHMARK {
+        database->markMessagesAsRead(9, 8);
+    }
+}
+
+void ServerBenchmark::getUnreadMessageCount()
+{
+    QFETCH(qint64, messages);
+    QVERIFY(useFixture(messages));
+
+    QBENCHMARK {
+        database->getUnreadMessageCount(8, 9);
+    }
+}
+
+QTEST_GUILESS_MAIN(ServerBenchmark)
+
+#include "serverbenchmark.moc"
@@ -0,0 +1,103 @@
+#include "addcontactdialog.h"
+
+#include <QVBoxLayout>
+#include <QLabel>
+#include <QPushButton>
+#include <QJsonArray>
+
+AddContactDialog::AddContactDialog(Session *session, QWidget *parent)
+    : QDialog(parent)
+    , session(session)
+    , debounceTimer(new QTimer(this))
+{
+    setupUI();
+
+    // Ask once typing pauses, not for every key
+    debounceTimer->setSingleShot(true);
+    debounceTimer->setInterval(SuggestDebounce);
+    connect(debounceTimer, &QTimer::timeout, this, &AddContactDialog::requestSuggestions);
+
+    connect(session->networkClient(), &NetworkClient::responseReceived,
+            this, &AddContactDialog::onNetworkResponse);
+}
+
+void AddContactDialog::setupUI()
+{
+    setWindowTitle("Add Contact");
+    setMinimumWidth(320);
+
+    QVBoxLayout *layout = new QVBoxLayout(this);
+    layout->addWidget(new QLabel("Enter username to add:"));
+
+    usernameEdit = new QLineEdit();
+    usernameEdit->setPlaceholderText("Start typing a username...");
+    layout->addWidget(usernameEdit);
+
+    // The server already matched by prefix, the completer only displays
+    suggestions = new QStringListModel(this);
+    completer = new QCompleter(suggestions, this);
+    completer->setCaseSensitivity(Qt::CaseInsensitive);
+    completer->setCompletionMode(QCompleter::PopupCompletion);
+    usernameEdit->setCompleter(completer);
+
+    buttons = new QDialogButtonBox(QDialogButtonBox::Ok | QDialogButtonBox::Cancel);
+    buttons->button(QDialogButtonBox::Ok)->setText("Add");
+    buttons->button(QDialogButtonBox::Ok)->setEnabled(false);
+    layout->addWidget(buttons);
+
+    connect(buttons, &QDialogButtonBox::accepted, this, &QDialog::accept);
+    connect(buttons, &QDialogButtonBox::rejected, this, &QDialog::reject);
+    connect(usernameEdit, &QLineEdit::textEdited, this, &AddContactDialog::onTextEdited);
+    connect(usernameEdit, &QLineEdit::textChanged, this, [this](const QString &text) {
+        buttons->button(QDialogButtonBox::Ok)->setEnabled(!text.trimmed().isEmpty());
+    });
+}
+
+void AddContactDialog::onTextEdited(const QString &text)
+{
+    if (text.trimmed().isEmpty()) {
+        debounceTimer->stop();
+        suggestions->setStringList(QStringList());
+        return;
+    }
+    debounceTimer->start();
+}
+
+void AddContactDialog::requestSuggestions()
+{
+    requestedPrefix = usernameEdit->text().trimmed();
+    if (requestedPrefix.isEmpty()) {
+        return;
+    }
+
+    QJsonObject request;
+    request["action"] = "searchUsers";
+    request["userId"] = session->userId();
+    request["prefix"] = requestedPrefix;
+    request["limit"] = SuggestLimit;
+    session->networkClient()->sendRequest(request);
+}
+
+void AddContactDialog::onNetworkResponse(const QJsonObject &response)
+{
+    // Answers to a prefix we have typed past are stale
+    if (response["action"].toString() != "searchUsers"
+        || response["status"].toString() != "success"
+        || response["prefix"].toString() != requestedPrefix) {
+        return;
+    }
+
+    QStringList names;
+    const QJsonArray users = response["users"].toArray();
+    for (const QJsonValue &user : users) {
+        names.append(user.toObject()["username"].toString());
+    }
+    suggestions->setStringList(names);
+
+    // Only pop up while the field still starts with what was asked for
+    if (!names.isEmpty() && usernameEdit->hasFocus()
+        && usernameEdit->text().trimmed().startsWith(requestedPrefix, Qt::CaseInsensitive)) {
+        completer->setCompletionPrefix(usernameEdit->text().trimmed());
+        completer->complete();
+    }
+}
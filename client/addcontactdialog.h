@@ -0,0 +1,44 @@
+#ifndef ADDCONTACTDIALOG_H
+#define ADDCONTACTDIALOG_H
+
+#include <QDialog>
+#include <QLineEdit>
+#include <QCompleter>
+#include <QStringListModel>
+#include <QDialogButtonBox>
+#include <QTimer>
+#include "session.h"
+
+// Username field that suggests matching users while typing. Suggestions
+// come from the server's searchUsers action once typing pauses.
+class AddContactDialog : public QDialog
+{
+    Q_OBJECT
+
+public:
+    explicit AddContactDialog(Session *session, QWidget *parent = nullptr);
+
+    QString username() const { return usernameEdit->text().trimmed(); }
+
+private slots:
+    void onTextEdited(const QString &text);
+    void requestSuggestions();
+    void onNetworkResponse(const QJsonObject &response);
+
+private:
+    void setupUI();
+
+    Session *session;
+
+    QLineEdit *usernameEdit;
+    QCompleter *completer;
+    QStringListModel *suggestions;
+    QDialogButtonBox *buttons;
+    QTimer *debounceTimer;
+    QString requestedPrefix;
+
+    static constexpr int SuggestDebounce = 200;     // ms
+    static constexpr int SuggestLimit = 10;
+};
+
+#endif // ADDCONTACTDIALOG_H
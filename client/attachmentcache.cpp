@@ -0,0 +1,202 @@
+#include "attachmentcache.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QDateTime>
+#include <QPointer>
+#include <QDebug>
+#include <algorithm>
+#include <functional>
+
+namespace {
+
+// Eviction goes by modification time, so a use refreshes it
+void touch(const QString &path)
+{
+    QFile file(path);
+    if (file.open(QIODevice::ReadWrite)) {
+        file.setFileTime(QDateTime::currentDateTimeUtc(), QFileDevice::FileModificationTime);
+    }
+}
+
+} // namespace
+
+AttachmentCache::AttachmentCache(qint64 budgetBytes, QObject *parent)
+    : QObject(parent)
+    , budget(budgetBytes)
+    , totalSize(0)
+{
+    io.setMaxThreadCount(1);
+}
+
+AttachmentCache::~AttachmentCache()
+{
+    io.waitForDone();
+}
+
+bool AttachmentCache::open(const QString &rootPath)
+{
+    QDir dir(rootPath);
+    if (!dir.mkpath("partial")) {
+        qWarning() << "Cannot create attachment cache in" << rootPath;
+        return false;
+    }
+
+    root = dir.absolutePath();
+
+    QPointer<AttachmentCache> self(this);
+    QString path = root;
+    io.start([self, path]() {
+        QHash<QString, Entry> scanned;
+        const QFileInfoList files = QDir(path).entryInfoList(QDir::Files);
+        for (const QFileInfo &info : files) {
+            Entry entry;
+            entry.path = info.absoluteFilePath();
+            entry.size = info.size();
+            entry.lastUsed = info.lastModified().toMSecsSinceEpoch();
+            scanned.insert(info.baseName(), entry);
+        }
+
+        QMetaObject::invokeMethod(self, [self, scanned]() {
+            if (self) {
+                self->indexed(scanned);
+            }
+        }, Qt::QueuedConnection);
+    });
+    return true;
+}
+
+QString AttachmentCache::entryPath(const QString &sha256, const QString &name) const
+{
+    QString suffix = QFileInfo(name).suffix().left(16);
+    return root + "/" + sha256 + (suffix.isEmpty() ? QString() : "." + suffix);
+}
+
+QString AttachmentCache::partialPath(const QString &sha256) const
+{
+    return root + "/partial/" + sha256;
+}
+
+QString AttachmentCache::find(const QString &sha256)
+{
+    auto it = entries.find(sha256);
+    if (it == entries.end()) {
+        return QString();
+    }
+
+    it->lastUsed = QDateTime::currentMSecsSinceEpoch();
+    QString path = it->path;
+    io.start([path]() { touch(path); });
+    return path;
+}
+
+void AttachmentCache::insert(const QString &sha256, const QString &name, const QString &sourcePath, bool move)
+{
+    if (root.isEmpty()) {
+        QMetaObject::invokeMethod(this, [this, sha256]() {
+            emit storeFailed(sha256);
+        }, Qt::QueuedConnection);
+        return;
+    }
+
+    QPointer<AttachmentCache> self(this);
+    QString path = find(sha256);
+    bool known = !path.isEmpty();
+    if (!known) {
+        path = entryPath(sha256, name);
+    }
+
+    io.start([self, sha256, sourcePath, path, move, known]() {
+        // Another insert of the same content may have landed first
+        bool stored = known || QFile::exists(path);
+        if (stored) {
+            if (move) {
+                QFile::remove(sourcePath);
+            }
+        } else {
+            stored = move ? QFile::rename(sourcePath, path) : QFile::copy(sourcePath, path);
+            if (!stored) {
+                qWarning() << "Cannot store" << sourcePath << "in the attachment cache";
+            }
+        }
+
+        qint64 size = 0;
+        if (stored) {
+            // Copies keep the source time, count the insert as a use
+            touch(path);
+            size = QFileInfo(path).size();
+        }
+
+        QMetaObject::invokeMethod(self, [self, sha256, path, size, stored]() {
+            if (!self) {
+                return;
+            }
+            if (!stored) {
+                emit self->storeFailed(sha256);
+                return;
+            }
+            self->inserted(sha256, path, size);
+            emit self->stored(sha256, path);
+        }, Qt::QueuedConnection);
+    });
+}
+
+void AttachmentCache::indexed(const QHash<QString, Entry> &scanned)
+{
+    // Entries inserted while the scan ran are newer, they win
+    for (auto it = scanned.constBegin(); it != scanned.constEnd(); ++it) {
+        if (!entries.contains(it.key())) {
+            entries.insert(it.key(), it.value());
+            totalSize += it->size;
+        }
+    }
+    evict();
+}
+
+void AttachmentCache::inserted(const QString &sha256, const QString &path, qint64 size)
+{
+    auto it = entries.find(sha256);
+    if (it == entries.end()) {
+        it = entries.insert(sha256, Entry());
+        it->path = path;
+        it->size = size;
+        totalSize += size;
+    }
+    it->lastUsed = QDateTime::currentMSecsSinceEpoch();
+    evict();
+}
+
+void AttachmentCache::evict()
+{
+    if (totalSize <= budget) {
+        return;
+    }
+
+    // Newest first, everything past the budget goes; the newest entry always
+    // stays, even when it alone is over budget, since it was just asked for
+    QList<QPair<qint64, QString>> byAge;
+    byAge.reserve(entries.size());
+    for (auto it = entries.constBegin(); it != entries.constEnd(); ++it) {
+        byAge.append(qMakePair(it->lastUsed, it.key()));
+    }
+    std::sort(byAge.begin(), byAge.end(), std::greater<QPair<qint64, QString>>());
+
+    qint64 total = 0;
+    QStringList doomed;
+    for (int i = 0; i < byAge.size(); ++i) {
+        auto it = entries.find(byAge[i].second);
+        total += it->size;
+        if (i > 0 && total > budget) {
+            doomed.append(it->path);
+            totalSize -= it->size;
+            entries.erase(it);
+        }
+    }
+
+    io.start([doomed]() {
+        for (const QString &path : doomed) {
+            QFile::remove(path);
+        }
+    });
+}
@@ -0,0 +1,59 @@
+#ifndef ATTACHMENTCACHE_H
+#define ATTACHMENTCACHE_H
+
+#include <QObject>
+#include <QHash>
+#include <QString>
+#include <QThreadPool>
+
+// Downloaded and sent attachments on disk, one file per content hash. The
+// file keeps the original suffix so the desktop can open it. Least recently
+// used entries are removed once the cache grows past its size budget.
+// Lookups answer from an in-memory index; every disk operation runs in
+// order on a single worker thread, so inserts and evictions never race.
+class AttachmentCache : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit AttachmentCache(qint64 budgetBytes = 1024LL * 1024 * 1024, QObject *parent = nullptr);
+    ~AttachmentCache();
+
+    // Existing entries are indexed in the background and show up once scanned
+    bool open(const QString &rootPath);
+    bool isOpen() const { return !root.isEmpty(); }
+
+    // Path of the cached file, empty on a miss; a hit counts as a use
+    QString find(const QString &sha256);
+
+    // Moves (or copies) a verified file into the cache in the background,
+    // stored() or storeFailed() follows
+    void insert(const QString &sha256, const QString &name, const QString &sourcePath, bool move);
+
+    // Where a download in progress keeps its partial data
+    QString partialPath(const QString &sha256) const;
+
+signals:
+    void stored(const QString &sha256, const QString &path);
+    void storeFailed(const QString &sha256);
+
+private:
+    struct Entry {
+        QString path;
+        qint64 size = 0;
+        qint64 lastUsed = 0;    // ms since epoch, mirrors the file's mtime
+    };
+
+    QString entryPath(const QString &sha256, const QString &name) const;
+    void indexed(const QHash<QString, Entry> &scanned);
+    void inserted(const QString &sha256, const QString &path, qint64 size);
+    void evict();
+
+    QString root;
+    qint64 budget;
+    QHash<QString, Entry> entries;     // by sha256
+    qint64 totalSize;
+    QThreadPool io;                    // one thread, keeps disk operations in order
+};
+
+#endif // ATTACHMENTCACHE_H
@@ -7,6 +7,7 @@
 #include <QDateTime>
 #include <QStyle>
 #include <QStyleOption>
+#include <QMouseEvent>
 
 ChatBubble::ChatBubble(const QString &message, const QString &timestamp, 
                        bool fromMe, const QString &type, QWidget *parent)
@@ -15,6 +16,10 @@ ChatBubble::ChatBubble(const QString &message, const QString &timestamp,
     , timestamp(timestamp)
     , fromMe(fromMe)
     , type(type)
+    , fileIconLabel(nullptr)
+    , imageLabel(nullptr)
+    , bubbleLayout(nullptr)
+    , progressBar(nullptr)
 {
     setupUI();
 }
@@ -35,7 +40,7 @@ void ChatBubble::setupUI()
     bubbleWidget->setMaximumWidth(400);
     
     // Bubble layout
-    QVBoxLayout *bubbleLayout = new QVBoxLayout(bubbleWidget);
+    bubbleLayout = new QVBoxLayout(bubbleWidget);
     bubbleLayout->setContentsMargins(12, 8, 12, 8);
     bubbleLayout->setSpacing(4);
     
@@ -58,6 +63,12 @@ void ChatBubble::setupUI()
         fileLayout->addWidget(messageLabel);
         
         bubbleLayout->addLayout(fileLayout);
+    } else if (type == "image") {
+        // Image above its file name, a placeholder until it is decoded
+        imageLabel = new QLabel();
+        bubbleLayout->addWidget(imageLabel);
+        bubbleLayout->addWidget(messageLabel);
+        setImageSize(QSize(MaxImageEdge, MaxImageEdge * 3 / 4));
     } else {
         bubbleLayout->addWidget(messageLabel);
     }
@@ -78,6 +89,11 @@ void ChatBubble::setupUI()
         mainLayout->addStretch();
     }
     
+    // Attachments open on click
+    if (type == "file" || type == "image") {
+        setCursor(Qt::PointingHandCursor);
+    }
+
     // Set object name for style
     if (fromMe) {
         bubbleWidget->setObjectName("myBubble");
@@ -86,6 +102,77 @@ void ChatBubble::setupUI()
     }
 }
 
+QSize ChatBubble::displaySize(const QSize &imageSize)
+{
+    if (imageSize.isEmpty()) {
+        return QSize(MaxImageEdge, MaxImageEdge * 3 / 4);
+    }
+    if (imageSize.width() <= MaxImageEdge && imageSize.height() <= MaxImageEdge) {
+        return imageSize;
+    }
+    return imageSize.scaled(MaxImageEdge, MaxImageEdge, Qt::KeepAspectRatio);
+}
+
+void ChatBubble::setImageSize(const QSize &size)
+{
+    if (!imageLabel) {
+        return;
+    }
+
+    QSize shown = displaySize(size);
+    imageLabel->setFixedSize(shown);
+
+    // Plain rounded block in the bubble colour range, cheap to paint
+    QPixmap placeholder(shown);
+    placeholder.fill(QColor(0, 0, 0, 30));
+    imageLabel->setPixmap(createRoundedPixmap(placeholder, ImageRadius));
+}
+
+void ChatBubble::setImage(const QPixmap &pixmap)
+{
+    if (!imageLabel || pixmap.isNull()) {
+        return;
+    }
+
+    // The cache already decoded to display size, no scaling while painting
+    imageLabel->setFixedSize(pixmap.size());
+    imageLabel->setPixmap(createRoundedPixmap(pixmap, ImageRadius));
+}
+
+void ChatBubble::setProgress(qint64 bytesDone, qint64 bytesTotal)
+{
+    if (bytesTotal <= 0 || bytesDone >= bytesTotal) {
+        clearProgress();
+        return;
+    }
+
+    if (!progressBar) {
+        // Between the content and the timestamp
+        progressBar = new QProgressBar();
+        progressBar->setRange(0, 1000);
+        progressBar->setTextVisible(false);
+        progressBar->setFixedHeight(4);
+        bubbleLayout->insertWidget(bubbleLayout->count() - 1, progressBar);
+    }
+
+    // Per mille, file sizes overflow the int range
+    progressBar->setValue(int(bytesDone * 1000 / bytesTotal));
+}
+
+void ChatBubble::clearProgress()
+{
+    delete progressBar;
+    progressBar = nullptr;
+}
+
+void ChatBubble::mouseReleaseEvent(QMouseEvent *event)
+{
+    if (event->button() == Qt::LeftButton && (type == "file" || type == "image")) {
+        emit attachmentClicked();
+    }
+    QWidget::mouseReleaseEvent(event);
+}
+
 void ChatBubble::paintEvent(QPaintEvent *event)
 {
     Q_UNUSED(event);
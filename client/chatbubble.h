@@ -3,6 +3,9 @@
 
 #include <QWidget>
 #include <QLabel>
+#include <QProgressBar>
+
+class QVBoxLayout;
 
 class ChatBubble : public QWidget
 {
@@ -13,8 +16,24 @@ public:
                         bool fromMe, const QString &type = "text", 
                         QWidget *parent = nullptr);
 
+    // Image bubbles: reserve the final size up front so the chat does not
+    // jump when the decoded image replaces the placeholder
+    void setImageSize(const QSize &size);
+    void setImage(const QPixmap &pixmap);
+
+    // Largest size an image is shown at, decode to this and no further
+    static QSize displaySize(const QSize &imageSize);
+
+    // Upload or download progress of the attachment, hidden once complete
+    void setProgress(qint64 bytesDone, qint64 bytesTotal);
+    void clearProgress();
+
+signals:
+    void attachmentClicked();
+
 protected:
     void paintEvent(QPaintEvent *event) override;
+    void mouseReleaseEvent(QMouseEvent *event) override;
 
 private:
     void setupUI();
@@ -28,6 +47,12 @@ private:
     QLabel *messageLabel;
     QLabel *timestampLabel;
     QLabel *fileIconLabel;
+    QLabel *imageLabel;
+    QVBoxLayout *bubbleLayout;
+    QProgressBar *progressBar;
+
+    static constexpr int MaxImageEdge = 280;
+    static constexpr int ImageRadius = 8;
 };
 
 #endif // CHATBUBBLE_H
\ No newline at end of file
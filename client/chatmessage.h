@@ -0,0 +1,70 @@
+#ifndef CHATMESSAGE_H
+#define CHATMESSAGE_H
+
+#include <QString>
+#include <QDateTime>
+#include <QJsonObject>
+#include <QList>
+#include <QSize>
+#include <QMetaType>
+
+#include "utils.h"
+
+// A message already decoded from JSON and ready to be shown in a bubble.
+// Built on the network thread so the GUI thread only creates widgets.
+class ChatMessage
+{
+public:
+    ChatMessage()
+        : id(-1), senderId(-1), receiverId(-1), type("text")
+        , attachmentId(-1), attachmentSize(0), thumbnailBytes(0) {}
+
+    static ChatMessage fromJson(const QJsonObject &json) {
+        ChatMessage message;
+        message.id = json["id"].toInt(-1);
+        message.senderId = json["senderId"].toInt(-1);
+        message.receiverId = json["receiverId"].toInt(-1);
+        message.senderName = json["senderName"].toString();
+        message.content = json["content"].toString();
+        message.type = json.contains("type") ? json["type"].toString() : "text";
+        message.timestamp = QDateTime::fromString(json["timestamp"].toString(), Qt::ISODate);
+        message.displayTime = Utils::formatTimestamp(message.timestamp);
+
+        if (json.contains("attachment")) {
+            QJsonObject attachment = json["attachment"].toObject();
+            message.attachmentId = attachment["id"].toInt(-1);
+            message.attachmentName = attachment["name"].toString();
+            message.attachmentSize = qint64(attachment["size"].toDouble());
+            message.sha256 = attachment["sha256"].toString();
+
+            QJsonObject thumbnail = attachment["thumbnail"].toObject();
+            message.thumbnailSize = QSize(thumbnail["width"].toInt(), thumbnail["height"].toInt());
+            message.thumbnailBytes = qint64(thumbnail["size"].toDouble());
+        }
+        return message;
+    }
+
+    bool isValid() const { return senderId != -1; }
+    bool hasThumbnail() const { return attachmentId != -1 && thumbnailBytes > 0 && !thumbnailSize.isEmpty(); }
+
+    int id;
+    int senderId;
+    int receiverId;
+    QString senderName;
+    QString content;
+    QString type;
+    QDateTime timestamp;
+    QString displayTime;
+
+    // Attachment, attachmentId is -1 for plain messages
+    int attachmentId;
+    QString attachmentName;
+    qint64 attachmentSize;
+    QString sha256;
+    QSize thumbnailSize;
+    qint64 thumbnailBytes;
+};
+
+Q_DECLARE_METATYPE(ChatMessage)
+
+#endif // CHATMESSAGE_H
@@ -13,8 +13,16 @@ SOURCES += \
     registerwindow.cpp \
     mainwindow.cpp \
     chatbubble.cpp \
+    imagecache.cpp \
     contactlistitem.cpp \
+    addcontactdialog.cpp \
+    messageindex.cpp \
     networkclient.cpp \
+    framedecoder.cpp \
+    networkworker.cpp \
+    session.cpp \
+    transfermanager.cpp \
+    attachmentcache.cpp \
     utils.cpp
 
 HEADERS += \
@@ -22,8 +30,17 @@ HEADERS += \
     registerwindow.h \
     mainwindow.h \
     chatbubble.h \
+    imagecache.h \
     contactlistitem.h \
+    addcontactdialog.h \
+    messageindex.h \
     networkclient.h \
+    framedecoder.h \
+    networkworker.h \
+    session.h \
+    transfermanager.h \
+    attachmentcache.h \
+    chatmessage.h \
     utils.h
 
 RESOURCES += \
@@ -149,6 +149,11 @@ void ContactListItem::updateLastMessage(const QString &message, const QString &t
     timeLabel->setText(timestamp);
 }
 
+void ContactListItem::setSearchPreview(const QString &message)
+{
+    messageLabel->setText(message.isEmpty() ? lastMessage : message);
+}
+
 void ContactListItem::incrementUnreadCount()
 {
     unreadCount++;
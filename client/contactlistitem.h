@@ -17,6 +17,9 @@ public:
     QString contactName() const { return name; }
     
     void updateLastMessage(const QString &message, const QString &timestamp);
+
+    // Shows a matching message in place of the last one, empty restores it
+    void setSearchPreview(const QString &message);
     void incrementUnreadCount();
     void resetUnreadCount();
 
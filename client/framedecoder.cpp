@@ -0,0 +1,164 @@
+#include "framedecoder.h"
+
+#include <QJsonDocument>
+#include <QElapsedTimer>
+#include <cctype>
+
+FrameDecoder::FrameDecoder()
+    : readPos(0)
+    , scanPos(0)
+    , discarding(false)
+    , lastSize(0)
+    , rawLength(-1)
+{
+}
+
+void FrameDecoder::append(const QByteArray &data)
+{
+    if (data.isEmpty()) {
+        return;
+    }
+
+    if (discarding) {
+        // Still inside an oversized frame, only keep what follows its delimiter
+        qsizetype end = data.indexOf('\n');
+        if (end < 0) {
+            return;
+        }
+        discarding = false;
+        buffer.append(data.constData() + end + 1, data.size() - end - 1);
+        return;
+    }
+
+    compact();
+    buffer.append(data);
+}
+
+FrameDecoder::Result FrameDecoder::next(QJsonObject &frame, QJsonParseError *error)
+{
+    lastPayload.clear();
+
+    while (true) {
+        if (rawLength >= 0) {
+            // Payload bytes are taken as they are, newlines included
+            if (bufferedBytes() < rawLength) {
+                return NeedMoreData;
+            }
+
+            lastPayload = buffer.mid(readPos, rawLength);
+            readPos += rawLength;
+            scanPos = readPos;
+            rawLength = -1;
+
+            frame = rawHeader;
+            rawHeader = QJsonObject();
+            return FrameDecoded;
+        }
+
+        qsizetype end = buffer.indexOf('\n', scanPos);
+
+        if (end < 0) {
+            // No complete frame yet, remember how far we already looked
+            scanPos = buffer.size();
+
+            if (bufferedBytes() > MaxFrameSize) {
+                buffer.clear();
+                readPos = 0;
+                scanPos = 0;
+                discarding = true;
+                return InvalidFrame;
+            }
+            return NeedMoreData;
+        }
+
+        qsizetype begin = readPos;
+        readPos = end + 1;
+        scanPos = readPos;
+
+        // Trim surrounding whitespace without copying the frame
+        while (begin < end && isspace(static_cast<unsigned char>(buffer.at(begin)))) {
+            ++begin;
+        }
+        qsizetype last = end;
+        while (last > begin && isspace(static_cast<unsigned char>(buffer.at(last - 1)))) {
+            --last;
+        }
+
+        if (last == begin) {
+            continue; // Empty line
+        }
+
+        const QByteArray slice = QByteArray::fromRawData(buffer.constData() + begin, last - begin);
+
+        QElapsedTimer timer;
+        timer.start();
+
+        QJsonParseError parseError;
+        QJsonDocument doc = QJsonDocument::fromJson(slice, &parseError);
+
+        decodeStats.decodeNsecs += timer.nsecsElapsed();
+        decodeStats.bytes += slice.size();
+        lastSize = slice.size();
+
+        if (error) {
+            *error = parseError;
+        }
+
+        if (parseError.error != QJsonParseError::NoError || !doc.isObject()) {
+            return InvalidFrame;
+        }
+
+        ++decodeStats.frames;
+        frame = doc.object();
+
+        if (isRawFrame(frame)) {
+            qint64 length = qint64(frame["length"].toDouble(-1));
+            if (length < 0 || length > MaxFrameSize) {
+                return InvalidFrame;
+            }
+
+            // Hold the header back until its payload is complete
+            rawHeader = frame;
+            rawLength = length;
+            continue;
+        }
+
+        return FrameDecoded;
+    }
+}
+
+void FrameDecoder::reset()
+{
+    buffer.clear();
+    readPos = 0;
+    scanPos = 0;
+    discarding = false;
+    rawHeader = QJsonObject();
+    rawLength = -1;
+    lastPayload.clear();
+}
+
+void FrameDecoder::compact()
+{
+    if (readPos == 0) {
+        return;
+    }
+
+    if (readPos >= buffer.size()) {
+        // Everything consumed, keep the allocation for the next read
+        buffer.resize(0);
+        readPos = 0;
+        scanPos = 0;
+        return;
+    }
+
+    // Only move the unconsumed tail once it dominates the buffer,
+    // so a large frame arriving in many segments is not shifted on every read
+    if (readPos < buffer.size() / 2) {
+        return;
+    }
+
+    buffer.remove(0, readPos);
+    scanPos -= readPos;
+    readPos = 0;
+}
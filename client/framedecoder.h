@@ -0,0 +1,68 @@
+#ifndef FRAMEDECODER_H
+#define FRAMEDECODER_H
+
+#include <QByteArray>
+#include <QJsonObject>
+#include <QJsonParseError>
+
+// Incremental decoder for the newline-delimited JSON protocol.
+// Bytes are appended as they arrive; partial frames stay buffered until
+// their delimiter shows up in a later read. A download header with
+// "raw": true and a "length" is followed by that many bytes of binary
+// payload, which is returned together with the header as one frame.
+class FrameDecoder
+{
+public:
+    enum Result {
+        NeedMoreData,
+        FrameDecoded,
+        InvalidFrame
+    };
+
+    struct Stats {
+        qint64 frames = 0;
+        qint64 bytes = 0;
+        qint64 decodeNsecs = 0;
+
+        double megabytesPerSecond() const {
+            return decodeNsecs > 0 ? (bytes / 1048576.0) / (decodeNsecs / 1e9) : 0.0;
+        }
+    };
+
+    FrameDecoder();
+
+    void append(const QByteArray &data);
+    Result next(QJsonObject &frame, QJsonParseError *error = nullptr);
+    void reset();
+
+    qsizetype bufferedBytes() const { return buffer.size() - readPos; }
+    qint64 lastFrameSize() const { return lastSize; }
+
+    // Binary payload of the frame last returned, empty for plain JSON frames
+    const QByteArray &payload() const { return lastPayload; }
+    const Stats &stats() const { return decodeStats; }
+
+    // Only download responses may carry a payload, so a pushed message
+    // relayed from another user can never claim one
+    static bool isRawFrame(const QJsonObject &frame) {
+        return frame["raw"].toBool() && frame["action"].toString() == "download";
+    }
+
+    // Frames larger than this are dropped instead of growing the buffer forever
+    static const qsizetype MaxFrameSize = 64 * 1024 * 1024;
+
+private:
+    void compact();
+
+    QByteArray buffer;
+    qsizetype readPos;   // start of the first unconsumed frame
+    qsizetype scanPos;   // where the next delimiter search resumes
+    bool discarding;     // skipping the rest of an oversized frame
+    qint64 lastSize;
+    QJsonObject rawHeader;
+    qint64 rawLength;    // payload still expected for rawHeader, -1 if none
+    QByteArray lastPayload;
+    Stats decodeStats;
+};
+
+#endif // FRAMEDECODER_H
@@ -0,0 +1,82 @@
+#include "imagecache.h"
+
+#include <QImageReader>
+#include <QBuffer>
+#include <QThreadPool>
+#include <QPointer>
+
+ImageCache::ImageCache(qint64 budgetBytes, QObject *parent)
+    : QObject(parent)
+{
+    cache.setMaxCost(int(qMax<qint64>(1, budgetBytes / 1024)));
+}
+
+QPixmap ImageCache::find(const QString &key) const
+{
+    QPixmap *pixmap = cache.object(key);
+    return pixmap ? *pixmap : QPixmap();
+}
+
+void ImageCache::decode(const QString &key, const QByteArray &data, const QSize &displaySize)
+{
+    start(key, data, QString(), displaySize);
+}
+
+void ImageCache::decodeFile(const QString &key, const QString &path, const QSize &displaySize)
+{
+    start(key, QByteArray(), path, displaySize);
+}
+
+void ImageCache::start(const QString &key, const QByteArray &data, const QString &path,
+                       const QSize &displaySize)
+{
+    if (pending.contains(key) || cache.contains(key)) {
+        return;
+    }
+    pending.insert(key);
+
+    QPointer<ImageCache> self(this);
+    QThreadPool::globalInstance()->start([self, key, data, path, displaySize]() {
+        QBuffer buffer;
+        QImageReader reader;
+        if (path.isEmpty()) {
+            buffer.setData(data);
+            buffer.open(QIODevice::ReadOnly);
+            reader.setDevice(&buffer);
+        } else {
+            reader.setFileName(path);
+        }
+        reader.setAutoTransform(true);
+
+        // Never decode more pixels than the bubble shows
+        QSize size = reader.size();
+        if (size.isValid() && (size.width() > displaySize.width() || size.height() > displaySize.height())) {
+            size.scale(displaySize, Qt::KeepAspectRatio);
+            reader.setScaledSize(size);
+        }
+        QImage image = reader.read();
+
+        QMetaObject::invokeMethod(self, [self, key, image]() {
+            if (self) {
+                self->finished(key, image);
+            }
+        }, Qt::QueuedConnection);
+    });
+}
+
+void ImageCache::finished(const QString &key, const QImage &image)
+{
+    pending.remove(key);
+
+    if (image.isNull()) {
+        emit imageFailed(key);
+        return;
+    }
+
+    // Pixmaps belong to the GUI thread, convert only now
+    QPixmap *pixmap = new QPixmap(QPixmap::fromImage(image));
+    int cost = qMax(1, int(qint64(pixmap->width()) * pixmap->height() * pixmap->depth() / 8 / 1024));
+    cache.insert(key, pixmap, cost);
+
+    emit imageReady(key);
+}
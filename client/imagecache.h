@@ -0,0 +1,41 @@
+#ifndef IMAGECACHE_H
+#define IMAGECACHE_H
+
+#include <QObject>
+#include <QCache>
+#include <QPixmap>
+#include <QSet>
+#include <QSize>
+
+// Decodes images on the global thread pool straight to their display size
+// and keeps the resulting pixmaps in an LRU bounded by memory, so bubbles
+// never decode on the GUI thread and scrolling back is free.
+class ImageCache : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit ImageCache(qint64 budgetBytes = 64 * 1024 * 1024, QObject *parent = nullptr);
+
+    // Null pixmap if the key is not cached (yet)
+    QPixmap find(const QString &key) const;
+    bool isPending(const QString &key) const { return pending.contains(key); }
+
+    // Decode in the background, imageReady(key) follows once it is cached
+    void decode(const QString &key, const QByteArray &data, const QSize &displaySize);
+    void decodeFile(const QString &key, const QString &path, const QSize &displaySize);
+
+signals:
+    void imageReady(const QString &key);
+    void imageFailed(const QString &key);
+
+private:
+    void start(const QString &key, const QByteArray &data, const QString &path,
+               const QSize &displaySize);
+    void finished(const QString &key, const QImage &image);
+
+    QCache<QString, QPixmap> cache;     // cost in KB
+    QSet<QString> pending;
+};
+
+#endif // IMAGECACHE_H
@@ -16,16 +16,17 @@
 #include <QApplication>
 
 
-LoginWindow::LoginWindow(QWidget *parent)
+LoginWindow::LoginWindow(Session *session, QWidget *parent)
     : QMainWindow(parent)
-    , networkClient(new NetworkClient(this)) // should match header order
+    , session(session) // should match header order
     , isDarkTheme(false)
+    , awaitingLogin(false)
 {
     setupUI();
     
-    // Connect network signals
-    connect(networkClient, &NetworkClient::responseReceived, 
-            this, &LoginWindow::onNetworkResponse);
+    // Connect session signals
+    connect(session, &Session::loggedIn, this, &LoginWindow::onLoggedIn);
+    connect(session, &Session::loginFailed, this, &LoginWindow::onLoginFailed);
     
     // Load saved credentials if available
     QSettings settings;
@@ -163,21 +164,16 @@ void LoginWindow::onLoginClicked()
     // Hash the password
     QString hashedPassword = Utils::hashPassword(password);
     
-    // Prepare login request
-    QJsonObject request;
-    request["action"] = "login";
-    request["username"] = username;
-    request["password"] = hashedPassword;
-    
-    // Send login request
+    // Send login request over the shared connection
     loginButton->setEnabled(false);
     loginButton->setText("Logging in...");
-    networkClient->sendRequest(request);
+    awaitingLogin = true;
+    session->login(username, hashedPassword);
 }
 
 void LoginWindow::onRegisterClicked()
 {
-    RegisterWindow *registerWindow = new RegisterWindow(this);
+    RegisterWindow *registerWindow = new RegisterWindow(session, this);
     registerWindow->setAttribute(Qt::WA_DeleteOnClose);
     registerWindow->show();
     hide();
@@ -206,28 +202,39 @@ void LoginWindow::loadStyleSheet(const QString &path)
 
 
 
-void LoginWindow::onNetworkResponse(const QJsonObject &response)
+void LoginWindow::onLoggedIn(int userId, const QString &username)
 {
+    Q_UNUSED(userId);
+    Q_UNUSED(username);
+
+    // Another login window may have started this login
+    if (!awaitingLogin) {
+        return;
+    }
+    awaitingLogin = false;
+
     loginButton->setEnabled(true);
     loginButton->setText("Login");
+    passwordEdit->clear();
     
-    QString status = response["status"].toString();
-    
-    if (status == "success") {
-        // Extract user data
-        QJsonObject userData = response["user"].toObject();
-        int userId = userData["id"].toInt();
-        QString username = userData["username"].toString();
-        
-        // Open main window
-        MainWindow *mainWindow = new MainWindow(userId, username);
-        mainWindow->setAttribute(Qt::WA_DeleteOnClose);
-        mainWindow->show();
-        mainWindow->loadContacts();
-        hide();
-    } else {
-        // Show error message
-        QString errorMessage = response["message"].toString();
-        statusLabel->setText(errorMessage);
+    // Open main window on the already authenticated connection
+    MainWindow *mainWindow = new MainWindow(session);
+    mainWindow->setAttribute(Qt::WA_DeleteOnClose);
+    mainWindow->show();
+    mainWindow->loadContacts();
+    hide();
+}
+
+void LoginWindow::onLoginFailed(const QString &errorMessage)
+{
+    if (!awaitingLogin) {
+        return;
     }
+    awaitingLogin = false;
+
+    loginButton->setEnabled(true);
+    loginButton->setText("Login");
+    
+    // Show error message
+    statusLabel->setText(errorMessage);
 }
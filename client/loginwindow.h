@@ -6,21 +6,22 @@
 #include <QPushButton>
 #include <QLabel>
 #include <QCheckBox>
-#include "networkclient.h"
+#include "session.h"
 
 class LoginWindow : public QMainWindow
 {
     Q_OBJECT
 
 public:
-    explicit LoginWindow(QWidget *parent = nullptr);
+    explicit LoginWindow(Session *session, QWidget *parent = nullptr);
     ~LoginWindow();
 
 private slots:
     void onLoginClicked();
     void onRegisterClicked();
     void onToggleTheme();
-    void onNetworkResponse(const QJsonObject &response);
+    void onLoggedIn(int userId, const QString &username);
+    void onLoginFailed(const QString &errorMessage);
 
 private:
     void setupUI();
@@ -33,8 +34,9 @@ private:
     QPushButton *themeButton;
     QLabel *statusLabel;
     QCheckBox *rememberMeCheckBox;
-    NetworkClient *networkClient;
+    Session *session;
     bool isDarkTheme;
+    bool awaitingLogin;
     
 
 };
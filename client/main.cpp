@@ -1,4 +1,5 @@
 #include "loginwindow.h"
+#include "session.h"
 
 #include <QApplication>
 #include <QFile>
@@ -21,8 +22,11 @@ int main(int argc, char *argv[])
         styleFile.close();
     }
     
+    // One connection shared by every window for the whole run
+    Session session;
+    
     // Create and show login window
-    LoginWindow loginWindow;
+    LoginWindow loginWindow(&session);
     loginWindow.show();
     
     return app.exec();
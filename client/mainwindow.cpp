@@ -1,12 +1,15 @@
 #include "mainwindow.h"
 #include "loginwindow.h"
 #include "contactlistitem.h"
+#include "addcontactdialog.h"
 #include "utils.h"
 
 #include <QVBoxLayout>
 #include <QHBoxLayout>
 #include <QScrollArea>
 #include <QFile>
+#include <QFileInfo>
+#include <QRegularExpression>
 #include <QMenuBar>
 #include <QMenu>
 #include <QAction>
@@ -17,39 +20,71 @@
 #include <QDateTime>
 #include <QScrollBar>
 #include <QIcon>
-#include <QInputDialog>
 #include <QStatusBar>
 #include <QApplication>
+#include <QDesktopServices>
+#include <QUrl>
 
 
-MainWindow::MainWindow(int userId, const QString &username, QWidget *parent)
+MainWindow::MainWindow(Session *session, QWidget *parent)
     : QMainWindow(parent)
-    , networkClient(new NetworkClient(this))
-    , currentUserId(userId)
-    , currentUsername(username)
+    , session(session)
+    , networkClient(session->networkClient())
+    , currentUserId(session->userId())
+    , currentUsername(session->username())
     , selectedContactId(-1)
     , isDarkTheme(false)
+    , searchTimer(new QTimer(this))
+    , imageCache(new ImageCache(ImageCacheBudget, this))
+    , transfers(new TransferManager(session, this))
 {
     setupUI();
     setupMenuBar();
 
+    // Filter once typing pauses rather than on every keystroke
+    searchTimer->setSingleShot(true);
+    searchTimer->setInterval(SearchDebounce);
+    connect(searchTimer, &QTimer::timeout, this, [this]() {
+        filterContacts(searchEdit->text());
+    });
+
     // Connect network signals
     connect(networkClient, &NetworkClient::responseReceived,
             this, &MainWindow::onNetworkResponse);
+    connect(networkClient, &NetworkClient::chatHistoryReceived,
+            this, &MainWindow::onChatHistoryReceived);
     connect(networkClient, &NetworkClient::messageReceived,
             this, &MainWindow::onMessageReceived);
-    connect(networkClient, &NetworkClient::connected, [this]() {
+    connect(networkClient, &NetworkClient::payloadReceived,
+            this, &MainWindow::onPayloadReceived);
+    connect(imageCache, &ImageCache::imageReady, this, &MainWindow::onImageReady);
+    connect(imageCache, &ImageCache::imageFailed, this, [this](const QString &key) {
+        imageBubbles.remove(key);
+    });
+    connect(transfers, &TransferManager::progress, this, &MainWindow::onTransferProgress);
+    connect(transfers, &TransferManager::uploadFinished, this, &MainWindow::onUploadFinished);
+    connect(transfers, &TransferManager::downloadFinished, this, &MainWindow::onDownloadFinished);
+    connect(transfers, &TransferManager::transferFailed, this, &MainWindow::onTransferFailed);
+    connect(networkClient, &NetworkClient::connected, this, [this]() {
         connectionStatusLabel->setText("Connected");
         connectionStatusLabel->setStyleSheet("color: green;");
-
-        // Load contacts when connected to server
-        QTimer::singleShot(500, this, &MainWindow::loadContacts);
     });
-    connect(networkClient, &NetworkClient::disconnected, [this]() {
+    connect(networkClient, &NetworkClient::disconnected, this, [this]() {
+        // Unanswered thumbnail downloads are gone with the connection
+        thumbnailRequests.clear();
         connectionStatusLabel->setText("Disconnected");
         connectionStatusLabel->setStyleSheet("color: red;");
     });
 
+    // Reload contacts once the session is re-authenticated after a reconnect
+    connect(session, &Session::sessionRestored, this, &MainWindow::onSessionRestored);
+
+    // The login window hands over an already connected session
+    if (networkClient->isConnected()) {
+        connectionStatusLabel->setText("Connected");
+        connectionStatusLabel->setStyleSheet("color: green;");
+    }
+
     // Start with welcome screen
     showWelcomeScreen();
 }
@@ -108,7 +143,7 @@ void MainWindow::setupUI()
 
     // Search box
     searchEdit = new QLineEdit();
-    searchEdit->setPlaceholderText("Search contacts...");
+    searchEdit->setPlaceholderText("Search contacts and messages...");
     searchEdit->setClearButtonEnabled(true);
 
     // Contacts list
@@ -300,6 +335,9 @@ void MainWindow::setupMenuBar()
     QAction *newContactAction = contactsMenu->addAction("Add New Contact");
     connect(newContactAction, &QAction::triggered, this, &MainWindow::onNewContactClicked);
 
+    QAction *importContactsAction = contactsMenu->addAction("Import Contacts...");
+    connect(importContactsAction, &QAction::triggered, this, &MainWindow::onImportContacts);
+
     QAction *refreshContactsAction = contactsMenu->addAction("Refresh Contacts");
     connect(refreshContactsAction, &QAction::triggered, this, &MainWindow::loadContacts);
 
@@ -329,12 +367,38 @@ void MainWindow::loadContacts()
     contactsList->clear();
 
     // Request contacts from server
+    networkClient->sendRequest(contactsRequest());
+    statusLabel->setText("Loading contacts...");
+}
+
+void MainWindow::onSessionRestored()
+{
+    if (selectedContactId == -1) {
+        loadContacts();
+        return;
+    }
+
+    // Contacts and the open conversation in one round trip
+    contactsList->clear();
+    networkClient->sendBatch({ contactsRequest(), chatHistoryRequest(selectedContactId) });
+    statusLabel->setText("Loading contacts...");
+}
+
+QJsonObject MainWindow::contactsRequest() const
+{
     QJsonObject request;
     request["action"] = "getContacts";
     request["userId"] = currentUserId;
+    return request;
+}
 
-    networkClient->sendRequest(request);
-    statusLabel->setText("Loading contacts...");
+QJsonObject MainWindow::chatHistoryRequest(int contactId) const
+{
+    QJsonObject request;
+    request["action"] = "getChatHistory";
+    request["userId"] = currentUserId;
+    request["contactId"] = contactId;
+    return request;
 }
 
 
@@ -351,21 +415,26 @@ void MainWindow::onSendMessage()
 
 void MainWindow::sendMessage(const QString &content, const QString &type)
 {
-    // Prepare message data
+    QJsonObject request = messageRequest(selectedContactId, content, type);
+
+    // Send to server, the session resends it if the connection drops first
+    request["clientMessageId"] = session->sendMessage(request);
+
+    // Add message to local chat (optimistic UI update)
+    addMessageToChat(request);
+}
+
+QJsonObject MainWindow::messageRequest(int receiverId, const QString &content, const QString &type) const
+{
     QJsonObject request;
     request["action"] = "sendMessage";
     request["senderId"] = currentUserId;
     request["senderName"] = currentUsername;
-    request["receiverId"] = selectedContactId;
+    request["receiverId"] = receiverId;
     request["content"] = content;
     request["type"] = type;
     request["timestamp"] = QDateTime::currentDateTime().toString(Qt::ISODate);
-
-    // Send to server
-    networkClient->sendRequest(request);
-
-    // Add message to local chat (optimistic UI update)
-    addMessageToChat(request);
+    return request;
 }
 
 void MainWindow::onAttachFile()
@@ -383,10 +452,77 @@ void MainWindow::onAttachFile()
     QFileInfo fileInfo(filePath);
     QString fileName = fileInfo.fileName();
 
-    // For this demo, we just send the file name
-    // In a real app, you'd upload the file and send a reference
-    QString message = "File: " + fileName;
-    sendMessage(message, "file");
+    // The bubble shows the upload, the message follows once it is stored
+    ChatBubble *bubble = addMessageToChat(messageRequest(selectedContactId, fileName, "file"));
+
+    int transferId = transfers->upload(filePath);
+    pendingUploads.insert(transferId, { selectedContactId, fileName });
+    transferBubbles.insert(transferId, bubble);
+    statusLabel->setText("Sending " + fileName + "...");
+}
+
+void MainWindow::openAttachment(const ChatMessage &message, ChatBubble *bubble)
+{
+    // Anything sent or downloaded before opens straight from the disk cache
+    QString path = transfers->cachedPath(message.sha256);
+    if (!path.isEmpty()) {
+        QDesktopServices::openUrl(QUrl::fromLocalFile(path));
+        return;
+    }
+
+    int transferId = transfers->download(message.attachmentId, message.sha256,
+                                         message.attachmentName, message.attachmentSize);
+    transferBubbles.insert(transferId, bubble);
+    openWhenDownloaded.insert(transferId);
+    statusLabel->setText("Downloading " + message.attachmentName + "...");
+}
+
+void MainWindow::onTransferProgress(int transferId, qint64 bytesDone, qint64 bytesTotal)
+{
+    if (ChatBubble *bubble = transferBubbles.value(transferId)) {
+        bubble->setProgress(bytesDone, bytesTotal);
+    }
+}
+
+void MainWindow::onUploadFinished(int transferId, int attachmentId, const QString &sha256)
+{
+    Q_UNUSED(sha256);
+
+    if (ChatBubble *bubble = transferBubbles.take(transferId)) {
+        bubble->clearProgress();
+    }
+
+    // The conversation may have changed meanwhile, the message goes where
+    // the file was picked
+    PendingUpload upload = pendingUploads.take(transferId);
+    QJsonObject request = messageRequest(upload.receiverId, upload.name, "file");
+    request["attachmentId"] = attachmentId;
+    session->sendMessage(request);
+
+    statusLabel->setText(upload.name + " sent");
+}
+
+void MainWindow::onDownloadFinished(int transferId, const QString &path)
+{
+    if (ChatBubble *bubble = transferBubbles.take(transferId)) {
+        bubble->clearProgress();
+    }
+
+    if (openWhenDownloaded.remove(transferId)) {
+        QDesktopServices::openUrl(QUrl::fromLocalFile(path));
+    }
+    statusLabel->setText("Download complete");
+}
+
+void MainWindow::onTransferFailed(int transferId, const QString &errorMessage)
+{
+    if (ChatBubble *bubble = transferBubbles.take(transferId)) {
+        bubble->clearProgress();
+    }
+    pendingUploads.remove(transferId);
+    openWhenDownloaded.remove(transferId);
+
+    statusLabel->setText("Transfer failed: " + errorMessage);
 }
 
 void MainWindow::onContactSelected(int row)
@@ -429,11 +565,11 @@ void MainWindow::onContactSelected(int row)
 
 void MainWindow::onNewContactClicked()
 {
-    QString username = QInputDialog::getText(this, "Add Contact",
-                                             "Enter username to add:");
-    if (username.isEmpty()) {
+    AddContactDialog dialog(session, this);
+    if (dialog.exec() != QDialog::Accepted || dialog.username().isEmpty()) {
         return;
     }
+    QString username = dialog.username();
 
     // Send add contact request
     QJsonObject request;
@@ -444,24 +580,168 @@ void MainWindow::onNewContactClicked()
     networkClient->sendRequest(request);
 }
 
+void MainWindow::onImportContacts()
+{
+    QString path = QFileDialog::getOpenFileName(this, "Import Contacts", QString(),
+                                                "Address books (*.vcf *.csv *.txt);;All files (*)");
+    if (path.isEmpty()) {
+        return;
+    }
+
+    QStringList entries = readAddressBook(path);
+    if (entries.isEmpty()) {
+        QMessageBox::information(this, "Import Contacts", "No usernames or email addresses found in this file.");
+        return;
+    }
+    if (entries.size() > MaxContactImport) {
+        QMessageBox::warning(this, "Import Contacts",
+                             QString("Only the first %1 of %2 entries will be matched.")
+                                 .arg(MaxContactImport).arg(entries.size()));
+        entries = entries.mid(0, MaxContactImport);
+    }
+
+    // Ask who is on the server first, nothing is added until confirmed
+    QJsonObject request;
+    request["action"] = "matchContacts";
+    request["userId"] = currentUserId;
+    request["contacts"] = QJsonArray::fromStringList(entries);
+    networkClient->sendRequest(request);
+
+    statusLabel->setText(QString("Matching %1 contacts...").arg(entries.size()));
+}
+
+QStringList MainWindow::readAddressBook(const QString &path)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        return QStringList();
+    }
+
+    // vCards contribute their EMAIL lines; any other file is read as one
+    // or more usernames or emails per line, separated by commas or tabs
+    bool vcard = QFileInfo(path).suffix().compare("vcf", Qt::CaseInsensitive) == 0;
+    static const QRegularExpression separators("[,;\\t]");
+
+    QStringList entries;
+    QSet<QString> seen;
+    while (!file.atEnd()) {
+        QString line = QString::fromUtf8(file.readLine()).trimmed();
+
+        QStringList fields;
+        if (vcard) {
+            if (line.startsWith("EMAIL", Qt::CaseInsensitive) && line.contains(':')) {
+                fields.append(line.section(':', 1));
+            }
+        } else {
+            fields = line.split(separators, Qt::SkipEmptyParts);
+        }
+
+        for (QString field : fields) {
+            field = field.trimmed().remove('"');
+            if (!field.isEmpty() && !field.contains(' ') && !seen.contains(field.toLower())) {
+                seen.insert(field.toLower());
+                entries.append(field);
+            }
+        }
+    }
+
+    return entries;
+}
+
+void MainWindow::onContactsMatched(const QJsonObject &response)
+{
+    if (response["status"].toString() != "success") {
+        statusLabel->setText("Error: " + response["message"].toString());
+        return;
+    }
+
+    QStringList toAdd;
+    int known = 0;
+    const QJsonArray matches = response["matches"].toArray();
+    for (const QJsonValue &value : matches) {
+        QJsonObject match = value.toObject();
+        if (match["isContact"].toBool()) {
+            ++known;
+        } else {
+            toAdd.append(match["query"].toString());
+        }
+    }
+    int unmatched = response["unmatched"].toArray().size();
+
+    QString summary = QString("%1 of your contacts use Qt Messenger, %2 of them are already in your list.")
+                          .arg(matches.size()).arg(known);
+    if (unmatched > 0) {
+        summary += QString("\n%1 could not be found.").arg(unmatched);
+    }
+
+    if (toAdd.isEmpty()) {
+        QMessageBox::information(this, "Import Contacts", summary);
+        statusLabel->setText("No new contacts to add");
+        return;
+    }
+
+    summary += QString("\n\nAdd %1 new contacts?").arg(toAdd.size());
+    if (QMessageBox::question(this, "Import Contacts", summary) != QMessageBox::Yes) {
+        statusLabel->setText("Import cancelled");
+        return;
+    }
+
+    // All of them in one request and one server-side transaction
+    QJsonObject request;
+    request["action"] = "addContacts";
+    request["userId"] = currentUserId;
+    request["contacts"] = QJsonArray::fromStringList(toAdd);
+    networkClient->sendRequest(request);
+}
+
 void MainWindow::onSearchTextChanged(const QString &text)
 {
-    filterContacts(text);
+    // Clearing the field shows everything again right away
+    if (text.trimmed().isEmpty()) {
+        searchTimer->stop();
+        filterContacts(text);
+        return;
+    }
+    searchTimer->start();
 }
 
 void MainWindow::filterContacts(const QString &searchText)
 {
+    bool searching = !searchText.trimmed().isEmpty();
+    const QHash<int, MessageIndex::Match> matches = searching ? messageIndex.search(searchText)
+                                                              : QHash<int, MessageIndex::Match>();
+
     // Show/hide contacts based on search text
+    int messageMatches = 0;
     for (int i = 0; i < contactsList->count(); ++i) {
         QListWidgetItem *item = contactsList->item(i);
         ContactListItem *contactItem = dynamic_cast<ContactListItem*>(
             contactsList->itemWidget(item));
 
         if (contactItem) {
-            bool visible = contactItem->contactName().contains(searchText, Qt::CaseInsensitive);
-            item->setHidden(!visible);
+            auto match = matches.constFind(contactItem->contactId());
+            bool found = match != matches.constEnd();
+            item->setHidden(searching && !found);
+
+            // Contacts found through a message preview that message instead
+            bool preview = found && !match->nameMatches;
+            contactItem->setSearchPreview(preview ? match->latestMessage : QString());
+            if (found) {
+                messageMatches += match->messageMatches;
+            }
         }
     }
+
+    if (searching) {
+        statusLabel->setText(QString("%1 matching messages").arg(messageMatches));
+    }
+}
+
+void MainWindow::indexMessage(int messageId, int senderId, int receiverId, const QString &content)
+{
+    // Messages are filed under the other side of the conversation
+    int contactId = senderId == currentUserId ? receiverId : senderId;
+    messageIndex.addMessage(messageId, contactId, content);
 }
 
 void MainWindow::onSettingsClicked()
@@ -499,6 +779,7 @@ void MainWindow::onNetworkResponse(const QJsonObject &response)
                 QString lastMessage = contact["lastMessage"].toString();
                 QString lastMessageTime = contact["lastMessageTime"].toString();
                 int unreadCount = contact["unreadCount"].toInt();
+                messageIndex.addContact(contactId, contactName);
 
                 QListWidgetItem *item = new QListWidgetItem(contactsList);
                 item->setSizeHint(QSize(contactsList->width(), 60));
@@ -510,53 +791,55 @@ void MainWindow::onNetworkResponse(const QJsonObject &response)
             }
             statusLabel->setText("Contacts loaded successfully");
         }
+
+        // A reloaded list starts unfiltered, keep showing the current search
+        if (!searchEdit->text().trimmed().isEmpty()) {
+            filterContacts(searchEdit->text());
+        }
     }
     else if (action == "getChatHistory") {
-        // Clear current chat (remove loading indicator)
+        // Successful histories arrive pre-decoded through onChatHistoryReceived
         while (QLayoutItem *item = chatLayout->takeAt(0)) {
             delete item->widget();
             delete item;
         }
 
-        if (status == "success") {
-            // Process chat history
-            QJsonArray messages = response["messages"].toArray();
-
-            if (messages.isEmpty()) {
-                // Show "No messages yet" indicator
-                QLabel *emptyLabel = new QLabel("No messages yet. Start a conversation!");
-                emptyLabel->setAlignment(Qt::AlignCenter);
-                chatLayout->addWidget(emptyLabel);
-            } else {
-                // Add messages to chat
-                for (const QJsonValue &messageValue : messages) {
-                    QJsonObject message = messageValue.toObject();
-                    addMessageToChat(message);
-                }
-
-                statusLabel->setText("Chat history loaded successfully");
-            }
-        } else {
-            // Show error message in chat
-            QString errorMessage = response["message"].toString();
-            QLabel *errorLabel = new QLabel("Failed to load messages: " + errorMessage);
-            errorLabel->setAlignment(Qt::AlignCenter);
-            errorLabel->setStyleSheet("color: red;");
-            chatLayout->addWidget(errorLabel);
-
-            statusLabel->setText("Error loading chat history");
-        }
+        // Show error message in chat
+        QString errorMessage = response["message"].toString();
+        QLabel *errorLabel = new QLabel("Failed to load messages: " + errorMessage);
+        errorLabel->setAlignment(Qt::AlignCenter);
+        errorLabel->setStyleSheet("color: red;");
+        chatLayout->addWidget(errorLabel);
 
-        // Scroll to bottom
-        QTimer::singleShot(100, [this]() {
-            chatScrollArea->verticalScrollBar()->setValue(
-                chatScrollArea->verticalScrollBar()->maximum());
-        });
+        statusLabel->setText("Error loading chat history");
     }
     else if (action == "sendMessage" && status == "success") {
         // Message sent successfully, nothing to do
         // (we already added the message to the chat optimistically)
     }
+    else if (action == "download" && response["thumbnail"].toBool()) {
+        // Successful thumbnails arrive as raw frames, this is a failure
+        int attachmentId = response["attachmentId"].toInt();
+        imageBubbles.remove(thumbnailRequests.take(attachmentId).key);
+    }
+    else if (action == "uploadBegin" || action == "uploadChunk" || action == "download") {
+        // The transfer manager retries these and reports what it gives up on
+    }
+    else if (action == "searchUsers") {
+        // Suggestions for the add contact dialog, stale ones are just dropped
+    }
+    else if (action == "matchContacts") {
+        onContactsMatched(response);
+    }
+    else if (action == "addContacts") {
+        if (status == "success") {
+            loadContacts();
+            statusLabel->setText(QString("%1 contacts added").arg(response["added"].toArray().size()));
+        } else {
+            QString errorMessage = response["message"].toString();
+            QMessageBox::warning(this, "Error", "Failed to import contacts: " + errorMessage);
+        }
+    }
     else if (action == "addContact") {
         if (status == "success") {
             // Reload contacts
@@ -573,9 +856,50 @@ void MainWindow::onNetworkResponse(const QJsonObject &response)
     }
 }
 
+void MainWindow::onChatHistoryReceived(int contactId, const QList<ChatMessage> &messages)
+{
+    // Ignore histories for a conversation we already switched away from
+    if (contactId != -1 && contactId != selectedContactId) {
+        return;
+    }
+
+    // Batch the widget work so the layout is only recomputed once
+    chatContainer->setUpdatesEnabled(false);
+
+    // Clear current chat (remove loading indicator)
+    while (QLayoutItem *item = chatLayout->takeAt(0)) {
+        delete item->widget();
+        delete item;
+    }
+
+    if (messages.isEmpty()) {
+        // Show "No messages yet" indicator
+        QLabel *emptyLabel = new QLabel("No messages yet. Start a conversation!");
+        emptyLabel->setAlignment(Qt::AlignCenter);
+        chatLayout->addWidget(emptyLabel);
+    } else {
+        // Add messages to chat
+        for (const ChatMessage &message : messages) {
+            addMessageToChat(message);
+            indexMessage(message.id, message.senderId, message.receiverId, message.content);
+        }
+
+        statusLabel->setText("Chat history loaded successfully");
+    }
+
+    chatContainer->setUpdatesEnabled(true);
+
+    // Scroll to bottom
+    QTimer::singleShot(100, [this]() {
+        chatScrollArea->verticalScrollBar()->setValue(
+            chatScrollArea->verticalScrollBar()->maximum());
+    });
+}
+
 void MainWindow::onMessageReceived(const QJsonObject &message)
 {
     int senderId = message["senderId"].toInt();
+    indexMessage(message["id"].toInt(-1), senderId, message["receiverId"].toInt(), message["content"].toString());
 
     // Add message to chat if from current contact
     if (senderId == selectedContactId) {
@@ -615,31 +939,105 @@ void MainWindow::onMessageReceived(const QJsonObject &message)
             break;
         }
     }
+
+    // The new message may match, and moving the row reset its visibility
+    if (!searchEdit->text().trimmed().isEmpty()) {
+        filterContacts(searchEdit->text());
+    }
 }
 
-void MainWindow::addMessageToChat(const QJsonObject &message)
+ChatBubble *MainWindow::addMessageToChat(const QJsonObject &message)
 {
     // Check if we have all required fields
     if (!message.contains("senderId") || !message.contains("content") || !message.contains("timestamp")) {
         qDebug() << "Invalid message format:" << message;
-        return;
+        return nullptr;
     }
 
-    int senderId = message["senderId"].toInt();
-    QString content = message["content"].toString();
-    QString timestamp = message["timestamp"].toString();
-    QString type = message.contains("type") ? message["type"].toString() : "text";
-
-    // Convert timestamp to formatted string
-    QDateTime dateTime = QDateTime::fromString(timestamp, Qt::ISODate);
-    QString timeStr = Utils::formatTimestamp(dateTime);
+    return addMessageToChat(ChatMessage::fromJson(message));
+}
 
+ChatBubble *MainWindow::addMessageToChat(const ChatMessage &message)
+{
     // Create bubble widget
-    bool isFromMe = (senderId == currentUserId);
-    ChatBubble *bubble = new ChatBubble(content, timeStr, isFromMe, type);
+    bool isFromMe = (message.senderId == currentUserId);
+    QString type = message.hasThumbnail() ? "image" : message.type;
+    ChatBubble *bubble = new ChatBubble(message.content, message.displayTime, isFromMe, type);
+
+    if (message.hasThumbnail()) {
+        showImage(bubble, message);
+    }
+    if (message.attachmentId != -1) {
+        connect(bubble, &ChatBubble::attachmentClicked, this, [this, message, bubble]() {
+            openAttachment(message, bubble);
+        });
+    }
 
     // Add to layout
     chatLayout->addWidget(bubble);
+    return bubble;
+}
+
+void MainWindow::showImage(ChatBubble *bubble, const ChatMessage &message)
+{
+    // Scrolling back over decoded images never touches the decoder
+    QString key = message.sha256;
+    QPixmap pixmap = imageCache->find(key);
+    if (!pixmap.isNull()) {
+        bubble->setImage(pixmap);
+        return;
+    }
+
+    // Placeholder at the final size until the thumbnail is decoded
+    bubble->setImageSize(message.thumbnailSize);
+    imageBubbles.insert(key, bubble);
+
+    if (imageCache->isPending(key) || thumbnailRequests.contains(message.attachmentId)) {
+        return;
+    }
+
+    // The server scaled it already, fetch the bytes in one raw frame
+    thumbnailRequests.insert(message.attachmentId, { key, ChatBubble::displaySize(message.thumbnailSize) });
+
+    QJsonObject request;
+    request["action"] = "download";
+    request["userId"] = currentUserId;
+    request["attachmentId"] = message.attachmentId;
+    request["thumbnail"] = true;
+    request["raw"] = true;
+    request["length"] = double(message.thumbnailBytes);
+    networkClient->sendRequest(request);
+}
+
+void MainWindow::onPayloadReceived(const QJsonObject &header, const QByteArray &payload)
+{
+    if (header["action"].toString() != "download" || !header["thumbnail"].toBool()) {
+        return;
+    }
+
+    auto it = thumbnailRequests.find(header["attachmentId"].toInt());
+    if (it == thumbnailRequests.end()) {
+        return;
+    }
+    ThumbnailRequest thumbnail = *it;
+    thumbnailRequests.erase(it);
+
+    // Decoded off the GUI thread, onImageReady picks it up
+    imageCache->decode(thumbnail.key, payload, thumbnail.size);
+}
+
+void MainWindow::onImageReady(const QString &key)
+{
+    QPixmap pixmap = imageCache->find(key);
+
+    // Bubbles from a conversation we left are already deleted
+    const QList<QPointer<ChatBubble>> bubbles = imageBubbles.values(key);
+    for (const QPointer<ChatBubble> &bubble : bubbles) {
+        if (bubble) {
+            bubble->setImage(pixmap);
+        }
+    }
+    imageBubbles.remove(key);
 }
 
 void MainWindow::showWelcomeScreen()
@@ -650,17 +1048,11 @@ void MainWindow::showWelcomeScreen()
 
 void MainWindow::loadChatHistory(int contactId)
 {
-    // Request chat history
-    QJsonObject request;
-    request["action"] = "getChatHistory";
-    request["userId"] = currentUserId;
-    request["contactId"] = contactId;
-
     // Show loading status
     statusLabel->setText("Loading chat history...");
 
     // Send request to server
-    networkClient->sendRequest(request);
+    networkClient->sendRequest(chatHistoryRequest(contactId));
 
     // Debug output
     qDebug() << "Requesting chat history for contact ID:" << contactId;
@@ -695,11 +1087,11 @@ void MainWindow::onLogoutClicked()
         QMessageBox::Yes | QMessageBox::No);
 
     if (reply == QMessageBox::Yes) {
-        // Disconnect from server
-        networkClient->disconnect();
+        // Drop the login but keep the shared connection for the next one
+        session->logout();
 
         // Show login window
-        LoginWindow *loginWindow = new LoginWindow();
+        LoginWindow *loginWindow = new LoginWindow(session);
         loginWindow->setAttribute(Qt::WA_DeleteOnClose);
         loginWindow->show();
 
@@ -13,16 +13,24 @@
 #include <QTimer>
 #include <QJsonObject>
 #include <QDebug>
+#include <QHash>
+#include <QMultiHash>
+#include <QPointer>
+#include <QSet>
 
-#include "networkclient.h"
+#include "session.h"
 #include "chatbubble.h"
+#include "chatmessage.h"
+#include "imagecache.h"
+#include "transfermanager.h"
+#include "messageindex.h"
 
 class MainWindow : public QMainWindow
 {
     Q_OBJECT
 
 public:
-    MainWindow(int userId, const QString &username, QWidget *parent = nullptr);
+    explicit MainWindow(Session *session, QWidget *parent = nullptr);
     ~MainWindow();
     void loadContacts();
 
@@ -31,24 +39,43 @@ private slots:
     void onAttachFile();
     void onContactSelected(int row);
     void onNewContactClicked();
+    void onImportContacts();
     void onSearchTextChanged(const QString &text);
     void onSettingsClicked();
     void onToggleTheme();
     void onLogoutClicked();
     void onNetworkResponse(const QJsonObject &response);
+    void onChatHistoryReceived(int contactId, const QList<ChatMessage> &messages);
     void onMessageReceived(const QJsonObject &message);
+    void onSessionRestored();
+    void onPayloadReceived(const QJsonObject &header, const QByteArray &payload);
+    void onImageReady(const QString &key);
+    void onTransferProgress(int transferId, qint64 bytesDone, qint64 bytesTotal);
+    void onUploadFinished(int transferId, int attachmentId, const QString &sha256);
+    void onDownloadFinished(int transferId, const QString &path);
+    void onTransferFailed(int transferId, const QString &errorMessage);
 
 private:
     void setupUI();
     void setupMenuBar();
     void loadChatHistory(int contactId);
+    QJsonObject contactsRequest() const;
+    QJsonObject chatHistoryRequest(int contactId) const;
     void showWelcomeScreen();
     void filterContacts(const QString &searchText);
     void sendMessage(const QString &content, const QString &type = "text");
-    void addMessageToChat(const QJsonObject &message);
+    QJsonObject messageRequest(int receiverId, const QString &content, const QString &type) const;
+    ChatBubble *addMessageToChat(const QJsonObject &message);
+    ChatBubble *addMessageToChat(const ChatMessage &message);
+    void openAttachment(const ChatMessage &message, ChatBubble *bubble);
     void loadStyleSheet(const QString &path);
+    void showImage(ChatBubble *bubble, const ChatMessage &message);
+    void indexMessage(int messageId, int senderId, int receiverId, const QString &content);
+    static QStringList readAddressBook(const QString &path);
+    void onContactsMatched(const QJsonObject &response);
 
-    // Network client
+    // Shared connection, owned by the session
+    Session *session;
     NetworkClient *networkClient;
 
     // User data
@@ -85,6 +112,34 @@ private:
 
     // Theme state
     bool isDarkTheme;
+
+    // Local search over contact names and every message seen so far
+    MessageIndex messageIndex;
+    QTimer *searchTimer;
+    static constexpr int SearchDebounce = 150;      // ms
+
+    static constexpr int MaxContactImport = 1000;   // server limit per request
+
+    // Decoded thumbnails by content hash, and the bubbles waiting for them
+    struct ThumbnailRequest {
+        QString key;
+        QSize size;
+    };
+    ImageCache *imageCache;
+    QMultiHash<QString, QPointer<ChatBubble>> imageBubbles;
+    QHash<int, ThumbnailRequest> thumbnailRequests;    // by attachment id
+
+    // Attachments on their way, the bubble shows their progress
+    struct PendingUpload {
+        int receiverId;
+        QString name;
+    };
+    TransferManager *transfers;
+    QHash<int, QPointer<ChatBubble>> transferBubbles;  // by transfer id
+    QHash<int, PendingUpload> pendingUploads;
+    QSet<int> openWhenDownloaded;
+
+    static constexpr qint64 ImageCacheBudget = 64 * 1024 * 1024;
 };
 
 #endif // MAINWINDOW_H
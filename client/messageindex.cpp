@@ -0,0 +1,118 @@
+#include "messageindex.h"
+
+QStringList MessageIndex::tokenize(const QString &text)
+{
+    // Words are runs of letters and digits, compared case-insensitively
+    QStringList terms;
+    QString current;
+    for (QChar ch : text) {
+        if (ch.isLetterOrNumber()) {
+            current.append(ch.toCaseFolded());
+        } else if (!current.isEmpty()) {
+            terms.append(current);
+            current.clear();
+        }
+    }
+    if (!current.isEmpty()) {
+        terms.append(current);
+    }
+    return terms;
+}
+
+void MessageIndex::insert(QMap<QString, QVector<int>> &index, const QString &text, int id)
+{
+    QStringList terms = tokenize(text);
+    terms.removeDuplicates();
+
+    for (const QString &term : terms) {
+        index[term].append(id);
+    }
+}
+
+void MessageIndex::addContact(int contactId, const QString &name)
+{
+    // Names do not change, a reloaded contact list adds nothing new
+    if (contacts.contains(contactId)) {
+        return;
+    }
+    contacts.insert(contactId, name);
+    insert(nameTerms, name, contactId);
+}
+
+void MessageIndex::addMessage(int messageId, int contactId, const QString &content)
+{
+    // Histories are reloaded whenever a chat is opened, index each id once
+    if (messageId < 0 || messages.contains(messageId)) {
+        return;
+    }
+    messages.insert(messageId, { contactId, content });
+    insert(messageTerms, content, messageId);
+}
+
+void MessageIndex::clear()
+{
+    nameTerms.clear();
+    messageTerms.clear();
+    contacts.clear();
+    messages.clear();
+}
+
+QSet<int> MessageIndex::lookup(const QMap<QString, QVector<int>> &index, const QStringList &words)
+{
+    QSet<int> result;
+
+    for (int i = 0; i < words.size(); ++i) {
+        // All terms starting with the word sit next to each other in the map
+        QSet<int> matches;
+        for (auto it = index.lowerBound(words[i]); it != index.end() && it.key().startsWith(words[i]); ++it) {
+            for (int id : it.value()) {
+                matches.insert(id);
+            }
+        }
+
+        if (i == 0) {
+            result = matches;
+        } else {
+            result.intersect(matches);
+        }
+        if (result.isEmpty()) {
+            break;
+        }
+    }
+
+    return result;
+}
+
+QHash<int, MessageIndex::Match> MessageIndex::search(const QString &query) const
+{
+    QHash<int, Match> results;
+
+    const QStringList words = tokenize(query);
+    if (words.isEmpty()) {
+        return results;
+    }
+
+    const QSet<int> contactIds = lookup(nameTerms, words);
+    for (int contactId : contactIds) {
+        Match &match = results[contactId];
+        match.contactId = contactId;
+        match.nameMatches = true;
+    }
+
+    // Message ids grow over time, the highest one is the newest match
+    QHash<int, int> latest;
+    const QSet<int> messageIds = lookup(messageTerms, words);
+    for (int messageId : messageIds) {
+        auto entry = messages.constFind(messageId);
+        Match &match = results[entry->contactId];
+        match.contactId = entry->contactId;
+        ++match.messageMatches;
+
+        if (messageId > latest.value(entry->contactId, -1)) {
+            latest.insert(entry->contactId, messageId);
+            match.latestMessage = entry->content;
+        }
+    }
+
+    return results;
+}
@@ -0,0 +1,49 @@
+#ifndef MESSAGEINDEX_H
+#define MESSAGEINDEX_H
+
+#include <QString>
+#include <QStringList>
+#include <QHash>
+#include <QMap>
+#include <QSet>
+#include <QVector>
+
+// Inverted index over contact names and every message the client has seen,
+// so the contact search answers as you type without asking the server.
+// Terms are kept sorted, every query word matches as a prefix.
+class MessageIndex
+{
+public:
+    struct Match {
+        int contactId = -1;
+        bool nameMatches = false;
+        int messageMatches = 0;
+        QString latestMessage;      // newest matching message, for a preview
+    };
+
+    void addContact(int contactId, const QString &name);
+    void addMessage(int messageId, int contactId, const QString &content);
+    void clear();
+
+    // Contacts whose name or any message contains every word of the query
+    QHash<int, Match> search(const QString &query) const;
+
+    int messageCount() const { return messages.size(); }
+
+private:
+    struct Entry {
+        int contactId;
+        QString content;
+    };
+
+    static QStringList tokenize(const QString &text);
+    static void insert(QMap<QString, QVector<int>> &index, const QString &text, int id);
+    static QSet<int> lookup(const QMap<QString, QVector<int>> &index, const QStringList &words);
+
+    QMap<QString, QVector<int>> nameTerms;      // term -> contact ids
+    QMap<QString, QVector<int>> messageTerms;   // term -> message ids
+    QHash<int, QString> contacts;
+    QHash<int, Entry> messages;
+};
+
+#endif // MESSAGEINDEX_H
@@ -1,163 +1,79 @@
 #include "networkclient.h"
-#include <QHostAddress>
-#include <QSettings>
+#include "networkworker.h"
+
+#include <QJsonArray>
 
 NetworkClient::NetworkClient(QObject *parent)
     : QObject(parent)
-    , socket(new QTcpSocket(this))
-    , reconnectTimer(new QTimer(this))
-    , reconnecting(false)
+    , ioThread(new QThread(this))
+    , worker(nullptr)
+    , connectedState(false)
     , serverHost("127.0.0.1")  // Changed from "localhost" to explicit IP
     , serverPort(8080)         // Make sure this matches your server's port
 {
-    // Configure reconnect timer
-    reconnectTimer->setInterval(5000); // 5 seconds between reconnect attempts
-
-    // Connect socket signals
-    connect(socket, &QTcpSocket::connected, this, &NetworkClient::onConnected);
-    connect(socket, &QTcpSocket::disconnected, this, &NetworkClient::onDisconnected);
-    connect(socket, &QTcpSocket::readyRead, this, &NetworkClient::onReadyRead);
-    connect(socket, QOverload<QAbstractSocket::SocketError>::of(&QTcpSocket::errorOccurred),
-            this, &NetworkClient::onError);
-
-    // Connect reconnect timer
-    connect(reconnectTimer, &QTimer::timeout, this, &NetworkClient::attemptReconnect);
+    qRegisterMetaType<ChatMessage>();
+    qRegisterMetaType<QList<ChatMessage>>();
+
+    // The worker and its socket live on the I/O thread from here on
+    worker = new NetworkWorker(serverHost, serverPort);
+    worker->moveToThread(ioThread);
+    connect(ioThread, &QThread::finished, worker, &QObject::deleteLater);
+
+    // Worker signals cross threads, so these are all queued
+    connect(worker, &NetworkWorker::responseReceived, this, &NetworkClient::responseReceived);
+    connect(worker, &NetworkWorker::chatHistoryReceived, this, &NetworkClient::chatHistoryReceived);
+    connect(worker, &NetworkWorker::messageReceived, this, &NetworkClient::messageReceived);
+    connect(worker, &NetworkWorker::payloadReceived, this, &NetworkClient::payloadReceived);
+    connect(worker, &NetworkWorker::connectionError, this, &NetworkClient::connectionError);
+    connect(worker, &NetworkWorker::connected, this, [this]() {
+        connectedState = true;
+        emit connected();
+    });
+    connect(worker, &NetworkWorker::disconnected, this, [this]() {
+        connectedState = false;
+        emit disconnected();
+    });
+
+    ioThread->setObjectName("NetworkClient I/O");
+    ioThread->start();
 
     // Connect to server on startup
-    connectToServer();
+    QMetaObject::invokeMethod(worker, &NetworkWorker::start, Qt::QueuedConnection);
 }
 
 NetworkClient::~NetworkClient()
 {
-    if (socket->state() == QTcpSocket::ConnectedState) {
-        socket->disconnectFromHost();
-    }
-    delete socket;
-}
-
-void NetworkClient::connectToServer()
-{
-    if (socket->state() == QTcpSocket::UnconnectedState) {
-        qDebug() << "Attempting to connect to server at" << serverHost << ":" << serverPort;
-        socket->connectToHost(serverHost, serverPort);
-    }
+    // Stopping the thread deletes the worker (and closes the socket) on it
+    ioThread->quit();
+    ioThread->wait();
 }
 
 void NetworkClient::sendRequest(const QJsonObject &request)
 {
-    if (socket->state() == QTcpSocket::ConnectedState) {
-        // Convert JSON to bytes
-        QJsonDocument doc(request);
-        QByteArray data = doc.toJson(QJsonDocument::Compact);
-
-        // Add message delimiter
-        data.append('\n');
-
-        // Send data
-        socket->write(data);
-    } else {
-        // Not connected, return error response
-        QString errorMsg = "Not connected to server. Attempting to reconnect...";
-        emit responseReceived(createErrorResponse(errorMsg));
-
-        // Try to reconnect
-        connectToServer();
-    }
-}
-
-void NetworkClient::disconnect()
-{
-    if (socket->state() != QTcpSocket::UnconnectedState) {
-        socket->disconnectFromHost();
-    }
-}
-
-bool NetworkClient::isConnected() const
-{
-    return socket->state() == QTcpSocket::ConnectedState;
+    QMetaObject::invokeMethod(worker, [worker = worker, request]() {
+        worker->sendRequest(request);
+    }, Qt::QueuedConnection);
 }
 
-void NetworkClient::onConnected()
+void NetworkClient::sendBatch(const QList<QJsonObject> &requests)
 {
-    qDebug() << "Connected to server successfully";
-    reconnectTimer->stop();
-    reconnecting = false;
-    emit connected();
-}
-
-void NetworkClient::onDisconnected()
-{
-    qDebug() << "Disconnected from server";
-    emit disconnected();
-
-    // Start reconnect timer if not already reconnecting
-    if (!reconnecting) {
-        reconnecting = true;
-        reconnectTimer->start();
+    QJsonArray requestsArray;
+    for (const QJsonObject &request : requests) {
+        requestsArray.append(request);
     }
-}
-
-void NetworkClient::onReadyRead()
-{
-    // Read all available data
-    QByteArray data = socket->readAll();
-
-    // Split data by message delimiter (newline)
-    QList<QByteArray> messages = data.split('\n');
-
-    // Process each complete message
-    for (const QByteArray &message : messages) {
-        if (message.isEmpty()) {
-            continue;
-        }
-
-        // Parse JSON
-        QJsonParseError parseError;
-        QJsonDocument doc = QJsonDocument::fromJson(message, &parseError);
-
-        if (parseError.error == QJsonParseError::NoError) {
-            QJsonObject response = doc.object();
 
-            // Check if this is a response or a message
-            if (response.contains("action") && response["action"].toString() == "message") {
-                emit messageReceived(response);
-            } else {
-                emit responseReceived(response);
-            }
-        } else {
-            // JSON parsing error
-            emit responseReceived(createErrorResponse("Invalid response from server"));
-        }
-    }
-}
-
-void NetworkClient::onError(QAbstractSocket::SocketError socketError)
-{
-    Q_UNUSED(socketError);
-
-    QString errorMessage = socket->errorString();
-    qDebug() << "Socket error:" << errorMessage;
-    emit connectionError(errorMessage);
-
-    // Try to reconnect if not already reconnecting
-    if (!reconnecting) {
-        reconnecting = true;
-        reconnectTimer->start();
-    }
+    QJsonObject batch;
+    batch["action"] = "batch";
+    batch["requests"] = requestsArray;
+    sendRequest(batch);
 }
 
-void NetworkClient::attemptReconnect()
+void NetworkClient::disconnect()
 {
-    if (socket->state() == QTcpSocket::UnconnectedState) {
-        qDebug() << "Attempting to reconnect...";
-        connectToServer();
-    }
+    QMetaObject::invokeMethod(worker, &NetworkWorker::disconnectFromServer, Qt::QueuedConnection);
 }
 
-QJsonObject NetworkClient::createErrorResponse(const QString &message)
+bool NetworkClient::isConnected() const
 {
-    QJsonObject response;
-    response["status"] = "error";
-    response["message"] = message;
-    return response;
+    return connectedState;
 }
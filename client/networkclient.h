@@ -2,11 +2,18 @@
 #define NETWORKCLIENT_H
 
 #include <QObject>
-#include <QTcpSocket>
+#include <QThread>
 #include <QJsonObject>
 #include <QJsonDocument>
-#include <QTimer>
+#include <QAbstractSocket>
+#include <atomic>
 
+#include "chatmessage.h"
+
+class NetworkWorker;
+
+// GUI-side handle to the server connection. The socket, framing and JSON
+// decoding run on a dedicated I/O thread; results arrive as queued signals.
 class NetworkClient : public QObject
 {
     Q_OBJECT
@@ -14,36 +21,31 @@ class NetworkClient : public QObject
 public:
     explicit NetworkClient(QObject *parent = nullptr);
     ~NetworkClient();
-    
+
     void sendRequest(const QJsonObject &request);
+
+    // Several requests in one frame, answered in order by one batch response
+    void sendBatch(const QList<QJsonObject> &requests);
     void disconnect();
     bool isConnected() const;
 
 signals:
     void responseReceived(const QJsonObject &response);
+    void chatHistoryReceived(int contactId, const QList<ChatMessage> &messages);
     void connectionError(const QString &errorMessage);
     void messageReceived(const QJsonObject &message);
+    void payloadReceived(const QJsonObject &header, const QByteArray &payload);
     void connected();
     void disconnected();
 
-private slots:
-    void onConnected();
-    void onDisconnected();
-    void onReadyRead();
-    void onError(QAbstractSocket::SocketError socketError);
-    void attemptReconnect();
-
 private:
-    QTcpSocket *socket;
-    QTimer *reconnectTimer;
-    bool reconnecting;
-    
-    void connectToServer();
-    QJsonObject createErrorResponse(const QString &message);
-    
+    QThread *ioThread;
+    NetworkWorker *worker;
+    std::atomic<bool> connectedState;
+
     // Default server settings (should be configurable)
     QString serverHost = "localhost";
     quint16 serverPort = 8080;
 };
 
-#endif // NETWORKCLIENT_H
\ No newline at end of file
+#endif // NETWORKCLIENT_H
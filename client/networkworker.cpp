@@ -0,0 +1,245 @@
+#include "networkworker.h"
+
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QRandomGenerator>
+
+NetworkWorker::NetworkWorker(const QString &host, quint16 port, QObject *parent)
+    : QObject(parent)
+    , socket(new QTcpSocket(this))
+    , reconnectTimer(new QTimer(this))
+    , reconnectAttempts(0)
+    , retryAfterHint(0)
+    , serverHost(host)
+    , serverPort(port)
+{
+    // Configure reconnect timer, each attempt picks its own delay
+    reconnectTimer->setSingleShot(true);
+
+    // Connect socket signals
+    connect(socket, &QTcpSocket::connected, this, &NetworkWorker::onConnected);
+    connect(socket, &QTcpSocket::disconnected, this, &NetworkWorker::onDisconnected);
+    connect(socket, &QTcpSocket::readyRead, this, &NetworkWorker::onReadyRead);
+    connect(socket, QOverload<QAbstractSocket::SocketError>::of(&QTcpSocket::errorOccurred),
+            this, &NetworkWorker::onError);
+
+    // Connect reconnect timer
+    connect(reconnectTimer, &QTimer::timeout, this, &NetworkWorker::attemptReconnect);
+}
+
+NetworkWorker::~NetworkWorker()
+{
+    if (socket->state() == QTcpSocket::ConnectedState) {
+        socket->disconnectFromHost();
+    }
+}
+
+void NetworkWorker::start()
+{
+    // Called once the worker runs on the I/O thread
+    connectToServer();
+}
+
+void NetworkWorker::connectToServer()
+{
+    if (socket->state() == QTcpSocket::UnconnectedState) {
+        qDebug() << "Attempting to connect to server at" << serverHost << ":" << serverPort;
+        socket->connectToHost(serverHost, serverPort);
+    }
+}
+
+void NetworkWorker::sendRequest(const QJsonObject &request)
+{
+    if (socket->state() == QTcpSocket::ConnectedState) {
+        // Convert JSON to bytes
+        QJsonDocument doc(request);
+        QByteArray data = doc.toJson(QJsonDocument::Compact);
+
+        // Add message delimiter
+        data.append('\n');
+
+        // Send data
+        socket->write(data);
+    } else {
+        // Not connected, return error response
+        QString errorMsg = "Not connected to server. Attempting to reconnect...";
+        emit responseReceived(createErrorResponse(errorMsg));
+
+        // Try to reconnect unless a backoff delay is already pending
+        if (!reconnectTimer->isActive()) {
+            connectToServer();
+        }
+    }
+}
+
+void NetworkWorker::disconnectFromServer()
+{
+    if (socket->state() != QTcpSocket::UnconnectedState) {
+        socket->disconnectFromHost();
+    }
+}
+
+void NetworkWorker::onConnected()
+{
+    qDebug() << "Connected to server successfully";
+    reconnectTimer->stop();
+
+    // The backoff only starts over once this connection proves stable, a
+    // server that accepts and drops right away must not get instant retries
+    connectedSince.start();
+    emit connected();
+}
+
+void NetworkWorker::onDisconnected()
+{
+    qDebug() << "Disconnected from server";
+    decoder.reset();
+    emit disconnected();
+
+    scheduleReconnect();
+}
+
+void NetworkWorker::onReadyRead()
+{
+    // Feed whatever arrived into the decoder, partial frames stay buffered
+    decoder.append(socket->readAll());
+
+    // Process each complete message
+    QJsonObject frame;
+    FrameDecoder::Result result;
+    while ((result = decoder.next(frame)) != FrameDecoder::NeedMoreData) {
+        if (result == FrameDecoder::InvalidFrame) {
+            // JSON parsing error
+            emit responseReceived(createErrorResponse("Invalid response from server"));
+            continue;
+        }
+
+        // Report throughput for large payloads such as chat histories
+        if (decoder.lastFrameSize() >= LargeFrameSize) {
+            const FrameDecoder::Stats &stats = decoder.stats();
+            qDebug() << "Decoded" << decoder.lastFrameSize() / 1024 << "KB frame;"
+                     << stats.frames << "frames," << stats.bytes / 1024 << "KB total at"
+                     << QString::number(stats.megabytesPerSecond(), 'f', 1) << "MB/s";
+        }
+
+        // Raw frames carry file data next to their header
+        if (FrameDecoder::isRawFrame(frame)) {
+            emit payloadReceived(frame, decoder.payload());
+            continue;
+        }
+
+        dispatchFrame(frame);
+    }
+}
+
+void NetworkWorker::dispatchFrame(const QJsonObject &frame)
+{
+    QString action = frame["action"].toString();
+
+    // Honor the server's hint on when to come back
+    if (frame.contains("retryAfter")) {
+        retryAfterHint = qBound<qint64>(0, qint64(frame["retryAfter"].toDouble()), MaxRetryAfterHint);
+    }
+
+    // Check if this is a response or a message
+    if (action == "message") {
+        emit messageReceived(frame);
+    }
+    else if (action == "batch" && frame["status"].toString() == "success") {
+        // Unpack so every sub-response takes the same path as a single one
+        const QJsonArray responses = frame["responses"].toArray();
+        for (const QJsonValue &value : responses) {
+            dispatchFrame(value.toObject());
+        }
+    }
+    else if (action == "offlineMessages") {
+        // Messages queued while we were away, handled like live pushes
+        const QJsonArray messagesArray = frame["messages"].toArray();
+        for (const QJsonValue &value : messagesArray) {
+            QJsonObject message = value.toObject();
+            message["action"] = "message";
+            emit messageReceived(message);
+        }
+    }
+    else if (action == "getChatHistory" && frame["status"].toString() == "success") {
+        // Convert the history here so the GUI thread only builds bubbles
+        const QJsonArray messagesArray = frame["messages"].toArray();
+
+        QList<ChatMessage> messages;
+        messages.reserve(messagesArray.size());
+        for (const QJsonValue &value : messagesArray) {
+            ChatMessage message = ChatMessage::fromJson(value.toObject());
+            if (message.isValid()) {
+                messages.append(message);
+            }
+        }
+
+        emit chatHistoryReceived(frame["contactId"].toInt(-1), messages);
+    }
+    else {
+        emit responseReceived(frame);
+    }
+}
+
+void NetworkWorker::onError(QAbstractSocket::SocketError socketError)
+{
+    Q_UNUSED(socketError);
+
+    QString errorMessage = socket->errorString();
+    qDebug() << "Socket error:" << errorMessage;
+    emit connectionError(errorMessage);
+
+    scheduleReconnect();
+}
+
+void NetworkWorker::scheduleReconnect()
+{
+    // Errors and disconnects often arrive together, schedule only once
+    if (reconnectTimer->isActive()) {
+        return;
+    }
+
+    // Errors usually come before the disconnect, so the connection that just
+    // ended is judged here
+    if (connectedSince.isValid()) {
+        if (connectedSince.elapsed() >= StableConnectionTime) {
+            reconnectAttempts = 0;
+        }
+        connectedSince.invalidate();
+    }
+
+    qint64 delay = 0;
+    if (reconnectAttempts > 0) {
+        // Full jitter: uniform in [0, min(max, base * 2^attempt)] so clients
+        // dropped by the same server restart do not come back in lockstep
+        int exponent = qMin(reconnectAttempts - 1, 16);
+        qint64 ceiling = qMin<qint64>(ReconnectMaxDelay, qint64(ReconnectBaseDelay) << exponent);
+        delay = QRandomGenerator::global()->bounded(int(ceiling) + 1);
+    }
+
+    // The server knows its own load better than our backoff does
+    if (retryAfterHint > delay) {
+        delay = retryAfterHint;
+    }
+    retryAfterHint = 0;
+
+    ++reconnectAttempts;
+    qDebug() << "Reconnecting in" << delay << "ms (attempt" << reconnectAttempts << ")";
+    reconnectTimer->start(int(delay));
+}
+
+void NetworkWorker::attemptReconnect()
+{
+    if (socket->state() == QTcpSocket::UnconnectedState) {
+        qDebug() << "Attempting to reconnect...";
+        connectToServer();
+    }
+}
+
+QJsonObject NetworkWorker::createErrorResponse(const QString &message)
+{
+    QJsonObject response;
+    response["status"] = "error";
+    response["message"] = message;
+    return response;
+}
@@ -0,0 +1,70 @@
+#ifndef NETWORKWORKER_H
+#define NETWORKWORKER_H
+
+#include <QObject>
+#include <QTcpSocket>
+#include <QJsonObject>
+#include <QTimer>
+#include <QElapsedTimer>
+
+#include "framedecoder.h"
+#include "chatmessage.h"
+
+// Owns the socket and does all framing and JSON decoding.
+// Lives on NetworkClient's I/O thread; only talk to it through queued calls.
+class NetworkWorker : public QObject
+{
+    Q_OBJECT
+
+public:
+    NetworkWorker(const QString &host, quint16 port, QObject *parent = nullptr);
+    ~NetworkWorker();
+
+public slots:
+    void start();
+    void sendRequest(const QJsonObject &request);
+    void disconnectFromServer();
+
+signals:
+    void responseReceived(const QJsonObject &response);
+    void chatHistoryReceived(int contactId, const QList<ChatMessage> &messages);
+    void connectionError(const QString &errorMessage);
+    void messageReceived(const QJsonObject &message);
+    void payloadReceived(const QJsonObject &header, const QByteArray &payload);
+    void connected();
+    void disconnected();
+
+private slots:
+    void onConnected();
+    void onDisconnected();
+    void onReadyRead();
+    void onError(QAbstractSocket::SocketError socketError);
+    void attemptReconnect();
+
+private:
+    void connectToServer();
+    void scheduleReconnect();
+    void dispatchFrame(const QJsonObject &frame);
+    QJsonObject createErrorResponse(const QString &message);
+
+    QTcpSocket *socket;
+    QTimer *reconnectTimer;
+    int reconnectAttempts;
+    QElapsedTimer connectedSince;
+    qint64 retryAfterHint;   // ms, last hint sent by the server
+    FrameDecoder decoder;
+
+    QString serverHost;
+    quint16 serverPort;
+
+    // Reconnect backoff: first retry is immediate, then capped exponential with full jitter
+    static const int ReconnectBaseDelay = 500;      // ms
+    static const int ReconnectMaxDelay = 60000;     // ms
+    static const int MaxRetryAfterHint = 300000;    // ms
+    static const int StableConnectionTime = 30000;  // ms up before the backoff starts over
+
+    // Frames at least this big get their decode throughput logged
+    static const qint64 LargeFrameSize = 256 * 1024;
+};
+
+#endif // NETWORKWORKER_H
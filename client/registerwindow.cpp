@@ -11,14 +11,15 @@
 #include <QRegularExpressionValidator>
 #include <QIcon>
 
-RegisterWindow::RegisterWindow(QWidget *parent)
+RegisterWindow::RegisterWindow(Session *session, QWidget *parent)
     : QMainWindow(parent)
-    , networkClient(new NetworkClient(this))
+    , session(session)
+    , registerPending(false)
 {
     setupUI();
     
-    // Connect network signals
-    connect(networkClient, &NetworkClient::responseReceived, 
+    // Connect network signals of the shared connection
+    connect(session->networkClient(), &NetworkClient::responseReceived, 
             this, &RegisterWindow::onNetworkResponse);
 }
 
@@ -167,7 +168,8 @@ void RegisterWindow::onRegisterClicked()
     // Send registration request
     registerButton->setEnabled(false);
     registerButton->setText("Creating account...");
-    networkClient->sendRequest(request);
+    registerPending = true;
+    session->networkClient()->sendRequest(request);
 }
 
 void RegisterWindow::onBackToLoginClicked()
@@ -177,7 +179,7 @@ void RegisterWindow::onBackToLoginClicked()
     if (parent) {
         parent->show();
     } else {
-        LoginWindow *loginWindow = new LoginWindow();
+        LoginWindow *loginWindow = new LoginWindow(session);
         loginWindow->setAttribute(Qt::WA_DeleteOnClose);
         loginWindow->show();
     }
@@ -186,6 +188,13 @@ void RegisterWindow::onBackToLoginClicked()
 
 void RegisterWindow::onNetworkResponse(const QJsonObject &response)
 {
+    // The connection is shared, only look at the answer to our own request
+    QString action = response["action"].toString();
+    if (!registerPending || (action != "register" && !action.isEmpty())) {
+        return;
+    }
+    registerPending = false;
+
     registerButton->setEnabled(true);
     registerButton->setText("Create Account");
     
@@ -5,14 +5,14 @@
 #include <QLineEdit>
 #include <QPushButton>
 #include <QLabel>
-#include "networkclient.h"
+#include "session.h"
 
 class RegisterWindow : public QMainWindow
 {
     Q_OBJECT
 
 public:
-    explicit RegisterWindow(QWidget *parent = nullptr);
+    explicit RegisterWindow(Session *session, QWidget *parent = nullptr);
     ~RegisterWindow();
 
 private slots:
@@ -31,7 +31,8 @@ private:
     QPushButton *backButton;
     QLabel *statusLabel;
     
-    NetworkClient *networkClient;
+    Session *session;
+    bool registerPending;
 };
 
 #endif // REGISTERWINDOW_H
\ No newline at end of file
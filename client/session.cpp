@@ -0,0 +1,165 @@
+#include "session.h"
+
+#include <QDebug>
+#include <QUuid>
+
+Session::Session(QObject *parent)
+    : QObject(parent)
+    , client(new NetworkClient(this))
+    , currentUserId(-1)
+    , loginPending(false)
+    , restoring(false)
+{
+    connect(client, &NetworkClient::connected, this, &Session::onConnected);
+    connect(client, &NetworkClient::responseReceived, this, &Session::onNetworkResponse);
+}
+
+Session::~Session()
+{
+}
+
+void Session::login(const QString &username, const QString &hashedPassword)
+{
+    loginName = username;
+    passwordHash = hashedPassword;
+    loginPending = true;
+    restoring = false;
+
+    sendLogin();
+}
+
+void Session::logout()
+{
+    if (isLoggedIn()) {
+        // Unbind the socket server-side, the connection itself stays open
+        QJsonObject request;
+        request["action"] = "logout";
+        request["token"] = resumeToken;
+        client->sendRequest(request);
+    }
+
+    currentUserId = -1;
+    currentUsername.clear();
+    resumeToken.clear();
+    loginName.clear();
+    passwordHash.clear();
+    loginPending = false;
+    restoring = false;
+    outbox.clear();
+}
+
+QString Session::sendMessage(QJsonObject request)
+{
+    QString clientMessageId = QUuid::createUuid().toString(QUuid::WithoutBraces);
+    request["clientMessageId"] = clientMessageId;
+    outbox.append(request);
+
+    // While disconnected or re-authenticating it waits for flushOutbox()
+    if (client->isConnected() && !restoring) {
+        client->sendRequest(request);
+    }
+
+    return clientMessageId;
+}
+
+void Session::flushOutbox()
+{
+    // Resend in batches, one round trip instead of one per message
+    for (int i = 0; i < outbox.size(); i += MaxBatchSize) {
+        client->sendBatch(outbox.mid(i, MaxBatchSize));
+    }
+}
+
+void Session::sendLogin()
+{
+    QJsonObject request;
+    request["action"] = "login";
+    request["username"] = loginName;
+    request["password"] = passwordHash;
+
+    client->sendRequest(request);
+}
+
+void Session::sendResume()
+{
+    QJsonObject request;
+    request["action"] = "resume";
+    request["token"] = resumeToken;
+
+    client->sendRequest(request);
+}
+
+void Session::onConnected()
+{
+    // A reconnect loses the server-side binding, rebind the new socket
+    if (isLoggedIn() && !loginPending) {
+        restoring = true;
+        if (!resumeToken.isEmpty()) {
+            sendResume();
+        } else {
+            sendLogin();
+        }
+    }
+}
+
+void Session::onNetworkResponse(const QJsonObject &response)
+{
+    QString action = response["action"].toString();
+    QString status = response["status"].toString();
+
+    if (action == "sendMessage") {
+        // Confirmed or rejected, either way retrying would not change it
+        QString clientMessageId = response["clientMessageId"].toString();
+        for (int i = 0; i < outbox.size(); ++i) {
+            if (outbox.at(i)["clientMessageId"].toString() == clientMessageId) {
+                outbox.removeAt(i);
+                break;
+            }
+        }
+        return;
+    }
+
+    if (action == "resume") {
+        if (status == "success") {
+            restoring = false;
+            flushOutbox();
+            emit sessionRestored();
+        } else if (restoring) {
+            // Token expired or the server restarted, fall back to a full login
+            resumeToken.clear();
+            sendLogin();
+        }
+        return;
+    }
+
+    // Connection errors carry no action but still answer a pending login
+    if (action != "login" && !(action.isEmpty() && status == "error" && loginPending)) {
+        return;
+    }
+
+    if (status == "success") {
+        resumeToken = response["token"].toString();
+
+        QJsonObject userData = response["user"].toObject();
+        currentUserId = userData["id"].toInt();
+        currentUsername = userData["username"].toString();
+
+        if (restoring) {
+            restoring = false;
+            flushOutbox();
+            emit sessionRestored();
+        } else if (loginPending) {
+            loginPending = false;
+            emit loggedIn(currentUserId, currentUsername);
+        }
+    } else if (loginPending) {
+        loginPending = false;
+        emit loginFailed(response["message"].toString());
+    } else if (restoring) {
+        // Credentials no longer valid, drop the session
+        qWarning() << "Failed to restore session:" << response["message"].toString();
+        restoring = false;
+        currentUserId = -1;
+        currentUsername.clear();
+    }
+}
@@ -0,0 +1,71 @@
+#ifndef SESSION_H
+#define SESSION_H
+
+#include <QObject>
+#include <QJsonObject>
+#include <QList>
+
+#include "networkclient.h"
+
+// Application-wide connection and login state. Created once in main() and
+// handed from window to window so every screen shares one authenticated socket.
+class Session : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit Session(QObject *parent = nullptr);
+    ~Session();
+
+    NetworkClient *networkClient() const { return client; }
+
+    bool isLoggedIn() const { return currentUserId != -1; }
+    int userId() const { return currentUserId; }
+    QString username() const { return currentUsername; }
+
+    // Logged in on a live, re-authenticated connection
+    bool isReady() const { return isLoggedIn() && client->isConnected() && !restoring; }
+
+    void login(const QString &username, const QString &hashedPassword);
+    void logout();
+
+    // Tags the request with a client message id and keeps it until the
+    // server confirms it, resending after a reconnect. Returns the id.
+    QString sendMessage(QJsonObject request);
+
+signals:
+    void loggedIn(int userId, const QString &username);
+    void loginFailed(const QString &errorMessage);
+    void sessionRestored();
+
+private slots:
+    void onConnected();
+    void onNetworkResponse(const QJsonObject &response);
+
+private:
+    void sendLogin();
+    void sendResume();
+    void flushOutbox();
+
+    NetworkClient *client;
+
+    int currentUserId;
+    QString currentUsername;
+
+    // Kept to re-authenticate the socket after a reconnect; the token is
+    // tried first and the credentials are only the fallback
+    QString resumeToken;
+    QString loginName;
+    QString passwordHash;
+
+    bool loginPending;
+    bool restoring;
+
+    // Sends not yet confirmed, in the order they were made; the server
+    // drops repeats of a client message id, so resending is always safe
+    QList<QJsonObject> outbox;
+
+    static constexpr int MaxBatchSize = 100;    // server limit per batch
+};
+
+#endif // SESSION_H
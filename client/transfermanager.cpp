@@ -0,0 +1,549 @@
+#include "transfermanager.h"
+
+#include <QCryptographicHash>
+#include <QFile>
+#include <QFileInfo>
+#include <QPointer>
+#include <QStandardPaths>
+#include <QThreadPool>
+#include <QDebug>
+#include <algorithm>
+
+namespace {
+
+// Streams the file through the hash, runs on the thread pool
+QString hashFile(const QString &path)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return QString();
+    }
+
+    QCryptographicHash hash(QCryptographicHash::Sha256);
+    if (!hash.addData(&file)) {
+        return QString();
+    }
+    return QString::fromLatin1(hash.result().toHex());
+}
+
+} // namespace
+
+TransferManager::TransferManager(Session *session, QObject *parent)
+    : QObject(parent)
+    , session(session)
+    , networkClient(session->networkClient())
+    , cache(new AttachmentCache(CacheBudget, this))
+    , nextTransferId(1)
+{
+    cache->open(QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/attachments");
+    connect(cache, &AttachmentCache::stored, this, &TransferManager::onCacheStored);
+    connect(cache, &AttachmentCache::storeFailed, this, &TransferManager::onCacheStoreFailed);
+
+    connect(networkClient, &NetworkClient::responseReceived, this, &TransferManager::onResponse);
+    connect(networkClient, &NetworkClient::payloadReceived, this, &TransferManager::onPayload);
+    connect(networkClient, &NetworkClient::disconnected, this, &TransferManager::onDisconnected);
+
+    // Interrupted transfers continue once the socket is authenticated again
+    connect(session, &Session::sessionRestored, this, &TransferManager::schedule);
+}
+
+QString TransferManager::cachedPath(const QString &sha256)
+{
+    return cache->find(sha256);
+}
+
+QJsonObject TransferManager::request(const QString &action) const
+{
+    QJsonObject request;
+    request["action"] = action;
+    request["userId"] = session->userId();
+    return request;
+}
+
+int TransferManager::upload(const QString &filePath)
+{
+    QFileInfo info(filePath);
+
+    Transfer transfer;
+    transfer.id = nextTransferId++;
+    transfer.isUpload = true;
+    transfer.state = Hashing;
+    transfer.path = info.absoluteFilePath();
+    transfer.name = info.fileName();
+    transfer.size = info.size();
+    transfers.insert(transfer.id, transfer);
+
+    if (!info.isFile() || transfer.size <= 0) {
+        // Reported once the caller had a chance to connect to the id
+        QMetaObject::invokeMethod(this, [this, id = transfer.id]() {
+            fail(id, "Only non-empty files can be sent");
+        }, Qt::QueuedConnection);
+        return transfer.id;
+    }
+
+    // The server checks the upload against this hash, and it keys our cache
+    QPointer<TransferManager> self(this);
+    int id = transfer.id;
+    QString path = transfer.path;
+    QThreadPool::globalInstance()->start([self, id, path]() {
+        QString sha256 = hashFile(path);
+
+        QMetaObject::invokeMethod(self, [self, id, sha256]() {
+            if (!self || !self->transfers.contains(id)) {
+                return;
+            }
+            if (sha256.isEmpty()) {
+                self->fail(id, "Cannot read the file");
+                return;
+            }
+
+            Transfer &transfer = self->transfers[id];
+            transfer.sha256 = sha256;
+            transfer.state = Queued;
+            self->schedule();
+        }, Qt::QueuedConnection);
+    });
+
+    return transfer.id;
+}
+
+int TransferManager::download(int attachmentId, const QString &sha256, const QString &name, qint64 size)
+{
+    // Somebody already asked for the same content, share the transfer and
+    // its partial file
+    if (Transfer *existing = findDownloadByHash(sha256.toLower())) {
+        return existing->id;
+    }
+
+    Transfer transfer;
+    transfer.id = nextTransferId++;
+    transfer.attachmentId = attachmentId;
+    transfer.sha256 = sha256.toLower();
+    transfer.name = name;
+    transfer.size = size;
+    transfers.insert(transfer.id, transfer);
+
+    int id = transfer.id;
+    QString cached = cache->find(transfer.sha256);
+    if (!cached.isEmpty()) {
+        QMetaObject::invokeMethod(this, [this, id, cached]() {
+            transfers.remove(id);
+            emit downloadFinished(id, cached);
+        }, Qt::QueuedConnection);
+        return id;
+    }
+
+    // Ranges arrive out of order across reconnects, so write into a file of
+    // the final size
+    Transfer &queued = transfers[id];
+    queued.path = cache->partialPath(queued.sha256);
+    QFile file(queued.path);
+    if (!cache->isOpen() || size <= 0 || !file.open(QIODevice::WriteOnly) || !file.resize(size)) {
+        QMetaObject::invokeMethod(this, [this, id]() {
+            fail(id, "Cannot create the download file");
+        }, Qt::QueuedConnection);
+        return id;
+    }
+
+    for (qint64 offset = 0; offset < size; offset += DownloadChunkSize) {
+        queued.missing.append(offset);
+    }
+
+    schedule();
+    return id;
+}
+
+void TransferManager::schedule()
+{
+    if (!session->isReady()) {
+        return;
+    }
+
+    int active = 0;
+    for (const Transfer &transfer : std::as_const(transfers)) {
+        if (transfer.state == Starting || transfer.state == Running) {
+            ++active;
+        }
+    }
+
+    // The map is ordered by id, the oldest queued transfers go first
+    const QList<int> ids = transfers.keys();
+    for (int id : ids) {
+        if (active >= MaxActiveTransfers) {
+            break;
+        }
+
+        auto it = transfers.find(id);
+        if (it == transfers.end() || it->state != Queued) {
+            continue;
+        }
+        ++active;
+
+        if (it->isUpload) {
+            startUpload(*it);
+        } else {
+            it->state = Running;
+            pumpDownload(*it);
+        }
+    }
+}
+
+void TransferManager::startUpload(Transfer &transfer)
+{
+    // With an upload id the server answers with how much it already has
+    QJsonObject begin = request("uploadBegin");
+    if (!transfer.uploadId.isEmpty()) {
+        begin["uploadId"] = transfer.uploadId;
+    } else {
+        begin["name"] = transfer.name;
+        begin["size"] = double(transfer.size);
+        begin["sha256"] = transfer.sha256;
+    }
+
+    transfer.state = Starting;
+    pendingBegins.enqueue(transfer.id);
+    networkClient->sendRequest(begin);
+}
+
+void TransferManager::pumpUpload(Transfer &transfer)
+{
+    // After an error the chunks still in flight fail too; resend only once
+    // they are all answered
+    if (transfer.stalled) {
+        if (transfer.inFlight > 0) {
+            return;
+        }
+        transfer.stalled = false;
+    }
+
+    // All data staged but not committed yet, an empty chunk finishes it
+    if (transfer.nextOffset >= transfer.size) {
+        if (transfer.inFlight == 0 && transfer.done >= transfer.size) {
+            QJsonObject chunk = request("uploadChunk");
+            chunk["uploadId"] = transfer.uploadId;
+            chunk["offset"] = double(transfer.size);
+            chunk["data"] = QString();
+            ++transfer.inFlight;
+            networkClient->sendRequest(chunk);
+        }
+        return;
+    }
+
+    QFile file(transfer.path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        fail(transfer.id, "Cannot read the file");
+        return;
+    }
+
+    // Chunks are pipelined, the server stages them in the order they arrive
+    while (transfer.inFlight < MaxChunksInFlight && transfer.nextOffset < transfer.size) {
+        QByteArray data;
+        if (file.seek(transfer.nextOffset)) {
+            data = file.read(qMin<qint64>(transfer.chunkSize, transfer.size - transfer.nextOffset));
+        }
+        if (data.isEmpty()) {
+            fail(transfer.id, "Cannot read the file");
+            return;
+        }
+
+        QJsonObject chunk = request("uploadChunk");
+        chunk["uploadId"] = transfer.uploadId;
+        chunk["offset"] = double(transfer.nextOffset);
+        chunk["data"] = QString::fromLatin1(data.toBase64());
+
+        transfer.nextOffset += data.size();
+        ++transfer.inFlight;
+        networkClient->sendRequest(chunk);
+    }
+}
+
+void TransferManager::pumpDownload(Transfer &transfer)
+{
+    while (transfer.requested.size() < MaxChunksInFlight && !transfer.missing.isEmpty()) {
+        qint64 offset = transfer.missing.takeFirst();
+
+        QJsonObject range = request("download");
+        range["attachmentId"] = transfer.attachmentId;
+        range["offset"] = double(offset);
+        range["length"] = double(qMin(DownloadChunkSize, transfer.size - offset));
+        range["raw"] = true;
+
+        transfer.requested.insert(offset);
+        networkClient->sendRequest(range);
+    }
+}
+
+void TransferManager::onResponse(const QJsonObject &response)
+{
+    QString action = response["action"].toString();
+
+    if (action == "uploadBegin") {
+        onUploadBegin(response);
+    } else if (action == "uploadChunk") {
+        onUploadChunk(response);
+    } else if (action == "download" && !response["thumbnail"].toBool()) {
+        // Successful ranges come in as raw frames, these are failures
+        onDownloadError(response);
+    }
+}
+
+void TransferManager::onUploadBegin(const QJsonObject &response)
+{
+    if (pendingBegins.isEmpty()) {
+        return;
+    }
+
+    auto it = transfers.find(pendingBegins.dequeue());
+    if (it == transfers.end() || it->state != Starting) {
+        return;
+    }
+
+    if (response["status"].toString() != "success") {
+        // A resumed upload may have expired server-side, start over once
+        if (!it->uploadId.isEmpty()) {
+            it->uploadId.clear();
+            it->done = 0;
+            if (retry(*it)) {
+                startUpload(*it);
+            }
+            return;
+        }
+        fail(it->id, response["message"].toString());
+        return;
+    }
+
+    it->state = Running;
+    it->uploadId = response["uploadId"].toString();
+    it->chunkSize = qMax(1, response["chunkSize"].toInt());
+    it->nextOffset = qint64(response["offset"].toDouble());
+    it->done = it->nextOffset;
+    it->inFlight = 0;
+    it->stalled = false;
+
+    emit progress(it->id, it->done, it->size);
+    pumpUpload(*it);
+}
+
+void TransferManager::onUploadChunk(const QJsonObject &response)
+{
+    Transfer *transfer = findUpload(response["uploadId"].toString());
+    if (!transfer || transfer->state != Running) {
+        return;
+    }
+    transfer->inFlight = qMax(0, transfer->inFlight - 1);
+
+    if (response["status"].toString() != "success") {
+        // Without an offset the server gave up on the upload altogether.
+        // Chunks already in flight fail the same way, one stall is one failure
+        if (!response.contains("offset") || (!transfer->stalled && !retry(*transfer))) {
+            fail(transfer->id, response["message"].toString());
+            return;
+        }
+        transfer->nextOffset = qint64(response["offset"].toDouble());
+        transfer->done = transfer->nextOffset;
+        transfer->stalled = true;
+        pumpUpload(*transfer);
+        return;
+    }
+
+    transfer->failures = 0;
+    transfer->done = qMax(transfer->done, qint64(response["offset"].toDouble()));
+    emit progress(transfer->id, transfer->done, transfer->size);
+
+    if (!response["complete"].toBool()) {
+        pumpUpload(*transfer);
+        return;
+    }
+
+    int id = transfer->id;
+    int attachmentId = response["attachmentId"].toInt();
+    QString sha256 = response["sha256"].toString();
+    QString name = transfer->name;
+    QString path = transfer->path;
+    transfers.remove(id);
+
+    // Keep our own copy so opening what we sent never downloads it
+    cache->insert(sha256, name, path, false);
+
+    emit uploadFinished(id, attachmentId, sha256);
+    schedule();
+}
+
+void TransferManager::onPayload(const QJsonObject &header, const QByteArray &payload)
+{
+    if (header["action"].toString() != "download" || header["thumbnail"].toBool()) {
+        return;
+    }
+
+    Transfer *transfer = findDownload(header["attachmentId"].toInt());
+    qint64 offset = qint64(header["offset"].toDouble());
+    if (!transfer || transfer->state != Running || !transfer->requested.remove(offset)) {
+        return;
+    }
+
+    QFile file(transfer->path);
+    if (!file.open(QIODevice::ReadWrite) || !file.seek(offset) || file.write(payload) != payload.size()) {
+        fail(transfer->id, "Cannot write the download file");
+        return;
+    }
+    file.close();
+
+    // A short range leaves its tail to be asked for again
+    qint64 expected = qMin(DownloadChunkSize, transfer->size - offset);
+    if (payload.size() < expected) {
+        transfer->missing.prepend(offset + payload.size());
+    }
+
+    transfer->failures = 0;
+    transfer->done += payload.size();
+    emit progress(transfer->id, transfer->done, transfer->size);
+
+    if (transfer->missing.isEmpty() && transfer->requested.isEmpty()) {
+        finishDownload(*transfer);
+    } else {
+        pumpDownload(*transfer);
+    }
+}
+
+void TransferManager::onDownloadError(const QJsonObject &response)
+{
+    Transfer *transfer = findDownload(response["attachmentId"].toInt());
+    qint64 offset = qint64(response["offset"].toDouble());
+    if (!transfer || transfer->state != Running || !transfer->requested.remove(offset)) {
+        return;
+    }
+
+    if (!retry(*transfer)) {
+        fail(transfer->id, response["message"].toString());
+        return;
+    }
+
+    transfer->missing.prepend(offset);
+    pumpDownload(*transfer);
+}
+
+void TransferManager::finishDownload(Transfer &transfer)
+{
+    transfer.state = Verifying;
+
+    int id = transfer.id;
+    QString sha256 = transfer.sha256;
+    QString name = transfer.name;
+    QString path = transfer.path;
+
+    // Verify off the GUI thread, the cache then moves it in on its own worker
+    QPointer<TransferManager> self(this);
+    QThreadPool::globalInstance()->start([self, id, sha256, name, path]() {
+        bool valid = hashFile(path) == sha256;
+
+        QMetaObject::invokeMethod(self, [self, id, valid, sha256, name, path]() {
+            if (!self || !self->transfers.contains(id)) {
+                return;
+            }
+            if (!valid) {
+                self->fail(id, "Download is corrupt");
+                return;
+            }
+            self->cache->insert(sha256, name, path, true);
+        }, Qt::QueuedConnection);
+    });
+
+    schedule();
+}
+
+void TransferManager::onCacheStored(const QString &sha256, const QString &path)
+{
+    // Uploads are copied in too, only a verified download waits on this
+    Transfer *transfer = findDownloadByHash(sha256);
+    if (!transfer || transfer->state != Verifying) {
+        return;
+    }
+
+    int id = transfer->id;
+    transfers.remove(id);
+    emit downloadFinished(id, path);
+    schedule();
+}
+
+void TransferManager::onCacheStoreFailed(const QString &sha256)
+{
+    Transfer *transfer = findDownloadByHash(sha256);
+    if (transfer && transfer->state == Verifying) {
+        fail(transfer->id, "Cannot store the download");
+    }
+}
+
+void TransferManager::onDisconnected()
+{
+    // Answers to anything in flight are lost with the connection; put the
+    // transfers back in the queue, they keep their position and progress
+    pendingBegins.clear();
+
+    for (Transfer &transfer : transfers) {
+        if (transfer.state != Starting && transfer.state != Running) {
+            continue;
+        }
+
+        transfer.state = Queued;
+        transfer.inFlight = 0;
+        transfer.stalled = false;
+
+        if (!transfer.requested.isEmpty()) {
+            transfer.missing += transfer.requested.values();
+            transfer.requested.clear();
+            std::sort(transfer.missing.begin(), transfer.missing.end());
+        }
+    }
+}
+
+bool TransferManager::retry(Transfer &transfer)
+{
+    return ++transfer.failures <= MaxFailures;
+}
+
+void TransferManager::fail(int transferId, const QString &errorMessage)
+{
+    auto it = transfers.find(transferId);
+    if (it == transfers.end()) {
+        return;
+    }
+
+    if (!it->isUpload && !it->path.isEmpty()) {
+        QFile::remove(it->path);
+    }
+    transfers.erase(it);
+
+    qWarning() << "Transfer" << transferId << "failed:" << errorMessage;
+    emit transferFailed(transferId, errorMessage);
+    schedule();
+}
+
+TransferManager::Transfer *TransferManager::findUpload(const QString &uploadId)
+{
+    for (Transfer &transfer : transfers) {
+        if (transfer.isUpload && !uploadId.isEmpty() && transfer.uploadId == uploadId) {
+            return &transfer;
+        }
+    }
+    return nullptr;
+}
+
+TransferManager::Transfer *TransferManager::findDownloadByHash(const QString &sha256)
+{
+    for (Transfer &transfer : transfers) {
+        if (!transfer.isUpload && transfer.sha256 == sha256) {
+            return &transfer;
+        }
+    }
+    return nullptr;
+}
+
+TransferManager::Transfer *TransferManager::findDownload(int attachmentId)
+{
+    for (Transfer &transfer : transfers) {
+        if (!transfer.isUpload && transfer.attachmentId == attachmentId) {
+            return &transfer;
+        }
+    }
+    return nullptr;
+}
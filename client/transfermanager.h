@@ -0,0 +1,109 @@
+#ifndef TRANSFERMANAGER_H
+#define TRANSFERMANAGER_H
+
+#include <QObject>
+#include <QJsonObject>
+#include <QMap>
+#include <QQueue>
+#include <QSet>
+#include <QList>
+
+#include "session.h"
+#include "attachmentcache.h"
+
+// Queue of attachment uploads and downloads over the session's connection.
+// Uploads pipeline several chunks, downloads request several ranges at once
+// as raw frames and write them in place. Both pick up where they left off
+// once the session is restored after a reconnect. Finished files land in
+// the on-disk cache, so an attachment is only ever downloaded once.
+class TransferManager : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit TransferManager(Session *session, QObject *parent = nullptr);
+
+    // Local copy of an attachment, empty if it has to be downloaded
+    QString cachedPath(const QString &sha256);
+
+    // Both return a transfer id used by the signals below
+    int upload(const QString &filePath);
+    int download(int attachmentId, const QString &sha256, const QString &name, qint64 size);
+
+signals:
+    void progress(int transferId, qint64 bytesDone, qint64 bytesTotal);
+    void uploadFinished(int transferId, int attachmentId, const QString &sha256);
+    void downloadFinished(int transferId, const QString &path);
+    void transferFailed(int transferId, const QString &errorMessage);
+
+private slots:
+    void onResponse(const QJsonObject &response);
+    void onPayload(const QJsonObject &header, const QByteArray &payload);
+    void onDisconnected();
+    void onCacheStored(const QString &sha256, const QString &path);
+    void onCacheStoreFailed(const QString &sha256);
+    void schedule();
+
+private:
+    enum State {
+        Hashing,        // upload source being hashed off the GUI thread
+        Queued,
+        Starting,       // uploadBegin sent
+        Running,
+        Verifying       // download complete, hash being checked and stored
+    };
+
+    struct Transfer {
+        int id = 0;
+        bool isUpload = false;
+        State state = Queued;
+        QString path;           // upload source or partial download
+        QString name;
+        qint64 size = 0;
+        qint64 done = 0;
+        QString sha256;
+        int failures = 0;
+
+        // Upload
+        QString uploadId;
+        qint64 nextOffset = 0;
+        int chunkSize = 0;
+        int inFlight = 0;
+        bool stalled = false;   // waiting out in-flight chunks after an error
+
+        // Download
+        int attachmentId = -1;
+        QList<qint64> missing;  // chunk offsets not requested yet
+        QSet<qint64> requested;
+    };
+
+    void startUpload(Transfer &transfer);
+    void pumpUpload(Transfer &transfer);
+    void onUploadBegin(const QJsonObject &response);
+    void onUploadChunk(const QJsonObject &response);
+    void pumpDownload(Transfer &transfer);
+    void onDownloadError(const QJsonObject &response);
+    void finishDownload(Transfer &transfer);
+    bool retry(Transfer &transfer);
+    void fail(int transferId, const QString &errorMessage);
+    Transfer *findUpload(const QString &uploadId);
+    Transfer *findDownload(int attachmentId);
+    Transfer *findDownloadByHash(const QString &sha256);
+    QJsonObject request(const QString &action) const;
+
+    Session *session;
+    NetworkClient *networkClient;
+    AttachmentCache *cache;
+
+    QMap<int, Transfer> transfers;      // ordered by id, so first come first served
+    QQueue<int> pendingBegins;          // uploadBegin answers carry no transfer id
+    int nextTransferId;
+
+    static constexpr int MaxActiveTransfers = 2;
+    static constexpr int MaxChunksInFlight = 4;
+    static constexpr qint64 DownloadChunkSize = 1024 * 1024;
+    static constexpr int MaxFailures = 5;       // in a row, per transfer
+    static constexpr qint64 CacheBudget = 1024LL * 1024 * 1024;
+};
+
+#endif // TRANSFERMANAGER_H
@@ -0,0 +1,37 @@
+#ifndef ATTACHMENT_H
+#define ATTACHMENT_H
+
+#include <QString>
+#include <QDateTime>
+
+// A stored file; several attachments may share the same content hash
+class Attachment
+{
+public:
+    Attachment() : id(-1), size(0), uploaderId(-1), thumbnailWidth(0), thumbnailHeight(0), thumbnailSize(0) {}
+
+    int id;
+    QString sha256;
+    QString name;
+    qint64 size;
+    int uploaderId;
+    QDateTime createdAt;
+    int thumbnailWidth;
+    int thumbnailHeight;
+    qint64 thumbnailSize;   // 0 until a thumbnail has been generated
+};
+
+// An upload in progress, its data is staged in the FileStore
+class Upload
+{
+public:
+    Upload() : userId(-1), size(0) {}
+
+    QString id;
+    int userId;
+    QString name;
+    qint64 size;
+    QString sha256;     // expected hash if the client sent one
+};
+
+#endif // ATTACHMENT_H
@@ -1,11 +1,19 @@
 #include "database.h"
+#include "tracer.h"
+
 #include <QDir>
 #include <QStandardPaths>
 #include <QVariant>
 #include <QDateTime>
+#include <QRegularExpression>
+
+const QString Database::SearchMatchStart = QStringLiteral("\x02");
+const QString Database::SearchMatchEnd = QStringLiteral("\x03");
 
 Database::Database(QObject *parent)
     : QObject(parent)
+    , transactionDepth(0)
+    , searchAvailable(false)
 {
 }
 
@@ -16,18 +24,22 @@ Database::~Database()
     }
 }
 
-bool Database::initialize()
+bool Database::initialize(const QString &path)
 {
-    // Set up database directory
-    QString dataPath = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation);
-    QDir dir(dataPath);
-    if (!dir.exists()) {
-        dir.mkpath(".");
+    QString databasePath = path;
+    if (databasePath.isEmpty()) {
+        // Set up database directory
+        QString dataPath = QStandardPaths::writableLocation(QStandardPaths::AppDataLocation);
+        QDir dir(dataPath);
+        if (!dir.exists()) {
+            dir.mkpath(".");
+        }
+        databasePath = dataPath + "/messenger.db";
     }
 
     // Initialize database
     db = QSqlDatabase::addDatabase("QSQLITE");
-    db.setDatabaseName(dataPath + "/messenger.db");
+    db.setDatabaseName(databasePath);
 
     if (!db.open()) {
         qCritical() << "Failed to open database:" << db.lastError().text();
@@ -82,11 +94,238 @@ bool Database::createTables()
         return false;
     }
 
+    // Rows written before the offline queue existed count as delivered
+    if (!ensureColumn("messages", "delivered", "INTEGER NOT NULL DEFAULT 1")) {
+        return false;
+    }
+
+    // Only undelivered rows are indexed, so the queue stays small however big the table gets
+    if (!query.exec("CREATE INDEX IF NOT EXISTS idx_messages_undelivered "
+                    "ON messages(receiver_id, id) WHERE delivered = 0")) {
+        qCritical() << "Failed to create undelivered messages index:" << query.lastError().text();
+        return false;
+    }
+
+    // Uploads in progress, their data lives in the FileStore staging area
+    if (!query.exec("CREATE TABLE IF NOT EXISTS uploads ("
+                    "id TEXT PRIMARY KEY, "
+                    "user_id INTEGER NOT NULL, "
+                    "name TEXT NOT NULL, "
+                    "size INTEGER NOT NULL, "
+                    "sha256 TEXT, "
+                    "created_at TIMESTAMP DEFAULT CURRENT_TIMESTAMP, "
+                    "FOREIGN KEY (user_id) REFERENCES users(id)"
+                    ")")) {
+        qCritical() << "Failed to create uploads table:" << query.lastError().text();
+        return false;
+    }
+
+    // Finished uploads, the content itself is stored once per hash
+    if (!query.exec("CREATE TABLE IF NOT EXISTS attachments ("
+                    "id INTEGER PRIMARY KEY AUTOINCREMENT, "
+                    "sha256 TEXT NOT NULL, "
+                    "name TEXT NOT NULL, "
+                    "size INTEGER NOT NULL, "
+                    "uploader_id INTEGER NOT NULL, "
+                    "created_at TIMESTAMP DEFAULT CURRENT_TIMESTAMP, "
+                    "FOREIGN KEY (uploader_id) REFERENCES users(id)"
+                    ")")) {
+        qCritical() << "Failed to create attachments table:" << query.lastError().text();
+        return false;
+    }
+
+    if (!ensureColumn("messages", "attachment_id", "INTEGER REFERENCES attachments(id)")
+        || !ensureColumn("attachments", "thumb_width", "INTEGER")
+        || !ensureColumn("attachments", "thumb_height", "INTEGER")
+        || !ensureColumn("attachments", "thumb_size", "INTEGER")) {
+        return false;
+    }
+
+    // Retried sends carry the same client id, the second insert fails here
+    if (!ensureColumn("messages", "client_message_id", "TEXT")) {
+        return false;
+    }
+
+    // Uploads expire once idle, not once old, so a slow transfer survives
+    if (!ensureColumn("uploads", "last_chunk_at", "TIMESTAMP")) {
+        return false;
+    }
+
+    if (!query.exec("CREATE UNIQUE INDEX IF NOT EXISTS idx_messages_client_id "
+                    "ON messages(sender_id, client_message_id) WHERE client_message_id IS NOT NULL")) {
+        qCritical() << "Failed to create client message id index:" << query.lastError().text();
+        return false;
+    }
+
+    // Search is optional, a SQLite without FTS5 only loses searchMessages
+    searchAvailable = createSearchIndex();
+
+    return true;
+}
+
+bool Database::createSearchIndex()
+{
+    QSqlQuery query;
+
+    // Who can see a message goes into the index as tokens next to its text:
+    // u<id> for both participants and c<low>x<high> for the conversation.
+    // A scoped search then intersects posting lists instead of filtering
+    // every text match against the messages table.
+    const QString scope = "'u' || sender_id || ' u' || receiver_id || ' c' || "
+                          "min(sender_id, receiver_id) || 'x' || max(sender_id, receiver_id)";
+
+    if (!query.exec("CREATE VIEW IF NOT EXISTS messages_search AS "
+                    "SELECT id, content, " + scope + " AS scope FROM messages")) {
+        qWarning() << "Message search disabled, cannot create view:" << query.lastError().text();
+        return false;
+    }
+
+    if (!query.exec("SELECT 1 FROM sqlite_master WHERE type = 'table' AND name = 'messages_fts'")) {
+        qWarning() << "Message search disabled:" << query.lastError().text();
+        return false;
+    }
+    bool exists = query.next();
+    query.finish();
+
+    if (!exists) {
+        // External content: the index holds no copy of the text, snippets
+        // read it back through the view
+        if (!query.exec("CREATE VIRTUAL TABLE messages_fts USING fts5("
+                        "content, scope, content='messages_search', content_rowid='id', "
+                        "tokenize='unicode61 remove_diacritics 2')")) {
+            qWarning() << "Message search disabled, FTS5 unavailable:" << query.lastError().text();
+            return false;
+        }
+
+        // Scope tokens must never make a message rank higher
+        if (!query.exec("INSERT INTO messages_fts(messages_fts, rank) VALUES('rank', 'bm25(1.0, 0.0)')")) {
+            qWarning() << "Failed to configure message search ranking:" << query.lastError().text();
+            return false;
+        }
+
+        // One-off for databases that already hold messages
+        qInfo() << "Building message search index";
+        if (!query.exec("INSERT INTO messages_fts(messages_fts) VALUES('rebuild')")) {
+            qWarning() << "Failed to build message search index:" << query.lastError().text();
+            return false;
+        }
+    }
+
+    // Triggers keep the index in step with every write path
+    const QString newScope = QString(scope).replace("sender_id", "new.sender_id").replace("receiver_id", "new.receiver_id");
+    const QString oldScope = QString(scope).replace("sender_id", "old.sender_id").replace("receiver_id", "old.receiver_id");
+
+    const QStringList triggers = {
+        "CREATE TRIGGER IF NOT EXISTS messages_fts_insert AFTER INSERT ON messages BEGIN "
+        "INSERT INTO messages_fts(rowid, content, scope) VALUES (new.id, new.content, " + newScope + "); "
+        "END",
+        "CREATE TRIGGER IF NOT EXISTS messages_fts_delete AFTER DELETE ON messages BEGIN "
+        "INSERT INTO messages_fts(messages_fts, rowid, content, scope) "
+        "VALUES ('delete', old.id, old.content, " + oldScope + "); "
+        "END",
+        "CREATE TRIGGER IF NOT EXISTS messages_fts_update AFTER UPDATE OF content, sender_id, receiver_id ON messages BEGIN "
+        "INSERT INTO messages_fts(messages_fts, rowid, content, scope) "
+        "VALUES ('delete', old.id, old.content, " + oldScope + "); "
+        "INSERT INTO messages_fts(rowid, content, scope) VALUES (new.id, new.content, " + newScope + "); "
+        "END"
+    };
+    for (const QString &trigger : triggers) {
+        if (!query.exec(trigger)) {
+            qWarning() << "Failed to create message search trigger:" << query.lastError().text();
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool Database::ensureColumn(const QString &table, const QString &column, const QString &definition)
+{
+    QSqlQuery query;
+    if (!query.exec(QString("PRAGMA table_info(%1)").arg(table))) {
+        qCritical() << "Failed to inspect table" << table << ":" << query.lastError().text();
+        return false;
+    }
+
+    while (query.next()) {
+        if (query.value(1).toString() == column) {
+            return true;
+        }
+    }
+
+    if (!query.exec(QString("ALTER TABLE %1 ADD COLUMN %2 %3").arg(table, column, definition))) {
+        qCritical() << "Failed to add column" << column << "to" << table << ":" << query.lastError().text();
+        return false;
+    }
+
+    return true;
+}
+
+bool Database::beginTransaction()
+{
+    // SQLite has no nested transactions, inner levels become savepoints
+    if (transactionDepth == 0) {
+        if (!db.transaction()) {
+            qWarning() << "Failed to start transaction:" << db.lastError().text();
+            return false;
+        }
+    } else {
+        QSqlQuery query;
+        if (!query.exec(QString("SAVEPOINT level%1").arg(transactionDepth))) {
+            qWarning() << "Failed to create savepoint:" << query.lastError().text();
+            return false;
+        }
+    }
+
+    ++transactionDepth;
+    return true;
+}
+
+bool Database::commitTransaction()
+{
+    if (transactionDepth == 0) {
+        return false;
+    }
+
+    --transactionDepth;
+    if (transactionDepth == 0) {
+        if (!db.commit()) {
+            qWarning() << "Failed to commit transaction:" << db.lastError().text();
+            db.rollback();
+            return false;
+        }
+        return true;
+    }
+
+    QSqlQuery query;
+    if (!query.exec(QString("RELEASE SAVEPOINT level%1").arg(transactionDepth))) {
+        qWarning() << "Failed to release savepoint:" << query.lastError().text();
+        return false;
+    }
     return true;
 }
 
+bool Database::rollbackTransaction()
+{
+    if (transactionDepth == 0) {
+        return false;
+    }
+
+    --transactionDepth;
+    if (transactionDepth == 0) {
+        return db.rollback();
+    }
+
+    // Undo this level only, the savepoint has to be released afterwards
+    QSqlQuery query;
+    return query.exec(QString("ROLLBACK TO SAVEPOINT level%1").arg(transactionDepth))
+        && query.exec(QString("RELEASE SAVEPOINT level%1").arg(transactionDepth));
+}
+
 bool Database::addUser(User &user)
 {
+    TraceSpan span("Database::addUser", "db");
+
     QSqlQuery query;
     query.prepare("INSERT INTO users (username, email, password) "
                   "VALUES (:username, :email, :password)");
@@ -103,8 +342,34 @@ bool Database::addUser(User &user)
     return true;
 }
 
+QList<User> Database::getDirectoryUsers()
+{
+    TraceSpan span("Database::getDirectoryUsers", "db");
+
+    QList<User> users;
+
+    QSqlQuery query;
+    query.setForwardOnly(true);
+    if (!query.exec("SELECT id, username, email FROM users")) {
+        qWarning() << "Get directory users query failed:" << query.lastError().text();
+        return users;
+    }
+
+    while (query.next()) {
+        User user;
+        user.id = query.value(0).toInt();
+        user.username = query.value(1).toString();
+        user.email = query.value(2).toString();
+        users.append(user);
+    }
+
+    return users;
+}
+
 bool Database::authenticateUser(const QString &username, const QString &password, User &user)
 {
+    TraceSpan span("Database::authenticateUser", "db");
+
     QSqlQuery query;
     query.prepare("SELECT id, username, email, password FROM users "
                   "WHERE (username = :username OR email = :username) "
@@ -130,6 +395,8 @@ bool Database::authenticateUser(const QString &username, const QString &password
 
 bool Database::getUserById(int id, User &user)
 {
+    TraceSpan span("Database::getUserById", "db");
+
     QSqlQuery query;
     query.prepare("SELECT id, username, email FROM users WHERE id = :id");
     query.bindValue(":id", id);
@@ -158,6 +425,8 @@ User Database::getUserById(int id)
 
 bool Database::getUserByUsername(const QString &username, User &user)
 {
+    TraceSpan span("Database::getUserByUsername", "db");
+
     QSqlQuery query;
     query.prepare("SELECT id, username, email FROM users WHERE username = :username");
     query.bindValue(":username", username);
@@ -179,6 +448,8 @@ bool Database::getUserByUsername(const QString &username, User &user)
 
 bool Database::usernameExists(const QString &username)
 {
+    TraceSpan span("Database::usernameExists", "db");
+
     QSqlQuery query;
     query.prepare("SELECT COUNT(*) FROM users WHERE username = :username");
     query.bindValue(":username", username);
@@ -197,6 +468,8 @@ bool Database::usernameExists(const QString &username)
 
 bool Database::emailExists(const QString &email)
 {
+    TraceSpan span("Database::emailExists", "db");
+
     QSqlQuery query;
     query.prepare("SELECT COUNT(*) FROM users WHERE email = :email");
     query.bindValue(":email", email);
@@ -215,6 +488,8 @@ bool Database::emailExists(const QString &email)
 
 QList<User> Database::getContacts(int userId)
 {
+    TraceSpan span("Database::getContacts", "db");
+
     QList<User> contacts;
     QSqlQuery query;
 
@@ -244,10 +519,12 @@ QList<User> Database::getContacts(int userId)
 
 bool Database::addContact(int userId, int contactId)
 {
+    TraceSpan span("Database::addContact", "db");
+
     QSqlQuery query;
 
-    if (!db.transaction()) {
-        qWarning() << "Failed to start transaction:" << db.lastError().text();
+    // May run inside a batch that already holds a transaction
+    if (!beginTransaction()) {
         return false;
     }
 
@@ -257,7 +534,7 @@ bool Database::addContact(int userId, int contactId)
     query.bindValue(":contactId", contactId);
 
     if (!query.exec()) {
-        db.rollback();
+        rollbackTransaction();
         qWarning() << "Failed to add contact:" << query.lastError().text();
         return false;
     }
@@ -268,16 +545,93 @@ bool Database::addContact(int userId, int contactId)
     query.bindValue(":contactId", contactId);
 
     if (!query.exec()) {
-        db.rollback();
+        rollbackTransaction();
         qWarning() << "Failed to add reverse contact:" << query.lastError().text();
         return false;
     }
 
-    return db.commit();
+    return commitTransaction();
+}
+
+QSet<int> Database::getContactIds(int userId)
+{
+    TraceSpan span("Database::getContactIds", "db");
+
+    QSet<int> ids;
+
+    // Covered by the primary key, never touches the users table
+    QSqlQuery query;
+    query.prepare("SELECT contact_id FROM contacts WHERE user_id = :userId");
+    query.bindValue(":userId", userId);
+
+    if (!query.exec()) {
+        qWarning() << "Failed to get contact ids:" << query.lastError().text();
+        return ids;
+    }
+
+    while (query.next()) {
+        ids.insert(query.value(0).toInt());
+    }
+
+    return ids;
+}
+
+bool Database::addContacts(int userId, const QList<int> &contactIds)
+{
+    TraceSpan span("Database::addContacts", "db");
+
+    if (contactIds.isEmpty()) {
+        return true;
+    }
+
+    // One transaction and one prepared statement for the whole list; pairs
+    // that already exist in either direction are left alone
+    if (!beginTransaction()) {
+        return false;
+    }
+
+    QSqlQuery query;
+    query.prepare("INSERT OR IGNORE INTO contacts (user_id, contact_id) VALUES (:userId, :contactId)");
+
+    for (int contactId : contactIds) {
+        for (int direction = 0; direction < 2; ++direction) {
+            query.bindValue(":userId", direction == 0 ? userId : contactId);
+            query.bindValue(":contactId", direction == 0 ? contactId : userId);
+
+            if (!query.exec()) {
+                qWarning() << "Failed to add contacts:" << query.lastError().text();
+                rollbackTransaction();
+                return false;
+            }
+        }
+    }
+
+    return commitTransaction();
+}
+
+bool Database::removeContact(int userId, int contactId)
+{
+    TraceSpan span("Database::removeContact", "db");
+
+    // Remove contact in both directions
+    QSqlQuery query;
+    query.prepare("DELETE FROM contacts WHERE (user_id = :userId AND contact_id = :contactId) "
+                  "OR (user_id = :contactId AND contact_id = :userId)");
+    query.bindValue(":userId", userId);
+    query.bindValue(":contactId", contactId);
+
+    if (!query.exec()) {
+        qWarning() << "Failed to remove contact:" << query.lastError().text();
+        return false;
+    }
+
+    return query.numRowsAffected() > 0;
 }
 
 bool Database::isContactExists(int userId, int contactId)
 {
+    TraceSpan span("Database::isContactExists", "db");
+
     QSqlQuery query;
     query.prepare("SELECT COUNT(*) FROM contacts WHERE user_id = :userId AND contact_id = :contactId");
     query.bindValue(":userId", userId);
@@ -297,6 +651,8 @@ bool Database::isContactExists(int userId, int contactId)
 
 QList<QPair<User, QPair<Message, int>>> Database::getUserContacts(int userId)
 {
+    TraceSpan span("Database::getUserContacts", "db");
+
     QList<QPair<User, QPair<Message, int>>> result;
 
     QSqlQuery query;
@@ -356,15 +712,22 @@ QList<QPair<User, QPair<Message, int>>> Database::getUserContacts(int userId)
 
 bool Database::addMessage(Message &message)
 {
+    TraceSpan span("Database::addMessage", "db");
+
     QSqlQuery query;
-    query.prepare("INSERT INTO messages (sender_id, receiver_id, content, type, read, timestamp) "
-                  "VALUES (:senderId, :receiverId, :content, :type, :read, :timestamp)");
+    query.prepare("INSERT INTO messages (sender_id, receiver_id, content, type, read, delivered, timestamp, "
+                  "client_message_id, attachment_id) "
+                  "VALUES (:senderId, :receiverId, :content, :type, :read, :delivered, :timestamp, "
+                  ":clientMessageId, :attachmentId)");
     query.bindValue(":senderId", message.senderId);
     query.bindValue(":receiverId", message.receiverId);
     query.bindValue(":content", message.content);
     query.bindValue(":type", message.type);
     query.bindValue(":read", message.read);
+    query.bindValue(":delivered", message.delivered);
     query.bindValue(":timestamp", message.timestamp);
+    query.bindValue(":clientMessageId", message.clientMessageId.isEmpty() ? QVariant() : QVariant(message.clientMessageId));
+    query.bindValue(":attachmentId", message.attachmentId > 0 ? QVariant(message.attachmentId) : QVariant());
 
     if (!query.exec()) {
         qWarning() << "Failed to add message:" << query.lastError().text();
@@ -375,13 +738,221 @@ bool Database::addMessage(Message &message)
     return true;
 }
 
+int Database::findMessageByClientId(int senderId, const QString &clientMessageId)
+{
+    TraceSpan span("Database::findMessageByClientId", "db");
+
+    QSqlQuery query;
+    query.prepare("SELECT id FROM messages WHERE sender_id = :senderId AND client_message_id = :clientMessageId");
+    query.bindValue(":senderId", senderId);
+    query.bindValue(":clientMessageId", clientMessageId);
+
+    if (query.exec() && query.next()) {
+        return query.value(0).toInt();
+    }
+
+    return -1;
+}
+
+bool Database::addUpload(const Upload &upload)
+{
+    TraceSpan span("Database::addUpload", "db");
+
+    QSqlQuery query;
+    query.prepare("INSERT INTO uploads (id, user_id, name, size, sha256) "
+                  "VALUES (:id, :userId, :name, :size, :sha256)");
+    query.bindValue(":id", upload.id);
+    query.bindValue(":userId", upload.userId);
+    query.bindValue(":name", upload.name);
+    query.bindValue(":size", upload.size);
+    query.bindValue(":sha256", upload.sha256.isEmpty() ? QVariant() : QVariant(upload.sha256));
+
+    if (!query.exec()) {
+        qWarning() << "Failed to add upload:" << query.lastError().text();
+        return false;
+    }
+
+    return true;
+}
+
+bool Database::getUpload(const QString &id, Upload &upload)
+{
+    TraceSpan span("Database::getUpload", "db");
+
+    QSqlQuery query;
+    query.prepare("SELECT id, user_id, name, size, sha256 FROM uploads WHERE id = :id");
+    query.bindValue(":id", id);
+
+    if (!query.exec() || !query.next()) {
+        return false;
+    }
+
+    upload.id = query.value(0).toString();
+    upload.userId = query.value(1).toInt();
+    upload.name = query.value(2).toString();
+    upload.size = query.value(3).toLongLong();
+    upload.sha256 = query.value(4).toString();
+    return true;
+}
+
+bool Database::removeUpload(const QString &id)
+{
+    TraceSpan span("Database::removeUpload", "db");
+
+    QSqlQuery query;
+    query.prepare("DELETE FROM uploads WHERE id = :id");
+    query.bindValue(":id", id);
+
+    if (!query.exec()) {
+        qWarning() << "Failed to remove upload:" << query.lastError().text();
+        return false;
+    }
+
+    return true;
+}
+
+bool Database::touchUpload(const QString &id)
+{
+    TraceSpan span("Database::touchUpload", "db");
+
+    QSqlQuery query;
+    query.prepare("UPDATE uploads SET last_chunk_at = CURRENT_TIMESTAMP WHERE id = :id");
+    query.bindValue(":id", id);
+
+    if (!query.exec()) {
+        qWarning() << "Failed to touch upload:" << query.lastError().text();
+        return false;
+    }
+
+    return true;
+}
+
+QStringList Database::getStaleUploads(int maxAgeSecs)
+{
+    TraceSpan span("Database::getStaleUploads", "db");
+
+    QStringList ids;
+    QSqlQuery query;
+    query.prepare("SELECT id FROM uploads WHERE COALESCE(last_chunk_at, created_at) < datetime('now', :age)");
+    query.bindValue(":age", QString("-%1 seconds").arg(maxAgeSecs));
+
+    if (!query.exec()) {
+        qWarning() << "Failed to get stale uploads:" << query.lastError().text();
+        return ids;
+    }
+
+    while (query.next()) {
+        ids.append(query.value(0).toString());
+    }
+
+    return ids;
+}
+
+int Database::countUploads(int userId)
+{
+    TraceSpan span("Database::countUploads", "db");
+
+    QSqlQuery query;
+    query.prepare("SELECT COUNT(*) FROM uploads WHERE user_id = :userId");
+    query.bindValue(":userId", userId);
+
+    if (query.exec() && query.next()) {
+        return query.value(0).toInt();
+    }
+
+    return 0;
+}
+
+bool Database::addAttachment(Attachment &attachment)
+{
+    TraceSpan span("Database::addAttachment", "db");
+
+    QSqlQuery query;
+    query.prepare("INSERT INTO attachments (sha256, name, size, uploader_id) "
+                  "VALUES (:sha256, :name, :size, :uploaderId)");
+    query.bindValue(":sha256", attachment.sha256);
+    query.bindValue(":name", attachment.name);
+    query.bindValue(":size", attachment.size);
+    query.bindValue(":uploaderId", attachment.uploaderId);
+
+    if (!query.exec()) {
+        qWarning() << "Failed to add attachment:" << query.lastError().text();
+        return false;
+    }
+
+    attachment.id = query.lastInsertId().toInt();
+
+    // Content we have seen before already has its thumbnail
+    query.prepare("SELECT thumb_width, thumb_height, thumb_size FROM attachments "
+                  "WHERE sha256 = :sha256 AND thumb_size IS NOT NULL LIMIT 1");
+    query.bindValue(":sha256", attachment.sha256);
+    if (query.exec() && query.next()) {
+        attachment.thumbnailWidth = query.value(0).toInt();
+        attachment.thumbnailHeight = query.value(1).toInt();
+        attachment.thumbnailSize = query.value(2).toLongLong();
+        query.finish();
+
+        setAttachmentThumbnail(attachment.sha256, attachment.thumbnailWidth, attachment.thumbnailHeight,
+                               attachment.thumbnailSize);
+    }
+
+    return true;
+}
+
+bool Database::setAttachmentThumbnail(const QString &sha256, int width, int height, qint64 size)
+{
+    TraceSpan span("Database::setAttachmentThumbnail", "db");
+
+    QSqlQuery query;
+    query.prepare("UPDATE attachments SET thumb_width = :width, thumb_height = :height, thumb_size = :size "
+                  "WHERE sha256 = :sha256");
+    query.bindValue(":width", width);
+    query.bindValue(":height", height);
+    query.bindValue(":size", size);
+    query.bindValue(":sha256", sha256);
+
+    if (!query.exec()) {
+        qWarning() << "Failed to set attachment thumbnail:" << query.lastError().text();
+        return false;
+    }
+
+    return true;
+}
+
+bool Database::getAttachment(int id, Attachment &attachment)
+{
+    TraceSpan span("Database::getAttachment", "db");
+
+    QSqlQuery query;
+    query.prepare("SELECT id, sha256, name, size, uploader_id, created_at, thumb_width, thumb_height, thumb_size "
+                  "FROM attachments WHERE id = :id");
+    query.bindValue(":id", id);
+
+    if (!query.exec() || !query.next()) {
+        return false;
+    }
+
+    attachment.id = query.value(0).toInt();
+    attachment.sha256 = query.value(1).toString();
+    attachment.name = query.value(2).toString();
+    attachment.size = query.value(3).toLongLong();
+    attachment.uploaderId = query.value(4).toInt();
+    attachment.createdAt = query.value(5).toDateTime();
+    attachment.thumbnailWidth = query.value(6).toInt();
+    attachment.thumbnailHeight = query.value(7).toInt();
+    attachment.thumbnailSize = query.value(8).toLongLong();
+    return true;
+}
+
 QList<Message> Database::getChatHistory(int userId, int contactId)
 {
+    TraceSpan span("Database::getChatHistory", "db");
+
     QList<Message> messages;
 
     QSqlQuery query;
     query.prepare(
-        "SELECT id, sender_id, receiver_id, content, type, read, timestamp "
+        "SELECT id, sender_id, receiver_id, content, type, read, timestamp, attachment_id "
         "FROM messages "
         "WHERE (sender_id = :userId AND receiver_id = :contactId) "
         "OR (sender_id = :contactId AND receiver_id = :userId) "
@@ -404,6 +975,7 @@ QList<Message> Database::getChatHistory(int userId, int contactId)
         message.type = query.value(4).toString();
         message.read = query.value(5).toBool();
         message.timestamp = query.value(6).toDateTime();
+        message.attachmentId = query.value(7).isNull() ? -1 : query.value(7).toInt();
 
         messages.append(message);
     }
@@ -411,8 +983,141 @@ QList<Message> Database::getChatHistory(int userId, int contactId)
     return messages;
 }
 
+QString Database::searchExpression(const QString &text)
+{
+    // Every word becomes a quoted phrase so user input can never be FTS5
+    // syntax; the last one matches as a prefix for search-as-you-type
+    const QStringList words = text.split(QRegularExpression("\\s+"), Qt::SkipEmptyParts);
+
+    QStringList phrases;
+    for (const QString &word : words) {
+        phrases.append("\"" + QString(word).replace("\"", "\"\"") + "\"");
+    }
+    if (!phrases.isEmpty()) {
+        phrases.last().append('*');
+    }
+    return phrases.join(' ');
+}
+
+QList<QPair<Message, QString>> Database::searchMessages(int userId, int contactId, const QString &text,
+                                                        int limit, int offset)
+{
+    TraceSpan span("Database::searchMessages", "db");
+
+    QList<QPair<Message, QString>> results;
+
+    QString expression = searchExpression(text);
+    if (!searchAvailable || expression.isEmpty()) {
+        return results;
+    }
+
+    // Scope tokens are written by createSearchIndex()
+    QString scope = contactId == -1
+        ? QString("u%1").arg(userId)
+        : QString("c%1x%2").arg(qMin(userId, contactId)).arg(qMax(userId, contactId));
+    QString match = QString("content : (%1) AND scope : \"%2\"").arg(expression, scope);
+
+    // CROSS JOIN keeps the index in the outer loop, only the page of hits
+    // is looked up in messages
+    QSqlQuery query;
+    query.prepare(
+        "SELECT m.id, m.sender_id, m.receiver_id, m.type, m.read, m.timestamp, m.attachment_id, "
+        "snippet(messages_fts, 0, :matchStart, :matchEnd, '...', 16) "
+        "FROM messages_fts CROSS JOIN messages m ON m.id = messages_fts.rowid "
+        "WHERE messages_fts MATCH :match "
+        "ORDER BY rank LIMIT :limit OFFSET :offset"
+        );
+    query.bindValue(":matchStart", SearchMatchStart);
+    query.bindValue(":matchEnd", SearchMatchEnd);
+    query.bindValue(":match", match);
+    query.bindValue(":limit", limit);
+    query.bindValue(":offset", offset);
+
+    if (!query.exec()) {
+        qWarning() << "Search messages query failed:" << query.lastError().text();
+        return results;
+    }
+
+    while (query.next()) {
+        Message message;
+        message.id = query.value(0).toInt();
+        message.senderId = query.value(1).toInt();
+        message.receiverId = query.value(2).toInt();
+        message.type = query.value(3).toString();
+        message.read = query.value(4).toBool();
+        message.timestamp = query.value(5).toDateTime();
+        message.attachmentId = query.value(6).isNull() ? -1 : query.value(6).toInt();
+
+        results.append(qMakePair(message, query.value(7).toString()));
+    }
+
+    return results;
+}
+
+QList<Message> Database::getUndeliveredMessages(int receiverId, int afterId, int limit)
+{
+    TraceSpan span("Database::getUndeliveredMessages", "db");
+
+    QList<Message> messages;
+
+    // Served by idx_messages_undelivered, in insertion order
+    QSqlQuery query;
+    query.prepare(
+        "SELECT id, sender_id, receiver_id, content, type, read, timestamp, attachment_id "
+        "FROM messages "
+        "WHERE receiver_id = :receiverId AND delivered = 0 AND id > :afterId "
+        "ORDER BY id ASC LIMIT :limit"
+        );
+    query.bindValue(":receiverId", receiverId);
+    query.bindValue(":afterId", afterId);
+    query.bindValue(":limit", limit);
+
+    if (!query.exec()) {
+        qWarning() << "Get undelivered messages query failed:" << query.lastError().text();
+        return messages;
+    }
+
+    while (query.next()) {
+        Message message;
+        message.id = query.value(0).toInt();
+        message.senderId = query.value(1).toInt();
+        message.receiverId = query.value(2).toInt();
+        message.content = query.value(3).toString();
+        message.type = query.value(4).toString();
+        message.read = query.value(5).toBool();
+        message.timestamp = query.value(6).toDateTime();
+        message.attachmentId = query.value(7).isNull() ? -1 : query.value(7).toInt();
+
+        messages.append(message);
+    }
+
+    return messages;
+}
+
+bool Database::markMessagesDelivered(int receiverId, int upToId)
+{
+    TraceSpan span("Database::markMessagesDelivered", "db");
+
+    QSqlQuery query;
+    query.prepare(
+        "UPDATE messages SET delivered = 1 "
+        "WHERE receiver_id = :receiverId AND delivered = 0 AND id <= :upToId"
+        );
+    query.bindValue(":receiverId", receiverId);
+    query.bindValue(":upToId", upToId);
+
+    if (!query.exec()) {
+        qWarning() << "Mark messages as delivered query failed:" << query.lastError().text();
+        return false;
+    }
+
+    return true;
+}
+
 bool Database::markMessagesAsRead(int senderId, int receiverId)
 {
+    TraceSpan span("Database::markMessagesAsRead", "db");
+
     QSqlQuery query;
     query.prepare(
         "UPDATE messages SET read = 1 "
@@ -431,6 +1136,8 @@ bool Database::markMessagesAsRead(int senderId, int receiverId)
 
 int Database::getUnreadMessageCount(int userId, int contactId)
 {
+    TraceSpan span("Database::getUnreadMessageCount", "db");
+
     QSqlQuery query;
     query.prepare(
         "SELECT COUNT(*) FROM messages "
@@ -6,8 +6,11 @@
 #include <QSqlDatabase>
 #include <QSqlQuery>
 #include <QSqlError>
+#include <QSet>
+#include <QStringList>
 #include "user.h"
 #include "message.h"
+#include "attachment.h"
 
 class Database : public QObject
 {
@@ -17,7 +20,13 @@ public:
     explicit Database(QObject *parent = nullptr);
     ~Database();
 
-    bool initialize();
+    // Opens messenger.db in the app data directory unless a path is given
+    bool initialize(const QString &path = QString());
+
+    // Transactions nest; inner levels are savepoints that roll back on their own
+    bool beginTransaction();
+    bool commitTransaction();
+    bool rollbackTransaction();
 
     // User management
     bool addUser(User &user);
@@ -28,22 +37,55 @@ public:
     bool getUserByUsername(const QString &username, User &user);
     bool usernameExists(const QString &username);
     bool emailExists(const QString &email);
+    QList<User> getDirectoryUsers();     // id, username and email only
 
     // Contact management
     bool addContact(int userId, int contactId);
     bool removeContact(int userId, int contactId);
     QList<User> getContacts(int userId);
     bool isContactExists(int userId, int contactId);
+    QSet<int> getContactIds(int userId);
+    bool addContacts(int userId, const QList<int> &contactIds);
 
     // Message management
     bool addMessage(Message &message);
+    int findMessageByClientId(int senderId, const QString &clientMessageId);
     QList<Message> getChatHistory(int userId, int contactId);
     bool markMessagesAsRead(int senderId, int receiverId);
     int getUnreadMessageCount(int userId, int contactId);
 
+    // Full-text search over the messages a user sent or received, best
+    // match first; contactId -1 searches every conversation. Each hit comes
+    // with a snippet where matches are wrapped in SearchMatchStart/End.
+    bool isSearchAvailable() const { return searchAvailable; }
+    QList<QPair<Message, QString>> searchMessages(int userId, int contactId, const QString &text,
+                                                  int limit, int offset);
+    static const QString SearchMatchStart;
+    static const QString SearchMatchEnd;
+
+    // Attachments, uploads are tracked until their data is complete
+    bool addUpload(const Upload &upload);
+    bool getUpload(const QString &id, Upload &upload);
+    bool removeUpload(const QString &id);
+    bool touchUpload(const QString &id);
+    QStringList getStaleUploads(int maxAgeSecs);      // idle for longer than maxAgeSecs
+    int countUploads(int userId);
+    bool addAttachment(Attachment &attachment);
+    bool getAttachment(int id, Attachment &attachment);
+    bool setAttachmentThumbnail(const QString &sha256, int width, int height, qint64 size);
+
+    // Offline queue: messages stored while their receiver was not connected
+    QList<Message> getUndeliveredMessages(int receiverId, int afterId, int limit);
+    bool markMessagesDelivered(int receiverId, int upToId);
+
 private:
     bool createTables();
+    bool ensureColumn(const QString &table, const QString &column, const QString &definition);
+    bool createSearchIndex();
+    static QString searchExpression(const QString &text);
     QSqlDatabase db;
+    int transactionDepth;
+    bool searchAvailable;
 };
 
 #endif // DATABASE_H
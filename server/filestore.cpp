@@ -0,0 +1,287 @@
+#include "filestore.h"
+#include "tracer.h"
+
+#include <QDir>
+#include <QFileInfo>
+#include <QRandomGenerator>
+#include <QDebug>
+
+FileStore::FileStore()
+{
+    pool.setMaxThreadCount(2);
+}
+
+FileStore::~FileStore()
+{
+    pool.waitForDone();
+    qDeleteAll(openUploads);
+    qDeleteAll(rehashing);
+}
+
+bool FileStore::open(const QString &path)
+{
+    QDir dir(path);
+    if (!dir.mkpath("objects") || !dir.mkpath("uploads") || !dir.mkpath("thumbs")) {
+        qCritical() << "Failed to create attachment store in" << path;
+        return false;
+    }
+
+    rootPath = dir.absolutePath();
+    return true;
+}
+
+QString FileStore::newUploadId()
+{
+    // 128 random bits, hex so they are safe as file names
+    quint32 random[4];
+    QRandomGenerator::system()->fillRange(random);
+    return QString::fromLatin1(QByteArray(reinterpret_cast<const char *>(random), sizeof(random)).toHex());
+}
+
+bool FileStore::isValidHash(const QString &sha256)
+{
+    if (sha256.size() != 64) {
+        return false;
+    }
+
+    for (QChar c : sha256) {
+        if (!((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f'))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+QString FileStore::stagingPath(const QString &uploadId) const
+{
+    return rootPath + "/uploads/" + uploadId + ".part";
+}
+
+QString FileStore::objectPath(const QString &sha256) const
+{
+    // Fan out by the first byte so no directory grows too large
+    return rootPath + "/objects/" + sha256.left(2) + "/" + sha256;
+}
+
+QString FileStore::thumbnailPath(const QString &sha256) const
+{
+    return rootPath + "/thumbs/" + sha256.left(2) + "/" + sha256;
+}
+
+bool FileStore::hasObject(const QString &sha256) const
+{
+    return isValidHash(sha256) && QFileInfo::exists(objectPath(sha256));
+}
+
+bool FileStore::createStaging(const QString &uploadId)
+{
+    QFile file(stagingPath(uploadId));
+    if (!file.open(QIODevice::WriteOnly)) {
+        qWarning() << "Failed to create staging file:" << file.errorString();
+        return false;
+    }
+    return true;
+}
+
+qint64 FileStore::stagedSize(const QString &uploadId) const
+{
+    if (Staging *open = openUploads.value(uploadId)) {
+        return open->file.size();
+    }
+
+    QFileInfo info(stagingPath(uploadId));
+    return info.exists() ? info.size() : -1;
+}
+
+FileStore::Staging *FileStore::staging(const QString &uploadId)
+{
+    if (Staging *open = openUploads.value(uploadId)) {
+        return open;
+    }
+    if (rehashing.contains(uploadId)) {
+        return nullptr;
+    }
+
+    Staging *entry = new Staging;
+    entry->file.setFileName(stagingPath(uploadId));
+    if (!entry->file.open(QIODevice::ReadWrite)) {
+        qWarning() << "Failed to open staging file:" << entry->file.errorString();
+        delete entry;
+        return nullptr;
+    }
+
+    // Callers prepare() anything already staged, this only catches stragglers
+    TraceSpan span("FileStore::rehash", "files");
+    span.setArg("bytes", entry->file.size());
+    while (!entry->file.atEnd()) {
+        entry->hash.addData(entry->file.read(RehashBlockSize));
+    }
+
+    keepOpen(uploadId, entry);
+    return entry;
+}
+
+void FileStore::keepOpen(const QString &uploadId, Staging *entry)
+{
+    // Bound the number of open handles, an evicted upload is prepared again on its next chunk
+    if (openUploads.size() >= MaxOpenUploads) {
+        close(openUploads.constBegin().key());
+    }
+    openUploads.insert(uploadId, entry);
+}
+
+bool FileStore::isReady(const QString &uploadId) const
+{
+    if (openUploads.contains(uploadId)) {
+        return true;
+    }
+    if (rehashing.contains(uploadId)) {
+        return false;
+    }
+
+    // Nothing staged yet means nothing to hash
+    return stagedSize(uploadId) <= 0;
+}
+
+void FileStore::prepare(const QString &uploadId, QObject *context, std::function<void(bool)> done)
+{
+    if (isReady(uploadId) || rehashing.contains(uploadId)) {
+        done(isReady(uploadId));
+        return;
+    }
+
+    // The worker only fills in the hash, the file handle is opened back here
+    Staging *entry = new Staging;
+    rehashing.insert(uploadId, entry);
+
+    QString path = stagingPath(uploadId);
+    QPointer<QObject> owner(context);
+    pool.start([this, owner, uploadId, entry, path, done]() {
+        TraceSpan span("FileStore::rehash", "files");
+
+        QFile file(path);
+        bool hashed = file.open(QIODevice::ReadOnly);
+        span.setArg("bytes", file.size());
+        while (hashed && !file.atEnd()) {
+            QByteArray block = file.read(RehashBlockSize);
+            if (block.isEmpty()) {
+                hashed = false;
+                break;
+            }
+            entry->hash.addData(block);
+        }
+
+        QMetaObject::invokeMethod(owner, [this, owner, uploadId, entry, hashed, done]() {
+            bool ok = finishPrepare(uploadId, entry, hashed);
+            if (owner) {
+                done(ok);
+            }
+        }, Qt::QueuedConnection);
+    });
+}
+
+bool FileStore::finishPrepare(const QString &uploadId, Staging *entry, bool hashed)
+{
+    rehashing.remove(uploadId);
+    if (entry->discarded) {
+        delete entry;
+        return false;
+    }
+
+    entry->file.setFileName(stagingPath(uploadId));
+    if (!hashed || !entry->file.open(QIODevice::ReadWrite)) {
+        qWarning() << "Failed to reopen staged upload" << uploadId;
+        delete entry;
+        return false;
+    }
+
+    keepOpen(uploadId, entry);
+    return true;
+}
+
+bool FileStore::append(const QString &uploadId, const QByteArray &data)
+{
+    TraceSpan span("FileStore::append", "files");
+    span.setArg("bytes", data.size());
+
+    Staging *entry = staging(uploadId);
+    if (!entry) {
+        return false;
+    }
+
+    entry->file.seek(entry->file.size());
+    if (entry->file.write(data) != data.size()) {
+        qWarning() << "Failed to write upload chunk:" << entry->file.errorString();
+        return false;
+    }
+
+    entry->hash.addData(data);
+    return true;
+}
+
+QString FileStore::commit(const QString &uploadId, const QString &expectedSha256)
+{
+    TraceSpan span("FileStore::commit", "files");
+
+    Staging *entry = staging(uploadId);
+    if (!entry) {
+        return QString();
+    }
+
+    QString sha256 = QString::fromLatin1(entry->hash.result().toHex());
+    close(uploadId);
+
+    if (!expectedSha256.isEmpty() && expectedSha256 != sha256) {
+        qWarning() << "Upload" << uploadId << "does not match its announced hash, discarding it";
+        QFile::remove(stagingPath(uploadId));
+        return QString();
+    }
+
+    QString target = objectPath(sha256);
+    if (QFileInfo::exists(target)) {
+        // Same content is already stored, keep a single copy
+        QFile::remove(stagingPath(uploadId));
+        return sha256;
+    }
+
+    QDir().mkpath(QFileInfo(target).absolutePath());
+    if (!QFile::rename(stagingPath(uploadId), target)) {
+        // The upload row goes away with this, nothing could resume from the staged file
+        qWarning() << "Failed to move upload into the object store:" << target;
+        QFile::remove(stagingPath(uploadId));
+        return QString();
+    }
+
+    return sha256;
+}
+
+void FileStore::discard(const QString &uploadId)
+{
+    // A rehash still running owns its entry, its result is thrown away
+    if (Staging *pending = rehashing.value(uploadId)) {
+        pending->discarded = true;
+    }
+    close(uploadId);
+    QFile::remove(stagingPath(uploadId));
+}
+
+void FileStore::close(const QString &uploadId)
+{
+    delete openUploads.take(uploadId);
+}
+
+bool FileStore::read(const QString &path, qint64 offset, qint64 maxBytes, QByteArray &data) const
+{
+    TraceSpan span("FileStore::read", "files");
+
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly) || offset < 0 || offset > file.size()) {
+        return false;
+    }
+
+    // Only the requested range is ever loaded
+    file.seek(offset);
+    data = file.read(qMin(maxBytes, file.size() - offset));
+    span.setArg("bytes", data.size());
+    return true;
+}
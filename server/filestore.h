@@ -0,0 +1,77 @@
+#ifndef FILESTORE_H
+#define FILESTORE_H
+
+#include <QString>
+#include <QHash>
+#include <QFile>
+#include <QCryptographicHash>
+#include <QThreadPool>
+#include <QPointer>
+#include <functional>
+
+// Content-addressed attachment storage on disk. Uploads are staged as
+// <root>/uploads/<id>.part and appended to chunk by chunk while their
+// SHA-256 is computed on the fly; a finished upload is renamed to
+// <root>/objects/<ab>/<sha256>, so identical files are stored once.
+// Thumbnails are kept the same way under <root>/thumbs.
+class FileStore
+{
+public:
+    FileStore();
+    ~FileStore();
+
+    bool open(const QString &rootPath);
+    bool isOpen() const { return !rootPath.isEmpty(); }
+
+    // Staging, size is -1 if the upload has no staged data on disk
+    bool createStaging(const QString &uploadId);
+    qint64 stagedSize(const QString &uploadId) const;
+    bool append(const QString &uploadId, const QByteArray &data);
+
+    // Staged data that is not open yet has to be rehashed before it takes
+    // more chunks. prepare() does that on a worker thread and calls done
+    // on the context's thread once the upload is open again.
+    bool isReady(const QString &uploadId) const;
+    void prepare(const QString &uploadId, QObject *context, std::function<void(bool)> done);
+
+    // Moves a complete upload into the object store and returns its hash.
+    // Returns an empty string if it could not be stored or does not match
+    // the expected hash, a mismatching upload is discarded.
+    QString commit(const QString &uploadId, const QString &expectedSha256 = QString());
+    void discard(const QString &uploadId);
+
+    bool hasObject(const QString &sha256) const;
+    QString objectPath(const QString &sha256) const;
+
+    // Derived preview of an object, shared by every attachment with that content
+    QString thumbnailPath(const QString &sha256) const;
+
+    // Reads up to maxBytes of a stored file starting at offset
+    bool read(const QString &path, qint64 offset, qint64 maxBytes, QByteArray &data) const;
+
+    static QString newUploadId();
+    static bool isValidHash(const QString &sha256);
+
+private:
+    struct Staging {
+        QFile file;
+        QCryptographicHash hash { QCryptographicHash::Sha256 };
+        bool discarded = false;     // dropped while being rehashed
+    };
+
+    QString stagingPath(const QString &uploadId) const;
+    Staging *staging(const QString &uploadId);
+    void close(const QString &uploadId);
+    void keepOpen(const QString &uploadId, Staging *entry);
+    bool finishPrepare(const QString &uploadId, Staging *entry, bool hashed);
+
+    QString rootPath;
+    QHash<QString, Staging*> openUploads;
+    QHash<QString, Staging*> rehashing;     // being hashed on the pool, not usable yet
+    QThreadPool pool;
+
+    static constexpr int MaxOpenUploads = 256;          // file handles kept between chunks
+    static constexpr qint64 RehashBlockSize = 1024 * 1024;
+};
+
+#endif // FILESTORE_H
@@ -0,0 +1,152 @@
+#include "filestreamer.h"
+#include "tracer.h"
+
+#include <QDebug>
+
+#if defined(Q_OS_UNIX)
+#include <sys/socket.h>
+#include <errno.h>
+#endif
+#if defined(Q_OS_LINUX)
+#include <sys/sendfile.h>
+#endif
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+FileStreamer::FileStreamer(QTcpSocket *socket, const QString &path, qint64 offset, qint64 length,
+                           QObject *parent)
+    : QObject(parent)
+    , socket(socket)
+    , file(path)
+    , offset(offset)
+    , length(length)
+    , sent(0)
+    , mapped(nullptr)
+    , notifier(nullptr)
+    , done(false)
+{
+}
+
+FileStreamer::~FileStreamer()
+{
+    if (mapped) {
+        file.unmap(mapped);
+    }
+}
+
+void FileStreamer::start()
+{
+    // finished() is never emitted from inside start(), the caller may still be mid-request
+    if (!file.open(QIODevice::ReadOnly) || offset < 0 || offset + length > file.size()) {
+        qWarning() << "Cannot stream" << file.fileName() << ":" << file.errorString();
+        QMetaObject::invokeMethod(this, [this]() { finish(false); }, Qt::QueuedConnection);
+        return;
+    }
+
+    if (length == 0) {
+        QMetaObject::invokeMethod(this, [this]() { finish(true); }, Qt::QueuedConnection);
+        return;
+    }
+
+#if !defined(Q_OS_LINUX)
+    // Without sendfile the kernel reads straight from the page cache mapping
+    mapped = file.map(offset, length);
+    if (!mapped) {
+        qWarning() << "Cannot map" << file.fileName() << ":" << file.errorString();
+        QMetaObject::invokeMethod(this, [this]() { finish(false); }, Qt::QueuedConnection);
+        return;
+    }
+#endif
+
+    // Whatever Qt still buffers (the response header) has to go out first
+    connect(socket, &QTcpSocket::bytesWritten, this, &FileStreamer::onBytesWritten);
+    if (socket->bytesToWrite() == 0) {
+        QMetaObject::invokeMethod(this, &FileStreamer::onBytesWritten, Qt::QueuedConnection);
+    }
+}
+
+void FileStreamer::onBytesWritten()
+{
+    if (!done && socket->bytesToWrite() == 0) {
+        stream();
+    }
+}
+
+void FileStreamer::onWritable()
+{
+    notifier->setEnabled(false);
+    stream();
+}
+
+void FileStreamer::stream()
+{
+    TraceSpan span("FileStreamer::stream", "files");
+
+#if defined(Q_OS_UNIX)
+    int fd = int(socket->socketDescriptor());
+
+    while (sent < length) {
+        qint64 block = qMin(BlockSize, length - sent);
+
+#if defined(Q_OS_LINUX)
+        off_t position = off_t(offset + sent);
+        ssize_t written = ::sendfile(fd, file.handle(), &position, size_t(block));
+#else
+        ssize_t written = ::send(fd, mapped + sent, size_t(block), MSG_NOSIGNAL);
+#endif
+
+        if (written > 0) {
+            sent += written;
+            continue;
+        }
+        if (written < 0 && errno == EINTR) {
+            continue;
+        }
+        if (written < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            // Socket buffer full, wait for the kernel to drain it
+            if (!notifier) {
+                notifier = new QSocketNotifier(fd, QSocketNotifier::Write, this);
+                connect(notifier, &QSocketNotifier::activated, this, &FileStreamer::onWritable);
+            }
+            notifier->setEnabled(true);
+            span.setArg("bytes", sent);
+            return;
+        }
+
+        qWarning() << "Streaming" << file.fileName() << "failed:" << qt_error_string(errno);
+        finish(false);
+        return;
+    }
+#else
+    // Keep at most one block in Qt's buffer, bytesWritten brings us back
+    if (sent < length && socket->bytesToWrite() == 0) {
+        qint64 block = qMin(BlockSize, length - sent);
+        socket->write(reinterpret_cast<const char *>(mapped + sent), block);
+        sent += block;
+        return;
+    }
+    if (sent < length || socket->bytesToWrite() > 0) {
+        return;
+    }
+#endif
+
+    span.setArg("bytes", sent);
+    finish(true);
+}
+
+void FileStreamer::finish(bool ok)
+{
+    if (done) {
+        return;
+    }
+    done = true;
+
+    if (notifier) {
+        notifier->setEnabled(false);
+    }
+    disconnect(socket, nullptr, this, nullptr);
+
+    emit finished(ok);
+}
@@ -0,0 +1,49 @@
+#ifndef FILESTREAMER_H
+#define FILESTREAMER_H
+
+#include <QObject>
+#include <QFile>
+#include <QTcpSocket>
+#include <QSocketNotifier>
+
+// Streams a byte range of a file straight into a socket. On Linux the data
+// goes through sendfile(2) and never enters user space; other Unix systems
+// send from an mmap'd slice, and anything else writes mapped blocks through
+// the socket as it drains. The socket's own buffer must stay empty while
+// streaming, so the owner holds back every other write until finished().
+class FileStreamer : public QObject
+{
+    Q_OBJECT
+
+public:
+    FileStreamer(QTcpSocket *socket, const QString &path, qint64 offset, qint64 length,
+                 QObject *parent = nullptr);
+    ~FileStreamer();
+
+    void start();
+    qint64 bytesSent() const { return sent; }
+
+signals:
+    void finished(bool ok);
+
+private slots:
+    void onBytesWritten();
+    void onWritable();
+
+private:
+    void stream();
+    void finish(bool ok);
+
+    QTcpSocket *socket;
+    QFile file;
+    qint64 offset;
+    qint64 length;
+    qint64 sent;
+    uchar *mapped;
+    QSocketNotifier *notifier;
+    bool done;
+
+    static constexpr qint64 BlockSize = 1024 * 1024;    // per syscall or buffered write
+};
+
+#endif // FILESTREAMER_H
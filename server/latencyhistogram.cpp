@@ -0,0 +1,96 @@
+#include "latencyhistogram.h"
+
+#include <QtAlgorithms>
+#include <limits>
+
+LatencyHistogram::LatencyHistogram()
+    : buckets(BucketCount, 0)
+    , total(0)
+    , sumMicros(0)
+    , minMicros(std::numeric_limits<qint64>::max())
+    , maxMicros(0)
+{
+}
+
+void LatencyHistogram::record(qint64 micros)
+{
+    if (micros < 0) {
+        micros = 0;
+    }
+
+    ++buckets[bucketIndex(micros)];
+    ++total;
+    sumMicros += micros;
+    minMicros = qMin(minMicros, micros);
+    maxMicros = qMax(maxMicros, micros);
+}
+
+void LatencyHistogram::merge(const LatencyHistogram &other)
+{
+    for (int i = 0; i < BucketCount; ++i) {
+        buckets[i] += other.buckets[i];
+    }
+    total += other.total;
+    sumMicros += other.sumMicros;
+    minMicros = qMin(minMicros, other.minMicros);
+    maxMicros = qMax(maxMicros, other.maxMicros);
+}
+
+void LatencyHistogram::reset()
+{
+    buckets.fill(0);
+    total = 0;
+    sumMicros = 0;
+    minMicros = std::numeric_limits<qint64>::max();
+    maxMicros = 0;
+}
+
+qint64 LatencyHistogram::percentile(double percent) const
+{
+    if (total == 0) {
+        return 0;
+    }
+
+    // Rank of the sample we are looking for, 1-based
+    quint64 rank = quint64(qBound(0.0, percent, 100.0) / 100.0 * total + 0.5);
+    rank = qBound<quint64>(1, rank, total);
+
+    quint64 seen = 0;
+    for (int i = 0; i < BucketCount; ++i) {
+        seen += buckets[i];
+        if (seen >= rank) {
+            // Never report more than what was actually observed
+            return qMin(bucketUpperBound(i), maxMicros);
+        }
+    }
+
+    return maxMicros;
+}
+
+int LatencyHistogram::bucketIndex(qint64 micros)
+{
+    if (micros < SubBucketCount) {
+        return int(micros);
+    }
+
+    int magnitude = 63 - qCountLeadingZeroBits(quint64(micros));
+    if (magnitude > MaxMagnitude) {
+        return BucketCount - 1;
+    }
+
+    int shift = magnitude - SubBucketBits;
+    int subBucket = int((micros >> shift) & (SubBucketCount - 1));
+    return (shift + 1) * SubBucketCount + subBucket;
+}
+
+qint64 LatencyHistogram::bucketUpperBound(int index)
+{
+    if (index < SubBucketCount) {
+        return index;
+    }
+
+    int shift = index / SubBucketCount - 1;
+    int subBucket = index % SubBucketCount;
+    qint64 lower = qint64(SubBucketCount + subBucket) << shift;
+    return lower + (qint64(1) << shift) - 1;
+}
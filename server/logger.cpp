@@ -0,0 +1,291 @@
+#include "logger.h"
+
+#include <QDateTime>
+#include <QStringList>
+#include <cstdio>
+#include <cstring>
+#include <chrono>
+
+Q_LOGGING_CATEGORY(lcRequest, "messenger.request")
+
+// Bounded multi-producer single-consumer queue of fixed-size log lines
+// (Vyukov's sequence-numbered ring). Producers never take a lock.
+class LogRing
+{
+public:
+    static constexpr size_t Capacity = 4096;        // power of two
+    static constexpr int LineCapacity = 512;        // longer lines are truncated
+
+    LogRing()
+        : cells(new Cell[Capacity])
+        , enqueuePos(0)
+        , dequeuePos(0)
+    {
+        for (size_t i = 0; i < Capacity; ++i) {
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    bool tryPush(const char *data, int length)
+    {
+        size_t pos = enqueuePos.load(std::memory_order_relaxed);
+        Cell *cell;
+        while (true) {
+            cell = &cells[pos & (Capacity - 1)];
+            size_t sequence = cell->sequence.load(std::memory_order_acquire);
+            intptr_t diff = intptr_t(sequence) - intptr_t(pos);
+            if (diff == 0) {
+                if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false; // Full
+            } else {
+                pos = enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+
+        if (length > LineCapacity) {
+            // Keep the line terminated when cutting it short
+            memcpy(cell->data, data, LineCapacity - 1);
+            cell->data[LineCapacity - 1] = '\n';
+            cell->length = LineCapacity;
+        } else {
+            memcpy(cell->data, data, size_t(length));
+            cell->length = length;
+        }
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Single consumer only
+    bool tryPop(QByteArray &out)
+    {
+        size_t pos = dequeuePos.load(std::memory_order_relaxed);
+        Cell &cell = cells[pos & (Capacity - 1)];
+        size_t sequence = cell.sequence.load(std::memory_order_acquire);
+        if (intptr_t(sequence) - intptr_t(pos + 1) < 0) {
+            return false; // Empty
+        }
+
+        out.append(cell.data, cell.length);
+        cell.sequence.store(pos + Capacity, std::memory_order_release);
+        dequeuePos.store(pos + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+private:
+    struct Cell {
+        std::atomic<size_t> sequence;
+        int length;
+        char data[LineCapacity];
+    };
+
+    std::unique_ptr<Cell[]> cells;
+    alignas(64) std::atomic<size_t> enqueuePos;
+    alignas(64) std::atomic<size_t> dequeuePos;
+};
+
+namespace {
+
+const char *levelName(QtMsgType type)
+{
+    switch (type) {
+    case QtDebugMsg: return "DEBUG";
+    case QtInfoMsg: return "INFO ";
+    case QtWarningMsg: return "WARN ";
+    case QtCriticalMsg: return "ERROR";
+    case QtFatalMsg: return "FATAL";
+    }
+    return "?????";
+}
+
+qint64 monotonicMsecs()
+{
+    using namespace std::chrono;
+    return duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+} // namespace
+
+Logger &Logger::instance()
+{
+    static Logger logger;
+    return logger;
+}
+
+Logger::Logger()
+    : ring(new LogRing)
+    , sites(new SiteWindow[SiteSlots])
+    , running(false)
+    , dropped(0)
+    , suppressed(0)
+    , reportedDropped(0)
+    , maxPerSecond(50)
+    , sampleEvery(100)
+    , previousHandler(nullptr)
+{
+}
+
+Logger::~Logger()
+{
+    shutdown();
+}
+
+void Logger::install()
+{
+    if (running.exchange(true)) {
+        return;
+    }
+
+    flusher = std::thread(&Logger::drainLoop, this);
+    previousHandler = qInstallMessageHandler(&Logger::messageHandler);
+}
+
+void Logger::shutdown()
+{
+    if (!running.exchange(false)) {
+        return;
+    }
+
+    qInstallMessageHandler(previousHandler);
+    flusher.join();
+}
+
+bool Logger::setCategoryLevels(const QString &spec)
+{
+    static const QStringList levels = { "debug", "info", "warning", "critical" };
+
+    // Translated into Qt filter rules, so disabled levels are rejected
+    // by the category check before any formatting happens
+    QStringList rules;
+    for (const QString &entry : spec.split(',', Qt::SkipEmptyParts)) {
+        QStringList parts = entry.trimmed().split('=');
+        if (parts.size() != 2 || !levels.contains(parts[1].trimmed())) {
+            return false;
+        }
+
+        QString category = parts[0].trimmed();
+        if (category.isEmpty()) {
+            category = "*";
+        }
+
+        int minimum = levels.indexOf(parts[1].trimmed());
+        for (int i = 0; i < levels.size(); ++i) {
+            rules << QString("%1.%2=%3").arg(category, levels[i], i >= minimum ? "true" : "false");
+        }
+    }
+
+    QLoggingCategory::setFilterRules(rules.join('\n'));
+    return true;
+}
+
+void Logger::setRateLimit(int maxPerSecond, int sampleEvery)
+{
+    this->maxPerSecond = qMax(0, maxPerSecond);
+    this->sampleEvery = qMax(0, sampleEvery);
+}
+
+void Logger::messageHandler(QtMsgType type, const QMessageLogContext &context, const QString &message)
+{
+    instance().write(type, context, message);
+}
+
+bool Logger::admit(QtMsgType type, const QMessageLogContext &context, bool &sampled)
+{
+    sampled = false;
+
+    // Only chatty levels are sampled, problems always get through
+    if ((type != QtDebugMsg && type != QtInfoMsg) || maxPerSecond == 0) {
+        return true;
+    }
+
+    // Call sites are identified by file and line (QT_MESSAGELOGCONTEXT),
+    // falling back to the category; collisions only make sampling coarser
+    size_t key = context.file ? qHash(QByteArray::fromRawData(context.file, int(strlen(context.file)))) ^ size_t(context.line)
+                              : qHash(QByteArray(context.category));
+    SiteWindow &site = sites[key % SiteSlots];
+
+    qint64 now = monotonicMsecs();
+    qint64 start = site.windowStart.load(std::memory_order_relaxed);
+    if (now - start >= 1000 && site.windowStart.compare_exchange_strong(start, now, std::memory_order_relaxed)) {
+        site.count.store(0, std::memory_order_relaxed);
+    }
+
+    int seen = site.count.fetch_add(1, std::memory_order_relaxed) + 1;
+    if (seen <= maxPerSecond) {
+        return true;
+    }
+
+    if (sampleEvery > 0 && (seen - maxPerSecond) % sampleEvery == 0) {
+        sampled = true;
+        return true;
+    }
+
+    suppressed.fetch_add(1, std::memory_order_relaxed);
+    return false;
+}
+
+void Logger::write(QtMsgType type, const QMessageLogContext &context, const QString &message)
+{
+    bool sampled = false;
+    if (!admit(type, context, sampled)) {
+        return;
+    }
+
+    QByteArray line = QDateTime::currentDateTime().toString(Qt::ISODateWithMs).toLatin1();
+    line.append(' ').append(levelName(type)).append(' ');
+    if (context.category && strcmp(context.category, "default") != 0) {
+        line.append(context.category).append(": ");
+    }
+    line.append(message.toUtf8());
+    if (sampled) {
+        line.append(" [sampled 1/").append(QByteArray::number(sampleEvery)).append(']');
+    }
+    line.append('\n');
+
+    if (type == QtFatalMsg) {
+        // Qt aborts right after the handler returns, write synchronously
+        fwrite(line.constData(), 1, size_t(line.size()), stderr);
+        fflush(stderr);
+        return;
+    }
+
+    if (!ring->tryPush(line.constData(), line.size())) {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void Logger::drainLoop()
+{
+    while (running.load(std::memory_order_acquire)) {
+        drain();
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+
+    // Whatever was logged before shutdown still goes out
+    drain();
+}
+
+void Logger::drain()
+{
+    QByteArray batch;
+    while (ring->tryPop(batch)) {
+        if (batch.size() >= 64 * 1024) {
+            fwrite(batch.constData(), 1, size_t(batch.size()), stderr);
+            batch.clear();
+        }
+    }
+
+    quint64 droppedNow = dropped.load(std::memory_order_relaxed);
+    if (droppedNow != reportedDropped) {
+        batch.append("logger: dropped ").append(QByteArray::number(droppedNow - reportedDropped))
+             .append(" lines, ring buffer full\n");
+        reportedDropped = droppedNow;
+    }
+
+    if (!batch.isEmpty()) {
+        fwrite(batch.constData(), 1, size_t(batch.size()), stderr);
+        fflush(stderr);
+    }
+}
@@ -0,0 +1,65 @@
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <QString>
+#include <QLoggingCategory>
+#include <atomic>
+#include <memory>
+#include <thread>
+
+Q_DECLARE_LOGGING_CATEGORY(lcRequest)
+
+class LogRing;
+
+// Asynchronous logging backend installed with qInstallMessageHandler.
+// Callers format into a lock-free ring buffer and return immediately; a
+// background thread drains it to stderr. Lines that do not fit are dropped
+// and counted instead of blocking the event loop.
+class Logger
+{
+public:
+    static Logger &instance();
+
+    void install();
+    void shutdown();
+
+    // "category=level,..." with level one of debug, info, warning, critical
+    bool setCategoryLevels(const QString &spec);
+
+    // Per call site: the first maxPerSecond info/debug lines pass every
+    // second, after that only one in sampleEvery (0 = none) is kept
+    void setRateLimit(int maxPerSecond, int sampleEvery);
+
+    quint64 droppedCount() const { return dropped.load(std::memory_order_relaxed); }
+    quint64 suppressedCount() const { return suppressed.load(std::memory_order_relaxed); }
+
+private:
+    Logger();
+    ~Logger();
+
+    static void messageHandler(QtMsgType type, const QMessageLogContext &context, const QString &message);
+
+    bool admit(QtMsgType type, const QMessageLogContext &context, bool &sampled);
+    void write(QtMsgType type, const QMessageLogContext &context, const QString &message);
+    void drainLoop();
+    void drain();
+
+    struct SiteWindow {
+        std::atomic<qint64> windowStart{0};
+        std::atomic<int> count{0};
+    };
+    static constexpr int SiteSlots = 1024;
+
+    std::unique_ptr<LogRing> ring;
+    std::unique_ptr<SiteWindow[]> sites;
+    std::thread flusher;
+    std::atomic<bool> running;
+    std::atomic<quint64> dropped;
+    std::atomic<quint64> suppressed;
+    quint64 reportedDropped;
+    int maxPerSecond;
+    int sampleEvery;
+    QtMessageHandler previousHandler;
+};
+
+#endif // LOGGER_H
@@ -0,0 +1,189 @@
+#include "loopmonitor.h"
+
+#include <QTextStream>
+#include <QDebug>
+#include <chrono>
+
+namespace {
+
+const char *IdleActivity = "event loop";
+
+QString seconds(qint64 micros)
+{
+    return QString::number(micros / 1e6, 'g', 9);
+}
+
+// Activities can carry client supplied action names
+QString labelValue(QString value)
+{
+    return value.replace('\\', "\\\\").replace('"', "\\\"").replace('\n', "\\n");
+}
+
+} // namespace
+
+LoopMonitor::LoopMonitor(QObject *parent)
+    : QObject(parent)
+    , timer(new QTimer(this))
+    , lastTickNsecs(0)
+    , stallThresholdMsecs(0)
+    , heartbeatNsecs(0)
+    , running(false)
+    , activity(IdleActivity)
+{
+    // A coarse timer would add its own slack to every lag sample
+    timer->setTimerType(Qt::PreciseTimer);
+    timer->setInterval(TickInterval);
+    connect(timer, &QTimer::timeout, this, &LoopMonitor::onTick);
+}
+
+LoopMonitor::~LoopMonitor()
+{
+    stop();
+}
+
+qint64 LoopMonitor::nowNsecs()
+{
+    using namespace std::chrono;
+    return duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+void LoopMonitor::start(int stallThresholdMsecs)
+{
+    stop();
+
+    this->stallThresholdMsecs = qMax(0, stallThresholdMsecs);
+    lastTickNsecs = nowNsecs();
+    heartbeatNsecs.store(lastTickNsecs, std::memory_order_relaxed);
+    timer->start();
+
+    if (this->stallThresholdMsecs > 0) {
+        running.store(true);
+        watchdog = std::thread(&LoopMonitor::watchdogLoop, this);
+    }
+}
+
+void LoopMonitor::stop()
+{
+    timer->stop();
+
+    if (running.exchange(false)) {
+        wakeup.notify_all();
+        watchdog.join();
+    }
+}
+
+void LoopMonitor::setActivity(const QString &name)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    previousActivity = activity;
+    activity = name;
+}
+
+void LoopMonitor::clearActivity()
+{
+    setActivity(IdleActivity);
+}
+
+void LoopMonitor::onTick()
+{
+    qint64 now = nowNsecs();
+    qint64 lagNsecs = qMax<qint64>(0, now - lastTickNsecs - qint64(TickInterval) * 1000000);
+    lastTickNsecs = now;
+    heartbeatNsecs.store(now, std::memory_order_relaxed);
+
+    lag.record(lagNsecs / 1000);
+
+    if (stallThresholdMsecs == 0 || lagNsecs < qint64(stallThresholdMsecs) * 1000000) {
+        return;
+    }
+
+    // The loop is back; attribute the stall to what the watchdog saw, or,
+    // if it was too short for the watchdog to notice, to the last activity
+    QString culprit;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!stalledIn.isEmpty()) {
+            culprit = stalledIn;
+        } else {
+            culprit = activity == IdleActivity ? previousActivity : activity;
+        }
+        stalledIn.clear();
+    }
+
+    if (!stalls.contains(culprit) && stalls.size() >= MaxActivities) {
+        culprit = "other";
+    }
+    StallStats &stats = stalls[culprit];
+    ++stats.count;
+    stats.totalMicros += lagNsecs / 1000;
+
+    qWarning().noquote() << QString("Event loop stalled for %1 ms in %2").arg(lagNsecs / 1000000).arg(culprit);
+}
+
+void LoopMonitor::watchdogLoop()
+{
+    qint64 threshold = qint64(stallThresholdMsecs) * 1000000;
+    qint64 reportedBeat = -1;
+
+    std::unique_lock<std::mutex> lock(mutex);
+    while (running.load()) {
+        // Poll a few times per threshold so stalls are caught while they last
+        wakeup.wait_for(lock, std::chrono::milliseconds(qMax(5, stallThresholdMsecs / 4)));
+        if (!running.load()) {
+            break;
+        }
+
+        qint64 beat = heartbeatNsecs.load(std::memory_order_relaxed);
+        if (beat == reportedBeat || nowNsecs() - beat < threshold) {
+            continue;
+        }
+
+        // Only the first detection of a stall captures the activity; logging
+        // goes through the asynchronous logger, so it is safe from here
+        reportedBeat = beat;
+        stalledIn = activity;
+        QString culprit = stalledIn;
+
+        lock.unlock();
+        qWarning().noquote() << QString("Event loop blocked for over %1 ms, running %2")
+                                .arg(stallThresholdMsecs).arg(culprit);
+        lock.lock();
+    }
+}
+
+QByteArray LoopMonitor::exposition() const
+{
+    static const double quantiles[] = { 0.5, 0.9, 0.99, 0.999 };
+
+    QByteArray output;
+    QTextStream out(&output);
+
+    out << "# HELP qtmessenger_event_loop_lag_seconds How late the event loop ran a " << TickInterval << " ms timer.\n";
+    out << "# TYPE qtmessenger_event_loop_lag_seconds summary\n";
+    for (double quantile : quantiles) {
+        out << "qtmessenger_event_loop_lag_seconds{quantile=\"" << quantile << "\"} "
+            << seconds(lag.percentile(quantile * 100)) << "\n";
+    }
+    out << "qtmessenger_event_loop_lag_seconds_sum " << seconds(lag.sum()) << "\n";
+    out << "qtmessenger_event_loop_lag_seconds_count " << lag.count() << "\n";
+
+    out << "# HELP qtmessenger_event_loop_lag_max_seconds Longest event loop lag seen.\n";
+    out << "# TYPE qtmessenger_event_loop_lag_max_seconds gauge\n";
+    out << "qtmessenger_event_loop_lag_max_seconds " << seconds(lag.max()) << "\n";
+
+    out << "# HELP qtmessenger_event_loop_stalls_total Event loop stalls over the threshold, by running activity.\n";
+    out << "# TYPE qtmessenger_event_loop_stalls_total counter\n";
+    for (auto it = stalls.constBegin(); it != stalls.constEnd(); ++it) {
+        out << "qtmessenger_event_loop_stalls_total{activity=\"" << labelValue(it.key()) << "\"} " << it->count << "\n";
+    }
+
+    out << "# HELP qtmessenger_event_loop_stall_seconds_total Time spent stalled, by running activity.\n";
+    out << "# TYPE qtmessenger_event_loop_stall_seconds_total counter\n";
+    for (auto it = stalls.constBegin(); it != stalls.constEnd(); ++it) {
+        out << "qtmessenger_event_loop_stall_seconds_total{activity=\"" << labelValue(it.key()) << "\"} "
+            << seconds(it->totalMicros) << "\n";
+    }
+
+    out.flush();
+    return output;
+}
@@ -0,0 +1,69 @@
+#ifndef LOOPMONITOR_H
+#define LOOPMONITOR_H
+
+#include <QObject>
+#include <QTimer>
+#include <QMap>
+#include <QString>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "latencyhistogram.h"
+
+// Measures how late the event loop runs a high-frequency timer (lag) and
+// watches it from a second thread. When the loop stops ticking for longer
+// than the stall threshold, the watchdog logs what the loop was busy with
+// while the stall is still going on.
+class LoopMonitor : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit LoopMonitor(QObject *parent = nullptr);
+    ~LoopMonitor();
+
+    // 0 disables stall detection, lag is always measured
+    void start(int stallThresholdMsecs);
+    void stop();
+
+    // Label for whatever the loop runs next, reported if it stalls
+    void setActivity(const QString &name);
+    void clearActivity();
+
+    // Prometheus text: lag summary and stall counters per activity
+    QByteArray exposition() const;
+
+private slots:
+    void onTick();
+
+private:
+    struct StallStats {
+        quint64 count = 0;
+        qint64 totalMicros = 0;
+    };
+
+    void watchdogLoop();
+    static qint64 nowNsecs();
+
+    QTimer *timer;
+    LatencyHistogram lag;
+    qint64 lastTickNsecs;
+    QMap<QString, StallStats> stalls;
+
+    int stallThresholdMsecs;
+    std::atomic<qint64> heartbeatNsecs;
+    std::atomic<bool> running;
+    std::thread watchdog;
+    std::mutex mutex;                   // guards activity, stalledIn and wakeups
+    std::condition_variable wakeup;
+    QString activity;
+    QString previousActivity;
+    QString stalledIn;                  // set by the watchdog during a stall
+
+    static constexpr int TickInterval = 10;         // ms
+    static constexpr int MaxActivities = 64;        // bounds the label set
+};
+
+#endif // LOOPMONITOR_H
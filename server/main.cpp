@@ -1,13 +1,29 @@
 #include "server.h"
 #include "database.h"
+#include "metricsserver.h"
+#include "tracer.h"
+#include "logger.h"
 
 #include <QCoreApplication>
 #include <QCommandLineParser>
+#include <QStandardPaths>
+
+#if defined(Q_OS_UNIX)
+#include <signal.h>
+#endif
 
 int main(int argc, char *argv[])
 {
     QCoreApplication app(argc, argv);
     
+    // Route all qDebug/qInfo/... output through the asynchronous backend
+    Logger::instance().install();
+    
+#if defined(Q_OS_UNIX)
+    // Raw downloads write to sockets directly, a peer hanging up must not kill us
+    signal(SIGPIPE, SIG_IGN);
+#endif
+    
     app.setApplicationName("QtMessengerServer");
     app.setApplicationVersion("1.0.0");
     
@@ -21,10 +37,75 @@ int main(int argc, char *argv[])
                                  "port", "8080");
     parser.addOption(portOption);
     
+    QCommandLineOption connectRateOption(QStringList() << "max-connect-rate",
+                                        "Accept at most this many new connections per second, "
+                                        "asking the rest to retry later (default: 200, 0 = unlimited).",
+                                        "rate", "200");
+    parser.addOption(connectRateOption);
+    
+    QCommandLineOption metricsPortOption(QStringList() << "metrics-port",
+                                        "Serve Prometheus metrics on 127.0.0.1:<port>/metrics (default: 0 = disabled).",
+                                        "port", "0");
+    parser.addOption(metricsPortOption);
+    
+    QCommandLineOption traceFileOption(QStringList() << "trace-file",
+                                      "Write sampled request traces (Chrome trace-event JSON) to <file>.",
+                                      "file");
+    parser.addOption(traceFileOption);
+    
+    QCommandLineOption traceSampleOption(QStringList() << "trace-sample",
+                                        "Trace one in every <n> requests (default: 100).",
+                                        "n", "100");
+    parser.addOption(traceSampleOption);
+    
+    QCommandLineOption stallOption(QStringList() << "stall-threshold",
+                                  "Log event loop stalls longer than <ms> with the action that caused them (default: 100, 0 = off).",
+                                  "ms", "100");
+    parser.addOption(stallOption);
+    
+    QCommandLineOption recordOption(QStringList() << "record",
+                                   "Capture every inbound frame to <file> for QtMessengerReplay.",
+                                   "file");
+    parser.addOption(recordOption);
+    
+    QCommandLineOption logLevelOption(QStringList() << "log-level",
+                                     "Minimum level per logging category, e.g. \"messenger.request=warning,default=info\".",
+                                     "rules");
+    parser.addOption(logLevelOption);
+    
+    QCommandLineOption logRateOption(QStringList() << "log-rate",
+                                    "Info/debug lines per second allowed from one call site before sampling (default: 50, 0 = unlimited).",
+                                    "n", "50");
+    parser.addOption(logRateOption);
+    
+    QCommandLineOption logSampleOption(QStringList() << "log-sample",
+                                      "Over the rate limit, keep one in every <n> lines (default: 100, 0 = drop all).",
+                                      "n", "100");
+    parser.addOption(logSampleOption);
+    
+    QCommandLineOption filesDirOption(QStringList() << "files-dir",
+                                     "Store attachments under <dir> (default: files/ in the app data directory).",
+                                     "dir");
+    parser.addOption(filesDirOption);
+    
     parser.process(app);
     
+    Logger::instance().setRateLimit(parser.value(logRateOption).toInt(), parser.value(logSampleOption).toInt());
+    if (parser.isSet(logLevelOption) && !Logger::instance().setCategoryLevels(parser.value(logLevelOption))) {
+        qCritical() << "Invalid --log-level rules:" << parser.value(logLevelOption);
+        return 1;
+    }
+    
     quint16 port = parser.value(portOption).toUShort();
     
+    // Tracing is opt-in, open the file before any request can arrive
+    if (parser.isSet(traceFileOption)) {
+        QString traceFile = parser.value(traceFileOption);
+        if (Tracer::instance().open(traceFile, parser.value(traceSampleOption).toInt())) {
+            qInfo() << "Tracing 1 in" << parser.value(traceSampleOption) << "requests to" << traceFile;
+        }
+    }
+    
     // Initialize database
     Database db;
     if (!db.initialize()) {
@@ -34,12 +115,41 @@ int main(int argc, char *argv[])
     
     // Create and start server
     Server server(port, &db);
+    server.setMaxConnectRate(parser.value(connectRateOption).toInt());
+    server.setStallThreshold(parser.value(stallOption).toInt());
     if (!server.start()) {
         qCritical() << "Failed to start server!";
         return 1;
     }
     
+    QString filesDir = parser.isSet(filesDirOption)
+        ? parser.value(filesDirOption)
+        : QStandardPaths::writableLocation(QStandardPaths::AppDataLocation) + "/files";
+    if (!server.openFileStore(filesDir)) {
+        qCritical() << "Failed to open attachment store in" << filesDir;
+        return 1;
+    }
+    
     qInfo() << "Server is running on port" << port;
     
-    return app.exec();
+    if (parser.isSet(recordOption) && server.startRecording(parser.value(recordOption))) {
+        qInfo() << "Recording traffic to" << parser.value(recordOption);
+    }
+    
+    // Optional scrape endpoint, local only
+    quint16 metricsPort = parser.value(metricsPortOption).toUShort();
+    MetricsServer metricsServer([&server]() { return server.metricsText(); });
+    if (metricsPort != 0 && metricsServer.listen(metricsPort)) {
+        qInfo() << "Metrics available at http://127.0.0.1:" << metricsPort << "/metrics";
+    }
+    
+    int result = app.exec();
+    
+    // Terminate the trace file so viewers can load it
+    Tracer::instance().close();
+    
+    // Flush buffered log lines before exiting
+    Logger::instance().shutdown();
+    
+    return result;
 }
\ No newline at end of file
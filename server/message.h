@@ -7,7 +7,7 @@
 class Message
 {
 public:
-    Message() : id(-1), senderId(-1), receiverId(-1), read(false) {}
+    Message() : id(-1), senderId(-1), receiverId(-1), read(false), delivered(false), attachmentId(-1) {}
     
     int id;
     int senderId;
@@ -15,7 +15,10 @@ public:
     QString content;
     QString type;
     bool read;
+    bool delivered;
     QDateTime timestamp;
+    QString clientMessageId;    // sender chosen, empty if none
+    int attachmentId;           // -1 for plain messages
 };
 
 #endif // MESSAGE_H
\ No newline at end of file
@@ -0,0 +1,99 @@
+#include "metrics.h"
+
+#include <QTextStream>
+
+namespace {
+
+const char *phaseName(int phase)
+{
+    switch (phase) {
+    case Metrics::Parse: return "parse";
+    case Metrics::Db: return "db";
+    case Metrics::Write: return "write";
+    default: return "total";
+    }
+}
+
+QString seconds(qint64 micros)
+{
+    return QString::number(micros / 1e6, 'g', 9);
+}
+
+} // namespace
+
+Metrics::Metrics()
+    : bytesIn(0)
+    , bytesOut(0)
+{
+}
+
+void Metrics::recordRequest(const QString &action, qint64 parseMicros, qint64 dbMicros, qint64 writeMicros)
+{
+    ActionStats &stats = actions[action];
+    stats.phases[Parse].record(parseMicros);
+    stats.phases[Db].record(dbMicros);
+    stats.phases[Write].record(writeMicros);
+    stats.phases[Total].record(parseMicros + dbMicros + writeMicros);
+}
+
+void Metrics::setGauge(const QString &name, const QString &help, double value)
+{
+    Gauge &gauge = gauges[name];
+    gauge.help = help;
+    gauge.value = value;
+}
+
+void Metrics::setCounter(const QString &name, const QString &help, quint64 value)
+{
+    counters[name] = qMakePair(help, value);
+}
+
+QByteArray Metrics::exposition() const
+{
+    static const double quantiles[] = { 0.5, 0.9, 0.99, 0.999 };
+
+    QByteArray output;
+    QTextStream out(&output);
+
+    // Latency summaries, one series per action and phase
+    out << "# HELP qtmessenger_request_duration_seconds Request latency by action and phase.\n";
+    out << "# TYPE qtmessenger_request_duration_seconds summary\n";
+    for (auto it = actions.constBegin(); it != actions.constEnd(); ++it) {
+        for (int phase = 0; phase < PhaseCount; ++phase) {
+            const LatencyHistogram &histogram = it->phases[phase];
+            QString labels = QString("action=\"%1\",phase=\"%2\"").arg(it.key(), phaseName(phase));
+
+            for (double quantile : quantiles) {
+                out << "qtmessenger_request_duration_seconds{" << labels
+                    << ",quantile=\"" << quantile << "\"} "
+                    << seconds(histogram.percentile(quantile * 100)) << "\n";
+            }
+            out << "qtmessenger_request_duration_seconds_sum{" << labels << "} "
+                << seconds(histogram.sum()) << "\n";
+            out << "qtmessenger_request_duration_seconds_count{" << labels << "} "
+                << histogram.count() << "\n";
+        }
+    }
+
+    out << "# HELP qtmessenger_received_bytes_total Bytes read from client sockets.\n";
+    out << "# TYPE qtmessenger_received_bytes_total counter\n";
+    out << "qtmessenger_received_bytes_total " << bytesIn << "\n";
+    out << "# HELP qtmessenger_sent_bytes_total Bytes written to client sockets.\n";
+    out << "# TYPE qtmessenger_sent_bytes_total counter\n";
+    out << "qtmessenger_sent_bytes_total " << bytesOut << "\n";
+
+    for (auto it = counters.constBegin(); it != counters.constEnd(); ++it) {
+        out << "# HELP " << it.key() << " " << it->first << "\n";
+        out << "# TYPE " << it.key() << " counter\n";
+        out << it.key() << " " << it->second << "\n";
+    }
+
+    for (auto it = gauges.constBegin(); it != gauges.constEnd(); ++it) {
+        out << "# HELP " << it.key() << " " << it->help << "\n";
+        out << "# TYPE " << it.key() << " gauge\n";
+        out << it.key() << " " << QString::number(it->value, 'g', 12) << "\n";
+    }
+
+    out.flush();
+    return output;
+}
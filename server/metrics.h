@@ -0,0 +1,52 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <QMap>
+#include <QString>
+#include <QByteArray>
+#include <QPair>
+
+#include "latencyhistogram.h"
+
+// Server-wide counters, gauges and per-action latency histograms,
+// rendered in the Prometheus text exposition format.
+class Metrics
+{
+public:
+    enum Phase {
+        Parse,      // QJsonDocument::fromJson of the request line
+        Db,         // handler body, dominated by the Database calls
+        Write,      // response serialization and socket write
+        Total,
+        PhaseCount
+    };
+
+    Metrics();
+
+    void recordRequest(const QString &action, qint64 parseMicros, qint64 dbMicros, qint64 writeMicros);
+    void addBytesIn(qint64 bytes) { bytesIn += bytes; }
+    void addBytesOut(qint64 bytes) { bytesOut += bytes; }
+    void setGauge(const QString &name, const QString &help, double value);
+    // For totals kept elsewhere that only ever go up, name them *_total
+    void setCounter(const QString &name, const QString &help, quint64 value);
+
+    QByteArray exposition() const;
+
+private:
+    struct ActionStats {
+        LatencyHistogram phases[PhaseCount];
+    };
+
+    struct Gauge {
+        QString help;
+        double value;
+    };
+
+    QMap<QString, ActionStats> actions;   // ordered for stable output
+    QMap<QString, Gauge> gauges;
+    QMap<QString, QPair<QString, quint64>> counters;     // name -> help, value
+    quint64 bytesIn;
+    quint64 bytesOut;
+};
+
+#endif // METRICS_H
@@ -0,0 +1,76 @@
+#include "metricsserver.h"
+
+#include <QHostAddress>
+#include <QDebug>
+
+MetricsServer::MetricsServer(std::function<QByteArray()> provider, QObject *parent)
+    : QObject(parent)
+    , server(new QTcpServer(this))
+    , provider(std::move(provider))
+{
+    connect(server, &QTcpServer::newConnection, this, &MetricsServer::onNewConnection);
+}
+
+bool MetricsServer::listen(quint16 port)
+{
+    // Local only, metrics are not meant to be reachable from clients
+    if (!server->listen(QHostAddress::LocalHost, port)) {
+        qWarning() << "Metrics listener failed to start:" << server->errorString();
+        return false;
+    }
+    return true;
+}
+
+void MetricsServer::onNewConnection()
+{
+    while (QTcpSocket *client = server->nextPendingConnection()) {
+        connect(client, &QTcpSocket::readyRead, this, &MetricsServer::onReadyRead);
+        connect(client, &QTcpSocket::disconnected, client, &QObject::deleteLater);
+    }
+}
+
+void MetricsServer::onReadyRead()
+{
+    QTcpSocket *client = qobject_cast<QTcpSocket*>(sender());
+    if (!client) return;
+
+    // Wait for the end of the request headers
+    QByteArray request = client->peek(MaxRequestSize);
+    int headerEnd = request.indexOf("\r\n\r\n");
+    if (headerEnd < 0) {
+        headerEnd = request.indexOf("\n\n");
+    }
+    if (headerEnd < 0) {
+        if (client->bytesAvailable() >= MaxRequestSize) {
+            reply(client, "400 Bad Request", "Request too large\n");
+        }
+        return;
+    }
+    client->readAll();
+
+    QList<QByteArray> requestLine = request.left(request.indexOf('\n')).trimmed().split(' ');
+    if (requestLine.size() < 2 || requestLine[0] != "GET") {
+        reply(client, "405 Method Not Allowed", "Only GET is supported\n");
+        return;
+    }
+
+    QByteArray path = requestLine[1];
+    if (path == "/metrics" || path == "/") {
+        reply(client, "200 OK", provider());
+    } else {
+        reply(client, "404 Not Found", "Try /metrics\n");
+    }
+}
+
+void MetricsServer::reply(QTcpSocket *client, const QByteArray &status, const QByteArray &body)
+{
+    QByteArray response = "HTTP/1.1 " + status + "\r\n"
+                          "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+                          "Content-Length: " + QByteArray::number(body.size()) + "\r\n"
+                          "Connection: close\r\n"
+                          "\r\n";
+    response.append(body);
+
+    client->write(response);
+    client->disconnectFromHost();
+}
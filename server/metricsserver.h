@@ -0,0 +1,35 @@
+#ifndef METRICSSERVER_H
+#define METRICSSERVER_H
+
+#include <QObject>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <functional>
+
+// Minimal HTTP listener on localhost that serves the metrics text
+// for Prometheus to scrape (GET /metrics).
+class MetricsServer : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit MetricsServer(std::function<QByteArray()> provider, QObject *parent = nullptr);
+
+    bool listen(quint16 port);
+    quint16 port() const { return server->serverPort(); }
+
+private slots:
+    void onNewConnection();
+    void onReadyRead();
+
+private:
+    void reply(QTcpSocket *client, const QByteArray &status, const QByteArray &body);
+
+    QTcpServer *server;
+    std::function<QByteArray()> provider;
+
+    // Scrape requests are tiny, anything bigger is not a scraper
+    static const int MaxRequestSize = 8192;
+};
+
+#endif // METRICSSERVER_H
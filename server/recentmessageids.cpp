@@ -0,0 +1,41 @@
+#include "recentmessageids.h"
+
+RecentMessageIds::RecentMessageIds(int capacity)
+    : capacity(qMax(1, capacity))
+{
+}
+
+QString RecentMessageIds::key(int senderId, const QString &clientMessageId)
+{
+    // Ids are only unique per sender
+    return QString::number(senderId) + ':' + clientMessageId;
+}
+
+int RecentMessageIds::find(int senderId, const QString &clientMessageId) const
+{
+    return ids.value(key(senderId, clientMessageId), -1);
+}
+
+void RecentMessageIds::insert(int senderId, const QString &clientMessageId, int messageId)
+{
+    QString entry = key(senderId, clientMessageId);
+    if (ids.contains(entry)) {
+        return;
+    }
+
+    while (order.size() >= capacity) {
+        ids.remove(order.dequeue());
+    }
+
+    ids.insert(entry, messageId);
+    order.enqueue(entry);
+}
+
+void RecentMessageIds::remove(int senderId, const QString &clientMessageId)
+{
+    // Only used when a write is rolled back, so the linear scan is fine
+    QString entry = key(senderId, clientMessageId);
+    if (ids.remove(entry) > 0) {
+        order.removeOne(entry);
+    }
+}
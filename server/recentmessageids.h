@@ -0,0 +1,31 @@
+#ifndef RECENTMESSAGEIDS_H
+#define RECENTMESSAGEIDS_H
+
+#include <QHash>
+#include <QQueue>
+#include <QString>
+
+// Bounded table of recently stored client message ids, so a retried
+// sendMessage is answered without touching the database. The oldest
+// entries are evicted first; the unique index catches anything older.
+class RecentMessageIds
+{
+public:
+    explicit RecentMessageIds(int capacity = 65536);
+
+    // Stored message id, or -1 if the pair has not been seen recently
+    int find(int senderId, const QString &clientMessageId) const;
+    void insert(int senderId, const QString &clientMessageId, int messageId);
+    void remove(int senderId, const QString &clientMessageId);
+
+    int size() const { return ids.size(); }
+
+private:
+    static QString key(int senderId, const QString &clientMessageId);
+
+    QHash<QString, int> ids;
+    QQueue<QString> order;      // insertion order, for eviction
+    int capacity;
+};
+
+#endif // RECENTMESSAGEIDS_H
@@ -1,15 +1,31 @@
 #include "server.h"
 #include "user.h"
 #include "message.h"
+#include "tracer.h"
+#include "logger.h"
 
 #include <QHostAddress>
 #include <QJsonArray>
 #include <QDateTime>
+#include <QRandomGenerator>
+#include <QFileInfo>
+
+// Session changing actions push frames of their own and stay out of batches
+const QSet<QString> Server::BatchableActions = { "getContacts", "getChatHistory", "sendMessage", "addContact",
+                                                 "searchMessages", "searchUsers", "matchContacts", "addContacts" };
 
 Server::Server(quint16 port, Database *database, QObject *parent)
     : QObject(parent)
     , server(new QTcpServer(this))
     , database(database)
+    , nextConnectionId(1)
+    , duplicateMessages(0)
+    , batchClient(nullptr)
+    , batchResponses(nullptr)
+    , maxConnectRate(0)
+    , connectTokens(0)
+    , rejectedInWindow(0)
+    , responseWriteMicros(0)
 {
     // Configure server
     server->setMaxPendingConnections(100); // Limit concurrent connections
@@ -21,6 +37,13 @@ Server::Server(quint16 port, Database *database, QObject *parent)
 
     // Connect signals
     connect(server, &QTcpServer::newConnection, this, &Server::onNewConnection);
+    connect(&thumbnailer, &Thumbnailer::thumbnailReady, this, &Server::onThumbnailReady);
+
+    QElapsedTimer directoryTimer;
+    directoryTimer.start();
+    userDirectory.build(database->getDirectoryUsers());
+    qInfo() << "User directory loaded:" << userDirectory.size() << "users in"
+            << directoryTimer.elapsed() << "ms";
 }
 
 Server::~Server()
@@ -42,27 +65,105 @@ void Server::stop()
     if (!server->isListening())
         return;
 
-    for (QTcpSocket *client : socketUsers.keys()) {
+    for (QTcpSocket *client : clients) {
         if (client->state() == QAbstractSocket::ConnectedState)
             client->disconnectFromHost();
         client->deleteLater();
     }
 
+    clients.clear();
+    connectionIds.clear();
+    offlineDeliveries.clear();
+    qDeleteAll(rawTransfers);
+    rawTransfers.clear();
+    heldOutput.clear();
+    waitingChunks.clear();
     socketUsers.clear();
     userConnections.clear();
 
     server->close();
 }
 
+void Server::setStallThreshold(int msecs)
+{
+    loopMonitor.start(msecs);
+}
+
+bool Server::startRecording(const QString &path)
+{
+    return recorder.open(path);
+}
+
+bool Server::openFileStore(const QString &path)
+{
+    return files.open(path);
+}
+
+void Server::setMaxConnectRate(int connectionsPerSecond)
+{
+    maxConnectRate = qMax(0, connectionsPerSecond);
+    connectTokens = maxConnectRate;
+    rejectedInWindow = 0;
+    connectClock.start();
+}
+
+bool Server::admitConnection(qint64 &retryAfter)
+{
+    if (maxConnectRate <= 0) {
+        return true;
+    }
+
+    // Refill the bucket, allowing at most one second worth of burst
+    qint64 elapsed = connectClock.restart();
+    connectTokens = qMin<double>(maxConnectRate, connectTokens + elapsed * maxConnectRate / 1000.0);
+
+    if (connectTokens >= 1.0) {
+        connectTokens -= 1.0;
+        if (connectTokens >= maxConnectRate - 1) {
+            rejectedInWindow = 0; // Storm is over
+        }
+        return true;
+    }
+
+    // Spread rejected clients over a window that grows with the backlog,
+    // so they come back at roughly the rate we can accept them
+    ++rejectedInWindow;
+    qint64 window = 1000 + qint64(rejectedInWindow) * 1000 / maxConnectRate;
+    retryAfter = 1000 + QRandomGenerator::global()->bounded(int(qMin<qint64>(window, 300000)));
+    return false;
+}
+
 void Server::onNewConnection()
 {
     QTcpSocket *client = server->nextPendingConnection();
 
+    qint64 retryAfter = 0;
+    if (!admitConnection(retryAfter)) {
+        // Tell the client when to come back instead of letting it hammer us
+        QJsonObject busyResponse;
+        busyResponse["action"] = "busy";
+        busyResponse["status"] = "error";
+        busyResponse["message"] = "Server busy, please retry later";
+        busyResponse["retryAfter"] = retryAfter;
+        sendResponse(client, busyResponse);
+
+        connect(client, &QTcpSocket::disconnected, client, &QObject::deleteLater);
+        client->disconnectFromHost();
+        return;
+    }
+
+    clients.insert(client);
+
+    quint32 connectionId = nextConnectionId++;
+    connectionIds.insert(client, connectionId);
+    recorder.recordOpen(connectionId);
+
     // Connect socket signals
     connect(client, &QTcpSocket::readyRead, this, &Server::onReadyRead);
     connect(client, &QTcpSocket::disconnected, this, &Server::onClientDisconnected);
+    connect(client, &QTcpSocket::bytesWritten, this, &Server::onBytesWritten);
 
-    qInfo() << "New client connected:" << client->peerAddress().toString();
+    qCInfo(lcRequest) << "New client connected:" << client->peerAddress().toString();
 }
 
 void Server::onClientDisconnected()
@@ -72,13 +173,21 @@ void Server::onClientDisconnected()
         return;
     }
 
+    clients.remove(client);
+    recorder.recordClose(connectionIds.take(client));
+
+    if (FileStreamer *streamer = rawTransfers.take(client)) {
+        streamer->disconnect(this);
+        streamer->deleteLater();
+    }
+    heldOutput.remove(client);
+
     // Remove from user maps
     if (socketUsers.contains(client)) {
         int userId = socketUsers[client];
-        userConnections.remove(userId);
-        socketUsers.remove(client);
+        unbindSocket(client);
 
-        qInfo() << "Client disconnected, user ID:" << userId;
+        qCInfo(lcRequest) << "Client disconnected, user ID:" << userId;
     }
 
     client->deleteLater();
@@ -89,15 +198,41 @@ void Server::onReadyRead()
     QTcpSocket *client = qobject_cast<QTcpSocket*>(sender());
     if (!client) return;
 
-    while (client->canReadLine()) {
-        QByteArray line = client->readLine().trimmed();
+    processLines(client);
+}
+
+void Server::processLines(QTcpSocket *client)
+{
+    // A raw download in progress owns the socket, the rest waits for it
+    while (client->canReadLine() && !rawTransfers.contains(client)) {
+        QByteArray line = client->readLine();
+        metrics.addBytesIn(line.size());
+
+        line = line.trimmed();
         if (line.isEmpty()) continue;
 
+        if (recorder.isRecording()) {
+            recorder.recordFrame(connectionIds.value(client), line);
+        }
+
+        // Sampling is decided per frame, every span below belongs to it
+        TraceRequest traceRequest;
+
+        QElapsedTimer parseTimer;
+        parseTimer.start();
+
         QJsonParseError parseError;
-        QJsonDocument doc = QJsonDocument::fromJson(line, &parseError);
+        QJsonDocument doc;
+        {
+            TraceSpan span("parse", "server");
+            span.setArg("bytes", line.size());
+            doc = QJsonDocument::fromJson(line, &parseError);
+        }
+
+        qint64 parseMicros = parseTimer.nsecsElapsed() / 1000;
 
         if (parseError.error == QJsonParseError::NoError && doc.isObject()) {
-            handleRequest(client, doc.object());
+            handleRequest(client, doc.object(), parseMicros);
         } else {
             QJsonObject errorResponse;
             errorResponse["status"] = "error";
@@ -107,15 +242,62 @@ void Server::onReadyRead()
     }
 }
 
-void Server::handleRequest(QTcpSocket *client, const QJsonObject &request)
+void Server::onBytesWritten()
+{
+    QTcpSocket *client = qobject_cast<QTcpSocket*>(sender());
+    if (!client || !offlineDeliveries.contains(client)) {
+        return;
+    }
+
+    loopMonitor.setActivity("offlineMessages");
+    pumpOfflineDelivery(client);
+    loopMonitor.clearActivity();
+}
+
+void Server::handleRequest(QTcpSocket *client, const QJsonObject &request, qint64 parseMicros)
 {
     QString action = request["action"].toString();
 
-    qInfo() << "Received request:" << action;
+    qCDebug(lcRequest) << "Received request:" << action;
+
+    TraceSpan span("handleRequest", "server");
+    span.setArg("action", action);
+
+    loopMonitor.setActivity(action);
+
+    QElapsedTimer requestTimer;
+    requestTimer.start();
+    responseWriteMicros = 0;
+    bool knownAction = true;
+
+    if (action == "batch") {
+        handleBatch(client, request);
+    }
+    else {
+        knownAction = dispatchRequest(client, action, request);
+    }
+
+    // Whatever the handler spent outside of writing responses is the DB phase
+    qint64 handlerMicros = requestTimer.nsecsElapsed() / 1000;
+    metrics.recordRequest(knownAction ? action : QString("unknown"), parseMicros,
+                          qMax<qint64>(0, handlerMicros - responseWriteMicros), responseWriteMicros);
+
+    loopMonitor.clearActivity();
+}
+
+bool Server::dispatchRequest(QTcpSocket *client, const QString &action, const QJsonObject &request)
+{
+    bool knownAction = true;
 
     if (action == "login") {
         handleLogin(client, request);
     }
+    else if (action == "logout") {
+        handleLogout(client, request);
+    }
+    else if (action == "resume") {
+        handleResume(client, request);
+    }
     else if (action == "register") {
         handleRegister(client, request);
     }
@@ -131,13 +313,113 @@ void Server::handleRequest(QTcpSocket *client, const QJsonObject &request)
     else if (action == "addContact") {
         handleAddContact(client, request);
     }
+    else if (action == "searchMessages") {
+        handleSearchMessages(client, request);
+    }
+    else if (action == "searchUsers") {
+        handleSearchUsers(client, request);
+    }
+    else if (action == "matchContacts") {
+        handleMatchContacts(client, request);
+    }
+    else if (action == "addContacts") {
+        handleAddContacts(client, request);
+    }
+    else if (action == "uploadBegin") {
+        handleUploadBegin(client, request);
+    }
+    else if (action == "uploadChunk") {
+        handleUploadChunk(client, request);
+    }
+    else if (action == "download") {
+        handleDownload(client, request);
+    }
     else {
         // Unknown action
+        knownAction = false;
         QJsonObject errorResponse;
         errorResponse["status"] = "error";
         errorResponse["message"] = "Unknown action: " + action;
         sendResponse(client, errorResponse);
     }
+
+    return knownAction;
+}
+
+void Server::handleBatch(QTcpSocket *client, const QJsonObject &request)
+{
+    const QJsonArray requests = request["requests"].toArray();
+
+    QJsonObject response;
+    response["action"] = "batch";
+
+    if (requests.size() > MaxBatchSize) {
+        response["status"] = "error";
+        response["message"] = QString("Batch too large, at most %1 requests").arg(MaxBatchSize);
+        sendResponse(client, response);
+        return;
+    }
+
+    // One transaction gives every read the same snapshot and every write one commit
+    if (!database->beginTransaction()) {
+        response["status"] = "error";
+        response["message"] = "Failed to start batch";
+        sendResponse(client, response);
+        return;
+    }
+
+    // Responses to this client are collected instead of written; pushes to
+    // other users wait for the commit so they never name rolled back rows
+    QJsonArray responses;
+    batchClient = client;
+    batchResponses = &responses;
+    batchMessageIds.clear();
+    batchPushes.clear();
+
+    for (const QJsonValue &value : requests) {
+        QJsonObject subRequest = value.toObject();
+        QString action = subRequest["action"].toString();
+
+        if (!BatchableActions.contains(action)) {
+            QJsonObject errorResponse;
+            errorResponse["action"] = action;
+            errorResponse["status"] = "error";
+            errorResponse["message"] = "Action not allowed in a batch: " + action;
+            responses.append(errorResponse);
+            continue;
+        }
+
+        dispatchRequest(client, action, subRequest);
+    }
+
+    batchClient = nullptr;
+    batchResponses = nullptr;
+
+    // A failed commit rolls everything back, so none of the sends happened
+    if (!database->commitTransaction()) {
+        for (const QPair<int, QString> &entry : batchMessageIds) {
+            recentMessageIds.remove(entry.first, entry.second);
+        }
+        batchMessageIds.clear();
+        batchPushes.clear();
+
+        qWarning() << "Batch of" << requests.size() << "requests rolled back";
+        response["status"] = "error";
+        response["message"] = "Failed to commit batch";
+        sendResponse(client, response);
+        return;
+    }
+    batchMessageIds.clear();
+
+    response["status"] = "success";
+    response["responses"] = responses;
+    sendResponse(client, response);
+
+    QList<QPair<int, QJsonObject>> pushes;
+    pushes.swap(batchPushes);
+    for (const QPair<int, QJsonObject> &push : pushes) {
+        broadcastToUser(push.first, push.second);
+    }
 }
 
 void Server::handleLogin(QTcpSocket *client, const QJsonObject &request)
@@ -146,6 +428,7 @@ void Server::handleLogin(QTcpSocket *client, const QJsonObject &request)
     QString password = request["password"].toString();
 
     QJsonObject response;
+    response["action"] = "login";
 
     // Authenticate user
     User user;
@@ -163,21 +446,81 @@ void Server::handleLogin(QTcpSocket *client, const QJsonObject &request)
 
         response["user"] = userData;
 
+        // Opaque token the client presents on reconnect instead of its password
+        response["token"] = QString::fromLatin1(sessions.issue(user));
+
         // Associate socket with user
-        userConnections[user.id] = client;
-        socketUsers[client] = user.id;
+        bindSocket(client, user.id);
 
-        qInfo() << "User logged in:" << username << "(ID:" << user.id << ")";
+        qCInfo(lcRequest) << "User logged in:" << username << "(ID:" << user.id << ")";
     } else {
         // Login failed
         response["status"] = "error";
         response["message"] = "Invalid username or password";
 
-        qInfo() << "Login failed for username:" << username;
+        qCInfo(lcRequest) << "Login failed for username:" << username;
     }
 
     // Send response
     sendResponse(client, response);
+
+    // Queued messages follow the login response
+    if (success) {
+        startOfflineDelivery(client, user.id);
+    }
+}
+
+void Server::handleLogout(QTcpSocket *client, const QJsonObject &request)
+{
+    // Logging out ends the session for good
+    if (request.contains("token")) {
+        sessions.revoke(request["token"].toString().toLatin1());
+    }
+
+    QJsonObject response;
+    response["action"] = "logout";
+    response["status"] = "success";
+
+    // Keep the connection open so the client can log in again on it
+    if (socketUsers.contains(client)) {
+        qCInfo(lcRequest) << "User logged out, user ID:" << socketUsers[client];
+        unbindSocket(client);
+    }
+
+    sendResponse(client, response);
+}
+
+void Server::handleResume(QTcpSocket *client, const QJsonObject &request)
+{
+    QByteArray token = request["token"].toString().toLatin1();
+
+    QJsonObject response;
+    response["action"] = "resume";
+
+    // Hash lookup only, reconnect storms must not turn into a query per client
+    User user;
+    bool resumed = !token.isEmpty() && sessions.resume(token, user);
+    if (resumed) {
+        response["status"] = "success";
+
+        QJsonObject userData;
+        userData["id"] = user.id;
+        userData["username"] = user.username;
+        userData["email"] = user.email;
+
+        response["user"] = userData;
+
+        bindSocket(client, user.id);
+    } else {
+        response["status"] = "error";
+        response["message"] = "Invalid or expired session";
+    }
+
+    sendResponse(client, response);
+
+    if (resumed) {
+        startOfflineDelivery(client, user.id);
+    }
 }
 
 void Server::handleRegister(QTcpSocket *client, const QJsonObject &request)
@@ -187,6 +530,7 @@ void Server::handleRegister(QTcpSocket *client, const QJsonObject &request)
     QString password = request["password"].toString();
 
     QJsonObject response;
+    response["action"] = "register";
 
     // Check if username already exists
     if (database->usernameExists(username)) {
@@ -208,6 +552,8 @@ void Server::handleRegister(QTcpSocket *client, const QJsonObject &request)
         bool success = database->addUser(user);
 
         if (success) {
+            userDirectory.add(user);
+
             response["status"] = "success";
             response["message"] = "User registered successfully";
 
@@ -269,6 +615,7 @@ void Server::handleGetChatHistory(QTcpSocket *client, const QJsonObject &request
 
     QJsonObject response;
     response["action"] = "getChatHistory";
+    response["contactId"] = contactId;
 
     // Get chat history
     QList<Message> messages = database->getChatHistory(userId, contactId);
@@ -282,6 +629,9 @@ void Server::handleGetChatHistory(QTcpSocket *client, const QJsonObject &request
         messageObj["content"] = message.content;
         messageObj["timestamp"] = message.timestamp.toString(Qt::ISODate);
         messageObj["type"] = message.type;
+        if (message.attachmentId > 0) {
+            messageObj["attachment"] = attachmentJson(message.attachmentId);
+        }
 
         // Get sender name
         User sender = database->getUserById(message.senderId);
@@ -300,6 +650,113 @@ void Server::handleGetChatHistory(QTcpSocket *client, const QJsonObject &request
     sendResponse(client, response);
 }
 
+void Server::handleSearchMessages(QTcpSocket *client, const QJsonObject &request)
+{
+    int userId = request["userId"].toInt();
+    int contactId = request["contactId"].toInt(-1);
+    QString text = request["query"].toString().trimmed();
+    int limit = qBound(1, request["limit"].toInt(DefaultSearchLimit), MaxSearchLimit);
+    int offset = qMax(0, request["offset"].toInt());
+
+    QJsonObject response;
+    response["action"] = "searchMessages";
+    response["query"] = text;
+    response["contactId"] = contactId;
+    response["offset"] = offset;
+
+    if (!database->isSearchAvailable()) {
+        response["status"] = "error";
+        response["message"] = "Search is not available";
+        sendResponse(client, response);
+        return;
+    }
+    if (text.isEmpty() || text.size() > MaxSearchLength) {
+        response["status"] = "error";
+        response["message"] = QString("Search text must be 1 to %1 characters").arg(MaxSearchLength);
+        sendResponse(client, response);
+        return;
+    }
+    if (offset > MaxSearchOffset) {
+        response["status"] = "error";
+        response["message"] = "Refine the search to see more results";
+        sendResponse(client, response);
+        return;
+    }
+
+    // One extra row tells whether another page exists
+    QList<QPair<Message, QString>> hits = database->searchMessages(userId, contactId, text, limit + 1, offset);
+    bool more = hits.size() > limit;
+    if (more) {
+        hits.removeLast();
+    }
+
+    QHash<int, QString> senderNames;
+    QJsonArray messagesArray;
+    for (const QPair<Message, QString> &hit : hits) {
+        const Message &message = hit.first;
+
+        QJsonObject messageObj;
+        messageObj["id"] = message.id;
+        messageObj["senderId"] = message.senderId;
+        messageObj["receiverId"] = message.receiverId;
+        messageObj["snippet"] = hit.second;
+        messageObj["timestamp"] = message.timestamp.toString(Qt::ISODate);
+        messageObj["type"] = message.type;
+        if (message.attachmentId > 0) {
+            messageObj["attachment"] = attachmentJson(message.attachmentId);
+        }
+
+        // A page mostly comes from few conversations, look each sender up once
+        if (!senderNames.contains(message.senderId)) {
+            senderNames.insert(message.senderId, database->getUserById(message.senderId).username);
+        }
+        messageObj["senderName"] = senderNames.value(message.senderId);
+
+        messagesArray.append(messageObj);
+    }
+
+    response["status"] = "success";
+    response["messages"] = messagesArray;
+    response["more"] = more;
+    sendResponse(client, response);
+}
+
+void Server::handleSearchUsers(QTcpSocket *client, const QJsonObject &request)
+{
+    int userId = request["userId"].toInt();
+    QString prefix = request["prefix"].toString().trimmed();
+    int limit = qBound(1, request["limit"].toInt(DefaultUserSearchLimit), MaxUserSearchLimit);
+
+    QJsonObject response;
+    response["action"] = "searchUsers";
+    response["prefix"] = prefix;
+
+    if (prefix.isEmpty() || prefix.size() > MaxUserSearchLength) {
+        response["status"] = "error";
+        response["message"] = QString("Prefix must be 1 to %1 characters").arg(MaxUserSearchLength);
+        sendResponse(client, response);
+        return;
+    }
+
+    // One extra in case the caller's own name is among the matches
+    QJsonArray usersArray;
+    const QList<QPair<int, QString>> matches = userDirectory.search(prefix, limit + 1);
+    for (const QPair<int, QString> &match : matches) {
+        if (match.first == userId || usersArray.size() == limit) {
+            continue;
+        }
+
+        QJsonObject userObj;
+        userObj["id"] = match.first;
+        userObj["username"] = match.second;
+        usersArray.append(userObj);
+    }
+
+    response["status"] = "success";
+    response["users"] = usersArray;
+    sendResponse(client, response);
+}
+
 void Server::handleSendMessage(QTcpSocket *client, const QJsonObject &request)
 {
     int senderId = request["senderId"].toInt();
@@ -307,6 +764,42 @@ void Server::handleSendMessage(QTcpSocket *client, const QJsonObject &request)
     QString content = request["content"].toString();
     QString type = request.contains("type") ? request["type"].toString() : "text";
     QString timestampStr = request["timestamp"].toString();
+    QString clientMessageId = request["clientMessageId"].toString();
+
+    QJsonObject response;
+    response["action"] = "sendMessage";
+    if (!clientMessageId.isEmpty()) {
+        response["clientMessageId"] = clientMessageId;
+    }
+
+    if (clientMessageId.size() > MaxClientMessageIdLength) {
+        response["status"] = "error";
+        response["message"] = "Client message id too long";
+        sendResponse(client, response);
+        return;
+    }
+
+    // A retry of something we already stored is answered from memory
+    if (!clientMessageId.isEmpty()) {
+        int existingId = recentMessageIds.find(senderId, clientMessageId);
+        if (existingId > 0) {
+            respondDuplicate(client, response, existingId);
+            return;
+        }
+    }
+
+    // Attachments must be fully uploaded before they can be sent
+    int attachmentId = request["attachmentId"].toInt(-1);
+    QJsonObject attachment;
+    if (attachmentId > 0) {
+        attachment = attachmentJson(attachmentId);
+        if (attachment.isEmpty()) {
+            response["status"] = "error";
+            response["message"] = "Unknown attachment";
+            sendResponse(client, response);
+            return;
+        }
+    }
 
     QDateTime timestamp = QDateTime::fromString(timestampStr, Qt::ISODate);
     if (!timestamp.isValid()) {
@@ -321,27 +814,59 @@ void Server::handleSendMessage(QTcpSocket *client, const QJsonObject &request)
     message.timestamp = timestamp;
     message.type = type;
     message.read = false;
+    message.clientMessageId = clientMessageId;
+    message.attachmentId = attachmentId;
+    if (attachmentId > 0 && !request.contains("type")) {
+        message.type = "file";
+    }
+
+    // Receivers that are online get it pushed right away, the rest queue up
+    message.delivered = userConnections.contains(receiverId);
 
     // Save message to database
     bool success = database->addMessage(message);
 
-    QJsonObject response;
-    response["action"] = "sendMessage";
+    // Older than the recent ids table, the unique index rejected it
+    if (!success && !clientMessageId.isEmpty()) {
+        int existingId = database->findMessageByClientId(senderId, clientMessageId);
+        if (existingId > 0) {
+            recentMessageIds.insert(senderId, clientMessageId, existingId);
+            respondDuplicate(client, response, existingId);
+            return;
+        }
+    }
 
     if (success) {
+        if (!clientMessageId.isEmpty()) {
+            recentMessageIds.insert(senderId, clientMessageId, message.id);
+            if (batchResponses) {
+                batchMessageIds.append(qMakePair(senderId, clientMessageId));
+            }
+        }
+
         response["status"] = "success";
         response["messageId"] = message.id;
 
         // Send message to receiver if online
-        if (userConnections.contains(receiverId)) {
-            QJsonObject messageObj = request;
+        if (message.delivered) {
+            // Built from what was stored, nothing else from the request is relayed
+            QJsonObject messageObj;
             messageObj["action"] = "message";
             messageObj["id"] = message.id;
+            messageObj["senderId"] = message.senderId;
+            messageObj["receiverId"] = message.receiverId;
+            messageObj["content"] = message.content;
+            messageObj["timestamp"] = message.timestamp.toString(Qt::ISODate);
+            messageObj["type"] = message.type;
+            messageObj["senderName"] = database->getUserById(senderId).username;
+            if (!attachment.isEmpty()) {
+                messageObj["attachment"] = attachment;
+            }
 
             broadcastToUser(receiverId, messageObj);
         }
 
-        qInfo() << "Message sent from" << senderId << "to" << receiverId;
+        qCInfo(lcRequest) << "Message sent from" << senderId << "to" << receiverId;
     } else {
         response["status"] = "error";
         response["message"] = "Failed to send message";
@@ -353,6 +878,371 @@ void Server::handleSendMessage(QTcpSocket *client, const QJsonObject &request)
     sendResponse(client, response);
 }
 
+void Server::respondDuplicate(QTcpSocket *client, QJsonObject &response, int messageId)
+{
+    // Same answer as the first time, without storing or pushing it again
+    ++duplicateMessages;
+    response["status"] = "success";
+    response["messageId"] = messageId;
+    response["duplicate"] = true;
+    sendResponse(client, response);
+}
+
+void Server::handleUploadBegin(QTcpSocket *client, const QJsonObject &request)
+{
+    int userId = request["userId"].toInt();
+
+    QJsonObject response;
+    response["action"] = "uploadBegin";
+
+    if (!files.isOpen()) {
+        response["status"] = "error";
+        response["message"] = "Attachments are not available";
+        sendResponse(client, response);
+        return;
+    }
+
+    expireUploads();
+
+    Upload upload;
+    if (request.contains("uploadId")) {
+        // Resuming, tell the client where to pick up
+        if (!database->getUpload(request["uploadId"].toString(), upload) || upload.userId != userId) {
+            response["status"] = "error";
+            response["message"] = "Unknown upload";
+            sendResponse(client, response);
+            return;
+        }
+
+        if (files.stagedSize(upload.id) < 0) {
+            files.createStaging(upload.id);
+        }
+    } else {
+        if (database->countUploads(userId) >= MaxUploadsPerUser) {
+            response["status"] = "error";
+            response["message"] = QString("At most %1 uploads can be in progress").arg(MaxUploadsPerUser);
+            sendResponse(client, response);
+            return;
+        }
+
+        upload.userId = userId;
+        upload.name = QFileInfo(request["name"].toString()).fileName().left(255);
+        upload.size = qint64(request["size"].toDouble());
+        upload.sha256 = request["sha256"].toString().toLower();
+
+        if (upload.name.isEmpty() || upload.size <= 0 || upload.size > MaxAttachmentSize) {
+            response["status"] = "error";
+            response["message"] = QString("Attachments need a name and a size of at most %1 bytes").arg(MaxAttachmentSize);
+            sendResponse(client, response);
+            return;
+        }
+        if (!upload.sha256.isEmpty() && !FileStore::isValidHash(upload.sha256)) {
+            response["status"] = "error";
+            response["message"] = "Invalid sha256";
+            sendResponse(client, response);
+            return;
+        }
+
+        upload.id = FileStore::newUploadId();
+        if (!files.createStaging(upload.id) || !database->addUpload(upload)) {
+            files.discard(upload.id);
+            response["status"] = "error";
+            response["message"] = "Failed to start upload";
+            sendResponse(client, response);
+            return;
+        }
+
+        qCInfo(lcRequest) << "Upload" << upload.id << "started by user" << userId << "," << upload.size << "bytes";
+    }
+
+    response["status"] = "success";
+    response["uploadId"] = upload.id;
+    response["offset"] = qMax<qint64>(0, files.stagedSize(upload.id));
+    response["chunkSize"] = MaxChunkSize;
+    sendResponse(client, response);
+}
+
+void Server::expireUploads()
+{
+    // Sweep at most once a minute so starting uploads stays cheap
+    if (uploadSweepClock.isValid() && uploadSweepClock.elapsed() < UploadSweepIntervalMs) {
+        return;
+    }
+    uploadSweepClock.start();
+
+    const QStringList stale = database->getStaleUploads(UploadMaxAgeSecs);
+    for (const QString &uploadId : stale) {
+        files.discard(uploadId);
+        database->removeUpload(uploadId);
+    }
+
+    if (!stale.isEmpty()) {
+        qInfo() << "Expired" << stale.size() << "abandoned uploads";
+    }
+}
+
+void Server::handleUploadChunk(QTcpSocket *client, const QJsonObject &request)
+{
+    int userId = request["userId"].toInt();
+    QString uploadId = request["uploadId"].toString();
+    qint64 offset = qint64(request["offset"].toDouble(-1));
+
+    QJsonObject response;
+    response["action"] = "uploadChunk";
+    response["uploadId"] = uploadId;
+
+    Upload upload;
+    if (!files.isOpen() || !database->getUpload(uploadId, upload) || upload.userId != userId) {
+        response["status"] = "error";
+        response["message"] = "Unknown upload";
+        sendResponse(client, response);
+        return;
+    }
+
+    // Resumed after a restart or eviction, hash the staged data off the event loop first
+    if (!files.isReady(uploadId)) {
+        bool preparing = waitingChunks.contains(uploadId);
+        waitingChunks[uploadId].append(qMakePair(QPointer<QTcpSocket>(client), request));
+        if (!preparing) {
+            files.prepare(uploadId, this, [this, uploadId](bool ok) {
+                onUploadPrepared(uploadId, ok);
+            });
+        }
+        return;
+    }
+
+    QByteArray data = QByteArray::fromBase64(request["data"].toString().toLatin1());
+    qint64 staged = qMax<qint64>(0, files.stagedSize(uploadId));
+
+    // A mismatched offset is answered with the right one so the client can resync
+    if (offset != staged) {
+        response["status"] = "error";
+        response["message"] = "Unexpected offset";
+        response["offset"] = staged;
+        sendResponse(client, response);
+        return;
+    }
+    // An empty chunk only finishes an upload whose data is all staged already
+    if ((data.isEmpty() && staged < upload.size) || data.size() > MaxChunkSize
+        || staged + data.size() > upload.size) {
+        response["status"] = "error";
+        response["message"] = "Invalid chunk";
+        response["offset"] = staged;
+        sendResponse(client, response);
+        return;
+    }
+
+    if (!data.isEmpty() && !files.append(uploadId, data)) {
+        response["status"] = "error";
+        response["message"] = "Failed to store chunk";
+        response["offset"] = staged;
+        sendResponse(client, response);
+        return;
+    }
+
+    staged += data.size();
+    response["offset"] = staged;
+
+    if (!data.isEmpty() && staged < upload.size) {
+        database->touchUpload(uploadId);
+    }
+
+    if (staged < upload.size) {
+        response["status"] = "success";
+        response["complete"] = false;
+        sendResponse(client, response);
+        return;
+    }
+
+    // Last chunk: move the data into the object store and record the attachment
+    Attachment attachment;
+    attachment.sha256 = files.commit(uploadId, upload.sha256);
+    attachment.name = upload.name;
+    attachment.size = upload.size;
+    attachment.uploaderId = userId;
+
+    database->removeUpload(uploadId);
+
+    if (attachment.sha256.isEmpty() || !database->addAttachment(attachment)) {
+        response["status"] = "error";
+        response["message"] = "Upload could not be verified or stored";
+        sendResponse(client, response);
+        return;
+    }
+
+    response["status"] = "success";
+    response["complete"] = true;
+    response["attachmentId"] = attachment.id;
+    response["sha256"] = attachment.sha256;
+    sendResponse(client, response);
+
+    // Previews are made off the event loop, history picks them up once ready
+    if (attachment.thumbnailSize == 0 && Thumbnailer::looksLikeImage(attachment.name)) {
+        thumbnailer.request(attachment.sha256, files.objectPath(attachment.sha256),
+                            files.thumbnailPath(attachment.sha256));
+    }
+
+    qCInfo(lcRequest) << "Upload" << uploadId << "complete, attachment" << attachment.id;
+}
+
+void Server::onUploadPrepared(const QString &uploadId, bool ok)
+{
+    const QList<QPair<QPointer<QTcpSocket>, QJsonObject>> chunks = waitingChunks.take(uploadId);
+    for (const QPair<QPointer<QTcpSocket>, QJsonObject> &chunk : chunks) {
+        if (!chunk.first) {
+            continue;
+        }
+
+        if (ok) {
+            handleUploadChunk(chunk.first, chunk.second);
+            continue;
+        }
+
+        QJsonObject response;
+        response["action"] = "uploadChunk";
+        response["uploadId"] = uploadId;
+        response["status"] = "error";
+        response["message"] = "Failed to store chunk";
+        response["offset"] = qMax<qint64>(0, files.stagedSize(uploadId));
+        sendResponse(chunk.first, response);
+    }
+}
+
+void Server::handleDownload(QTcpSocket *client, const QJsonObject &request)
+{
+    int attachmentId = request["attachmentId"].toInt();
+    qint64 offset = qint64(request["offset"].toDouble(0));
+    bool raw = request["raw"].toBool();
+    qint64 maxLength = raw ? MaxRawChunkSize : MaxChunkSize;
+    qint64 length = qBound<qint64>(1, qint64(request["length"].toDouble(maxLength)), maxLength);
+
+    bool thumbnail = request["thumbnail"].toBool();
+
+    QJsonObject response;
+    response["action"] = "download";
+    response["attachmentId"] = attachmentId;
+    response["offset"] = offset;
+    if (thumbnail) {
+        response["thumbnail"] = true;
+    }
+
+    // The thumbnail is served like any other file, only path and size differ
+    Attachment attachment;
+    QString path;
+    qint64 size = 0;
+    if (files.isOpen() && database->getAttachment(attachmentId, attachment)) {
+        path = thumbnail ? files.thumbnailPath(attachment.sha256) : files.objectPath(attachment.sha256);
+        size = thumbnail ? attachment.thumbnailSize : attachment.size;
+    }
+
+    QByteArray data;
+    if (path.isEmpty()) {
+        response["status"] = "error";
+        response["message"] = "Unknown attachment";
+    }
+    else if (size <= 0) {
+        response["status"] = "error";
+        response["message"] = "No thumbnail available";
+    }
+    else if (offset < 0 || offset > size) {
+        response["status"] = "error";
+        response["message"] = "Offset out of range";
+    }
+    else if (raw) {
+        // Header line first, then exactly "length" bytes straight from the file
+        length = qMin(length, size - offset);
+        response["status"] = "success";
+        response["size"] = size;
+        response["raw"] = true;
+        response["length"] = length;
+        response["eof"] = offset + length >= size;
+        sendResponse(client, response);
+
+        startRawTransfer(client, path, offset, length);
+        return;
+    }
+    else if (!files.read(path, offset, length, data)) {
+        response["status"] = "error";
+        response["message"] = "Failed to read attachment";
+    }
+    else {
+        response["status"] = "success";
+        response["size"] = size;
+        response["data"] = QString::fromLatin1(data.toBase64());
+        response["eof"] = offset + data.size() >= size;
+    }
+
+    sendResponse(client, response);
+}
+
+void Server::onThumbnailReady(const QString &sha256, int width, int height, qint64 size)
+{
+    database->setAttachmentThumbnail(sha256, width, height, size);
+}
+
+void Server::startRawTransfer(QTcpSocket *client, const QString &path, qint64 offset, qint64 length)
+{
+    FileStreamer *streamer = new FileStreamer(client, path, offset, length, this);
+    rawTransfers.insert(client, streamer);
+    connect(streamer, &FileStreamer::finished, this, &Server::onRawTransferFinished);
+    streamer->start();
+}
+
+void Server::onRawTransferFinished(bool ok)
+{
+    FileStreamer *streamer = qobject_cast<FileStreamer*>(sender());
+    QTcpSocket *client = rawTransfers.key(streamer);
+    if (!streamer || !client) {
+        return;
+    }
+
+    rawTransfers.remove(client);
+    streamer->deleteLater();
+    metrics.addBytesOut(streamer->bytesSent());
+
+    // The header promised bytes that never came, the stream cannot be resynced
+    if (!ok) {
+        heldOutput.remove(client);
+        client->abort();
+        return;
+    }
+
+    // Back to buffered writes: flush what queued up, then read what waited
+    QByteArray held = heldOutput.take(client);
+    if (!held.isEmpty()) {
+        client->write(held);
+    }
+
+    loopMonitor.setActivity("download");
+    pumpOfflineDelivery(client);
+    processLines(client);
+    loopMonitor.clearActivity();
+}
+
+QJsonObject Server::attachmentJson(int attachmentId)
+{
+    QJsonObject json;
+
+    Attachment attachment;
+    if (database->getAttachment(attachmentId, attachment)) {
+        json["id"] = attachment.id;
+        json["name"] = attachment.name;
+        json["size"] = attachment.size;
+        json["sha256"] = attachment.sha256;
+
+        // A few KB to show in the bubble instead of the full image
+        if (attachment.thumbnailSize > 0) {
+            QJsonObject thumbnail;
+            thumbnail["width"] = attachment.thumbnailWidth;
+            thumbnail["height"] = attachment.thumbnailHeight;
+            thumbnail["size"] = attachment.thumbnailSize;
+            json["thumbnail"] = thumbnail;
+        }
+    }
+
+    return json;
+}
+
 void Server::handleAddContact(QTcpSocket *client, const QJsonObject &request)
 {
     int userId = request["userId"].toInt();
@@ -400,23 +1290,288 @@ void Server::handleAddContact(QTcpSocket *client, const QJsonObject &request)
     sendResponse(client, response);
 }
 
+bool Server::resolveContacts(int userId, const QJsonValue &entries, QList<ContactMatch> &matches,
+                             QJsonArray &unmatched, QJsonObject &response)
+{
+    const QJsonArray list = entries.toArray();
+    if (!entries.isArray() || list.size() > MaxContactImport) {
+        response["status"] = "error";
+        response["message"] = QString("Expected a list of at most %1 usernames or emails").arg(MaxContactImport);
+        return false;
+    }
+
+    // Every entry is a hash or binary search in the directory; the same
+    // person listed by name and by email is matched once
+    QSet<QString> seenQueries;
+    QSet<int> seenIds;
+    for (const QJsonValue &value : list) {
+        QString query = value.toString().trimmed();
+        if (query.isEmpty() || seenQueries.contains(query.toCaseFolded())) {
+            continue;
+        }
+        seenQueries.insert(query.toCaseFolded());
+
+        ContactMatch match;
+        match.query = query;
+        if (!userDirectory.find(query, match.id, match.username)) {
+            unmatched.append(query);
+            continue;
+        }
+        if (match.id == userId || seenIds.contains(match.id)) {
+            continue;
+        }
+        seenIds.insert(match.id);
+        matches.append(match);
+    }
+
+    return true;
+}
+
+void Server::handleMatchContacts(QTcpSocket *client, const QJsonObject &request)
+{
+    int userId = request["userId"].toInt();
+
+    QJsonObject response;
+    response["action"] = "matchContacts";
+
+    QList<ContactMatch> matches;
+    QJsonArray unmatched;
+    if (!resolveContacts(userId, request["contacts"], matches, unmatched, response)) {
+        sendResponse(client, response);
+        return;
+    }
+
+    // One query for the existing contacts, then a set lookup per match
+    QSet<int> existing = database->getContactIds(userId);
+
+    QJsonArray matchesArray;
+    for (const ContactMatch &match : matches) {
+        QJsonObject matchObj;
+        matchObj["query"] = match.query;
+        matchObj["id"] = match.id;
+        matchObj["username"] = match.username;
+        matchObj["isContact"] = existing.contains(match.id);
+        matchesArray.append(matchObj);
+    }
+
+    response["status"] = "success";
+    response["matches"] = matchesArray;
+    response["unmatched"] = unmatched;
+    sendResponse(client, response);
+}
+
+void Server::handleAddContacts(QTcpSocket *client, const QJsonObject &request)
+{
+    int userId = request["userId"].toInt();
+
+    QJsonObject response;
+    response["action"] = "addContacts";
+
+    QList<ContactMatch> matches;
+    QJsonArray unmatched;
+    if (!resolveContacts(userId, request["contacts"], matches, unmatched, response)) {
+        sendResponse(client, response);
+        return;
+    }
+
+    QSet<int> existing = database->getContactIds(userId);
+
+    QList<int> newIds;
+    QJsonArray addedArray;
+    QJsonArray existingArray;
+    for (const ContactMatch &match : matches) {
+        QJsonObject userObj;
+        userObj["id"] = match.id;
+        userObj["username"] = match.username;
+
+        if (existing.contains(match.id)) {
+            existingArray.append(userObj);
+        } else {
+            newIds.append(match.id);
+            addedArray.append(userObj);
+        }
+    }
+
+    // All new pairs, both directions, in a single transaction
+    if (!database->addContacts(userId, newIds)) {
+        response["status"] = "error";
+        response["message"] = "Failed to add contacts";
+        sendResponse(client, response);
+
+        qWarning() << "Failed to add" << newIds.size() << "contacts for user" << userId;
+        return;
+    }
+
+    response["status"] = "success";
+    response["added"] = addedArray;
+    response["alreadyContacts"] = existingArray;
+    response["unmatched"] = unmatched;
+    sendResponse(client, response);
+
+    qInfo() << "Contacts imported: User" << userId << "added" << newIds.size();
+}
+
 void Server::sendResponse(QTcpSocket *client, const QJsonObject &response)
 {
-    // Convert JSON to bytes
-    QJsonDocument doc(response);
-    QByteArray data = doc.toJson(QJsonDocument::Compact);
+    if (batchResponses && client == batchClient) {
+        batchResponses->append(response);
+        return;
+    }
 
-    // Add message delimiter
-    data.append('\n');
+    QElapsedTimer writeTimer;
+    writeTimer.start();
+
+    // Convert JSON to bytes
+    QByteArray data;
+    {
+        TraceSpan span("serialize", "server");
+        QJsonDocument doc(response);
+        data = doc.toJson(QJsonDocument::Compact);
+
+        // Add message delimiter
+        data.append('\n');
+        span.setArg("bytes", data.size());
+    }
 
     // Send data
-    client->write(data);
+    {
+        TraceSpan span("write", "server");
+        if (rawTransfers.contains(client)) {
+            heldOutput[client].append(data);
+        } else {
+            client->write(data);
+        }
+    }
+
+    metrics.addBytesOut(data.size());
+    responseWriteMicros += writeTimer.nsecsElapsed() / 1000;
+}
+
+QByteArray Server::metricsText()
+{
+    qint64 writeQueue = 0;
+    qint64 readQueue = 0;
+    for (QTcpSocket *client : clients) {
+        writeQueue += client->bytesToWrite();
+        readQueue += client->bytesAvailable();
+    }
+
+    metrics.setGauge("qtmessenger_connections", "Open client connections.", clients.size());
+    metrics.setGauge("qtmessenger_online_users", "Users bound to a connection.", userConnections.size());
+    metrics.setGauge("qtmessenger_write_queue_bytes", "Bytes buffered for writing across all sockets.", writeQueue);
+    metrics.setGauge("qtmessenger_read_queue_bytes", "Bytes received but not yet handled across all sockets.", readQueue);
+    metrics.setGauge("qtmessenger_session_tokens", "Resumable sessions held in memory.", sessions.size());
+    metrics.setGauge("qtmessenger_thumbnail_queue", "Thumbnails waiting for or being generated by the worker pool.",
+                     thumbnailer.pending());
+    metrics.setCounter("qtmessenger_duplicate_messages_total",
+                       "Retried sendMessage requests answered without storing them again.", duplicateMessages);
+    metrics.setCounter("qtmessenger_log_dropped_lines_total", "Log lines dropped because the log ring buffer was full.",
+                       Logger::instance().droppedCount());
+    metrics.setCounter("qtmessenger_log_suppressed_lines_total", "Log lines suppressed by per call site rate limiting.",
+                       Logger::instance().suppressedCount());
+
+    return metrics.exposition() + loopMonitor.exposition();
+}
+
+void Server::bindSocket(QTcpSocket *client, int userId)
+{
+    // A socket that logs in again drops its previous user first
+    unbindSocket(client);
+
+    userConnections[userId] = client;
+    socketUsers[client] = userId;
+}
+
+void Server::unbindSocket(QTcpSocket *client)
+{
+    if (!socketUsers.contains(client)) {
+        return;
+    }
+
+    int userId = socketUsers.take(client);
+    offlineDeliveries.remove(client);
+
+    // The user may already be bound to a newer socket
+    if (userConnections.value(userId) == client) {
+        userConnections.remove(userId);
+    }
 }
 
 void Server::broadcastToUser(int userId, const QJsonObject &message)
 {
+    // Inside a batch nothing is committed yet, handleBatch sends these after
+    if (batchResponses) {
+        batchPushes.append(qMakePair(userId, message));
+        return;
+    }
+
     if (userConnections.contains(userId)) {
         QTcpSocket *client = userConnections[userId];
         sendResponse(client, message);
     }
 }
+
+void Server::startOfflineDelivery(QTcpSocket *client, int userId)
+{
+    offlineDeliveries.insert(client, { userId, 0 });
+    pumpOfflineDelivery(client);
+}
+
+void Server::pumpOfflineDelivery(QTcpSocket *client)
+{
+    auto it = offlineDeliveries.find(client);
+    if (it == offlineDeliveries.end()) {
+        return;
+    }
+
+    // A newer login of the same user took over the queue
+    if (userConnections.value(it->userId) != client) {
+        offlineDeliveries.erase(it);
+        return;
+    }
+
+    // Stop feeding a slow reader once enough is queued, bytesWritten resumes it;
+    // behind a raw download the pushes would only pile up in heldOutput
+    while (client->bytesToWrite() < OfflineHighWater && !rawTransfers.contains(client)) {
+        QList<Message> messages = database->getUndeliveredMessages(it->userId, it->lastSentId, OfflineChunkSize);
+        if (messages.isEmpty()) {
+            offlineDeliveries.erase(it);
+            return;
+        }
+
+        QHash<int, QString> senderNames;
+        QJsonArray messagesArray;
+        for (const Message &message : messages) {
+            if (!senderNames.contains(message.senderId)) {
+                senderNames.insert(message.senderId, database->getUserById(message.senderId).username);
+            }
+
+            QJsonObject messageObj;
+            messageObj["id"] = message.id;
+            messageObj["senderId"] = message.senderId;
+            messageObj["receiverId"] = message.receiverId;
+            messageObj["content"] = message.content;
+            messageObj["timestamp"] = message.timestamp.toString(Qt::ISODate);
+            messageObj["type"] = message.type;
+            messageObj["senderName"] = senderNames.value(message.senderId);
+            if (message.attachmentId > 0) {
+                messageObj["attachment"] = attachmentJson(message.attachmentId);
+            }
+
+            messagesArray.append(messageObj);
+        }
+
+        QJsonObject push;
+        push["action"] = "offlineMessages";
+        push["status"] = "success";
+        push["messages"] = messagesArray;
+        push["more"] = messages.size() == OfflineChunkSize;
+        sendResponse(client, push);
+
+        // Handed to the socket counts as delivered, the history still has them
+        it->lastSentId = messages.last().id;
+        database->markMessagesDelivered(it->userId, it->lastSentId);
+
+        qCDebug(lcRequest) << "Pushed" << messages.size() << "offline messages to user" << it->userId;
+    }
+}
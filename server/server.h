@@ -6,9 +6,23 @@
 #include <QTcpSocket>
 #include <QJsonObject>
 #include <QJsonDocument>
+#include <QJsonArray>
 #include <QMap>
+#include <QElapsedTimer>
+#include <QSet>
+#include <QHash>
+#include <QPointer>
 
 #include "database.h"
+#include "sessionstore.h"
+#include "metrics.h"
+#include "trafficrecorder.h"
+#include "loopmonitor.h"
+#include "recentmessageids.h"
+#include "userdirectory.h"
+#include "filestore.h"
+#include "filestreamer.h"
+#include "thumbnailer.h"
 
 class Server : public QObject
 {
@@ -21,28 +35,152 @@ public:
     bool start();
     void stop();
 
+    // Event loop lag monitoring, stalls longer than the threshold are logged
+    // with the action that caused them (0 = measure lag only)
+    void setStallThreshold(int msecs);
+
+    // Capture inbound frames for QtMessengerReplay
+    bool startRecording(const QString &path);
+
+    // Where attachments are stored, they are refused until this is set
+    bool openFileStore(const QString &path);
+
+    // Admission control for reconnect storms, 0 disables it
+    void setMaxConnectRate(int connectionsPerSecond);
+
+    // Prometheus text for the metrics endpoint, gauges refreshed on each call
+    QByteArray metricsText();
+
 private slots:
     void onNewConnection();
     void onClientDisconnected();
     void onReadyRead();
+    void onBytesWritten();
+    void onRawTransferFinished(bool ok);
+    void onThumbnailReady(const QString &sha256, int width, int height, qint64 size);
 
 private:
-    void handleRequest(QTcpSocket *client, const QJsonObject &request);
+    friend class ServerBenchmark;   // drives handleRequest without a network round trip
+    friend class ServerTest;
+
+    void processLines(QTcpSocket *client);
+    void handleRequest(QTcpSocket *client, const QJsonObject &request, qint64 parseMicros = 0);
+    bool dispatchRequest(QTcpSocket *client, const QString &action, const QJsonObject &request);
+    void handleBatch(QTcpSocket *client, const QJsonObject &request);
     void handleLogin(QTcpSocket *client, const QJsonObject &request);
+    void handleLogout(QTcpSocket *client, const QJsonObject &request);
+    void handleResume(QTcpSocket *client, const QJsonObject &request);
     void handleRegister(QTcpSocket *client, const QJsonObject &request);
     void handleGetContacts(QTcpSocket *client, const QJsonObject &request);
     void handleGetChatHistory(QTcpSocket *client, const QJsonObject &request);
     void handleSendMessage(QTcpSocket *client, const QJsonObject &request);
     void handleAddContact(QTcpSocket *client, const QJsonObject &request);
+    void handleSearchMessages(QTcpSocket *client, const QJsonObject &request);
+    void handleSearchUsers(QTcpSocket *client, const QJsonObject &request);
+    void handleMatchContacts(QTcpSocket *client, const QJsonObject &request);
+    void handleAddContacts(QTcpSocket *client, const QJsonObject &request);
+    struct ContactMatch {
+        QString query;          // as the client sent it, to map results back
+        int id;
+        QString username;
+    };
+    bool resolveContacts(int userId, const QJsonValue &entries, QList<ContactMatch> &matches,
+                         QJsonArray &unmatched, QJsonObject &response);
+    void respondDuplicate(QTcpSocket *client, QJsonObject &response, int messageId);
+    void handleUploadBegin(QTcpSocket *client, const QJsonObject &request);
+    void handleUploadChunk(QTcpSocket *client, const QJsonObject &request);
+    void onUploadPrepared(const QString &uploadId, bool ok);
+    void expireUploads();
+    void handleDownload(QTcpSocket *client, const QJsonObject &request);
+    QJsonObject attachmentJson(int attachmentId);
+    void startRawTransfer(QTcpSocket *client, const QString &path, qint64 offset, qint64 length);
 
+    bool admitConnection(qint64 &retryAfter);
     void sendResponse(QTcpSocket *client, const QJsonObject &response);
     void broadcastToUser(int userId, const QJsonObject &message);
+    void bindSocket(QTcpSocket *client, int userId);
+    void unbindSocket(QTcpSocket *client);
+    void startOfflineDelivery(QTcpSocket *client, int userId);
+    void pumpOfflineDelivery(QTcpSocket *client);
 
     QTcpServer *server;
     Database *database;
 
     QMap<int, QTcpSocket*> userConnections;      // userId -> socket
     QMap<QTcpSocket*, int> socketUsers;          // socket -> userId
+    QSet<QTcpSocket*> clients;                   // every open connection
+    SessionStore sessions;                       // resume token -> user
+    QHash<QTcpSocket*, quint32> connectionIds;   // stable ids for the capture
+    quint32 nextConnectionId;
+    TrafficRecorder recorder;
+    LoopMonitor loopMonitor;
+
+    // Offline queue pushes in progress, resumed as each socket drains
+    struct OfflineDelivery {
+        int userId;
+        int lastSentId;
+    };
+    QHash<QTcpSocket*, OfflineDelivery> offlineDeliveries;
+
+    static constexpr int OfflineChunkSize = 200;                // messages per push
+    static constexpr qint64 OfflineHighWater = 256 * 1024;      // bytes queued before pausing
+
+    // Client message ids of recent sends, deduplicates retries
+    RecentMessageIds recentMessageIds;
+    quint64 duplicateMessages;
+    static constexpr int MaxClientMessageIdLength = 64;
+
+    // Attachments move in bounded chunks so a large file never holds up
+    // other requests for long
+    FileStore files;
+    Thumbnailer thumbnailer;
+    static constexpr qint64 MaxChunkSize = 256 * 1024;
+    static constexpr qint64 MaxAttachmentSize = qint64(1) << 30;
+
+    // Uploads without a chunk for a day are dropped, swept at most once a minute
+    QElapsedTimer uploadSweepClock;
+    static constexpr int UploadMaxAgeSecs = 24 * 60 * 60;
+    static constexpr qint64 UploadSweepIntervalMs = 60 * 1000;
+    static constexpr int MaxUploadsPerUser = 16;
+
+    // Chunks for uploads whose staged data is being rehashed, replayed in order after
+    QHash<QString, QList<QPair<QPointer<QTcpSocket>, QJsonObject>>> waitingChunks;
+
+    // Raw downloads own their socket until done; requests wait unread and
+    // responses or pushes for it are held back in the meantime
+    QHash<QTcpSocket*, FileStreamer*> rawTransfers;
+    QHash<QTcpSocket*, QByteArray> heldOutput;
+    static constexpr qint64 MaxRawChunkSize = 16 * 1024 * 1024;
+
+    // Usernames for autocomplete, answered without touching the database
+    UserDirectory userDirectory;
+    static constexpr int MaxUserSearchLength = 64;
+    static constexpr int DefaultUserSearchLimit = 10;
+    static constexpr int MaxUserSearchLimit = 50;
+    static constexpr int MaxContactImport = 1000;          // entries per matchContacts/addContacts
+
+    // Search pages are small and shallow, deep pages cost as much as all before them
+    static constexpr int MaxSearchLength = 256;
+    static constexpr int DefaultSearchLimit = 20;
+    static constexpr int MaxSearchLimit = 100;
+    static constexpr int MaxSearchOffset = 1000;
+
+    // Set while a batch runs, its responses are collected here
+    QTcpSocket *batchClient;
+    QJsonArray *batchResponses;
+    QList<QPair<int, QString>> batchMessageIds;   // dedup entries to drop if the batch rolls back
+    QList<QPair<int, QJsonObject>> batchPushes;   // userId -> push, sent once the batch commits
+    static constexpr int MaxBatchSize = 100;
+    static const QSet<QString> BatchableActions;
+
+    // Token bucket refilled at maxConnectRate per second
+    int maxConnectRate;
+    double connectTokens;
+    int rejectedInWindow;
+    QElapsedTimer connectClock;
+
+    Metrics metrics;
+    qint64 responseWriteMicros;                  // write time of the request being handled
 };
 
 #endif // SERVER_H
@@ -1,5 +1,5 @@
-QT += core network sql
-QT -= gui
+# Gui only for QImage/QImageReader in the thumbnail workers
+QT += core network sql gui
 
 TARGET = QtMessengerServer
 TEMPLATE = app
@@ -7,18 +7,48 @@ TEMPLATE = app
 CONFIG += c++17 console
 CONFIG -= app_bundle
 
+# File and line in QMessageLogContext, used to rate limit per call site
+DEFINES += QT_MESSAGELOGCONTEXT
+
 SOURCES += \
     main.cpp \
     server.cpp \
     database.cpp \
     user.cpp \
-    message.cpp
+    message.cpp \
+    sessionstore.cpp \
+    latencyhistogram.cpp \
+    metrics.cpp \
+    metricsserver.cpp \
+    tracer.cpp \
+    logger.cpp \
+    trafficrecorder.cpp \
+    loopmonitor.cpp \
+    recentmessageids.cpp \
+    userdirectory.cpp \
+    filestore.cpp \
+    filestreamer.cpp \
+    thumbnailer.cpp
 
 HEADERS += \
     server.h \
     database.h \
     user.h \
-    message.h
+    message.h \
+    attachment.h \
+    sessionstore.h \
+    latencyhistogram.h \
+    metrics.h \
+    metricsserver.h \
+    tracer.h \
+    logger.h \
+    trafficrecorder.h \
+    loopmonitor.h \
+    recentmessageids.h \
+    userdirectory.h \
+    filestore.h \
+    filestreamer.h \
+    thumbnailer.h
 
 # Default rules for deployment.
 qnx: target.path = /tmp/$${TARGET}/bin
@@ -0,0 +1,73 @@
+#include "sessionstore.h"
+
+#include <QRandomGenerator>
+
+SessionStore::SessionStore(qint64 idleTimeoutMs)
+    : idleTimeout(idleTimeoutMs)
+    , lastSweep(0)
+{
+    clock.start();
+}
+
+QByteArray SessionStore::issue(const User &user)
+{
+    expireIdle();
+
+    // 256 random bits from the system CSPRNG, URL-safe so it travels in JSON as-is
+    quint32 random[8];
+    QRandomGenerator::system()->fillRange(random);
+    QByteArray token = QByteArray(reinterpret_cast<const char *>(random), sizeof(random))
+                           .toBase64(QByteArray::Base64UrlEncoding | QByteArray::OmitTrailingEquals);
+
+    Entry entry;
+    entry.userId = user.id;
+    entry.username = user.username;
+    entry.email = user.email;
+    entry.lastUsed = clock.elapsed();
+    tokens.insert(token, entry);
+
+    return token;
+}
+
+bool SessionStore::resume(const QByteArray &token, User &user)
+{
+    auto it = tokens.find(token);
+    if (it == tokens.end()) {
+        return false;
+    }
+
+    qint64 now = clock.elapsed();
+    if (now - it->lastUsed > idleTimeout) {
+        tokens.erase(it);
+        return false;
+    }
+
+    it->lastUsed = now;
+    user.id = it->userId;
+    user.username = it->username;
+    user.email = it->email;
+    return true;
+}
+
+void SessionStore::revoke(const QByteArray &token)
+{
+    tokens.remove(token);
+}
+
+void SessionStore::expireIdle()
+{
+    // Sweep at most once a minute so issuing stays cheap
+    qint64 now = clock.elapsed();
+    if (now - lastSweep < 60 * 1000) {
+        return;
+    }
+    lastSweep = now;
+
+    for (auto it = tokens.begin(); it != tokens.end();) {
+        if (now - it->lastUsed > idleTimeout) {
+            it = tokens.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
@@ -0,0 +1,39 @@
+#ifndef SESSIONSTORE_H
+#define SESSIONSTORE_H
+
+#include <QHash>
+#include <QByteArray>
+#include <QElapsedTimer>
+
+#include "user.h"
+
+// In-memory table of opaque session tokens handed out at login.
+// Resuming a session is a single hash lookup, no password check or SQL.
+class SessionStore
+{
+public:
+    explicit SessionStore(qint64 idleTimeoutMs = 24 * 60 * 60 * 1000);
+
+    QByteArray issue(const User &user);
+    bool resume(const QByteArray &token, User &user);
+    void revoke(const QByteArray &token);
+
+    int size() const { return tokens.size(); }
+
+private:
+    struct Entry {
+        int userId;
+        QString username;
+        QString email;
+        qint64 lastUsed;   // ms on clock
+    };
+
+    void expireIdle();
+
+    QHash<QByteArray, Entry> tokens;
+    QElapsedTimer clock;
+    qint64 idleTimeout;
+    qint64 lastSweep;
+};
+
+#endif // SESSIONSTORE_H
@@ -0,0 +1,92 @@
+#include "thumbnailer.h"
+
+#include <QImageReader>
+#include <QImage>
+#include <QFileInfo>
+#include <QDir>
+#include <QSaveFile>
+#include <QPointer>
+#include <QDebug>
+
+Thumbnailer::Thumbnailer(QObject *parent)
+    : QObject(parent)
+{
+    // Leave most cores to the event loop and SQLite
+    pool.setMaxThreadCount(qMax(1, QThread::idealThreadCount() / 2));
+}
+
+Thumbnailer::~Thumbnailer()
+{
+    pool.clear();
+    pool.waitForDone();
+}
+
+bool Thumbnailer::looksLikeImage(const QString &fileName)
+{
+    static const QList<QByteArray> formats = QImageReader::supportedImageFormats();
+    return formats.contains(QFileInfo(fileName).suffix().toLower().toLatin1());
+}
+
+void Thumbnailer::request(const QString &sha256, const QString &sourcePath, const QString &targetPath)
+{
+    if (inFlight.contains(sha256)) {
+        return;
+    }
+    inFlight.insert(sha256);
+
+    QPointer<Thumbnailer> self(this);
+    pool.start([self, sha256, sourcePath, targetPath]() {
+        int width = 0;
+        int height = 0;
+        qint64 size = 0;
+
+        QImageReader reader(sourcePath);
+        reader.setAutoTransform(true);
+
+        QSize sourceSize = reader.size();
+        if (reader.canRead() && sourceSize.isValid()
+            && qint64(sourceSize.width()) * sourceSize.height() <= MaxSourcePixels) {
+            // Decode straight to the target size, JPEG readers skip most of the work
+            QSize scaled = sourceSize;
+            if (scaled.width() > MaxEdge || scaled.height() > MaxEdge) {
+                scaled.scale(MaxEdge, MaxEdge, Qt::KeepAspectRatio);
+            }
+            reader.setScaledSize(scaled);
+
+            QImage image = reader.read();
+            if (!image.isNull()) {
+                QDir().mkpath(QFileInfo(targetPath).absolutePath());
+
+                // JPEG is far smaller, PNG only where transparency has to survive
+                const char *format = image.hasAlphaChannel() ? "PNG" : "JPEG";
+
+                QSaveFile file(targetPath);
+                if (file.open(QIODevice::WriteOnly) && image.save(&file, format, Quality) && file.commit()) {
+                    width = image.width();
+                    height = image.height();
+                    size = QFileInfo(targetPath).size();
+                }
+            }
+        }
+
+        if (self) {
+            QMetaObject::invokeMethod(self, [self, sha256, width, height, size]() {
+                if (self) {
+                    self->finished(sha256, width, height, size);
+                }
+            }, Qt::QueuedConnection);
+        }
+    });
+}
+
+void Thumbnailer::finished(const QString &sha256, int width, int height, qint64 size)
+{
+    inFlight.remove(sha256);
+
+    if (size > 0) {
+        emit thumbnailReady(sha256, width, height, size);
+    } else {
+        qInfo() << "No thumbnail for" << sha256 << "(not a readable image)";
+        emit thumbnailFailed(sha256);
+    }
+}
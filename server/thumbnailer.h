@@ -0,0 +1,44 @@
+#ifndef THUMBNAILER_H
+#define THUMBNAILER_H
+
+#include <QObject>
+#include <QThreadPool>
+#include <QSet>
+#include <QString>
+
+// Generates preview images for uploaded pictures on a small worker pool.
+// Decoding uses QImageReader's scaled decode, so even a large photo is
+// never expanded to full resolution in memory. Results are written next
+// to the object store and reported back on the owning thread.
+class Thumbnailer : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit Thumbnailer(QObject *parent = nullptr);
+    ~Thumbnailer();
+
+    // Queues a thumbnail for sourcePath unless one is already being made
+    void request(const QString &sha256, const QString &sourcePath, const QString &targetPath);
+
+    // Cheap check on the file name, the worker decides from the content
+    static bool looksLikeImage(const QString &fileName);
+
+    int pending() const { return inFlight.size(); }
+
+signals:
+    void thumbnailReady(const QString &sha256, int width, int height, qint64 size);
+    void thumbnailFailed(const QString &sha256);
+
+private:
+    void finished(const QString &sha256, int width, int height, qint64 size);
+
+    QThreadPool pool;
+    QSet<QString> inFlight;
+
+    static constexpr int MaxEdge = 320;             // longest side of a thumbnail, px
+    static constexpr int Quality = 80;              // JPEG quality, PNG compression
+    static constexpr qint64 MaxSourcePixels = 100 * 1000 * 1000;    // refuse decompression bombs
+};
+
+#endif // THUMBNAILER_H
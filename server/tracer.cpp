@@ -0,0 +1,120 @@
+#include "tracer.h"
+
+#include <QCoreApplication>
+#include <QJsonDocument>
+#include <QThread>
+#include <QDebug>
+
+Tracer &Tracer::instance()
+{
+    static Tracer tracer;
+    return tracer;
+}
+
+Tracer::Tracer()
+    : sampleEvery(1)
+    , requestCounter(0)
+    , requestDepth(0)
+    , sampling(false)
+    , firstEvent(true)
+    , pid(0)
+    , lastFlush(0)
+{
+}
+
+Tracer::~Tracer()
+{
+    close();
+}
+
+bool Tracer::open(const QString &path, int sampleEvery)
+{
+    close();
+
+    file.setFileName(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qWarning() << "Failed to open trace file:" << path << file.errorString();
+        return false;
+    }
+
+    this->sampleEvery = qMax(1, sampleEvery);
+    requestCounter = 0;
+    firstEvent = true;
+    pid = QCoreApplication::applicationPid();
+    clock.start();
+    lastFlush = 0;
+
+    buffer = "[\n";
+    return true;
+}
+
+void Tracer::close()
+{
+    if (!file.isOpen()) {
+        return;
+    }
+
+    buffer.append("\n]\n");
+    flush();
+    file.close();
+    sampling = false;
+}
+
+void Tracer::beginRequest()
+{
+    // Nested requests (e.g. sub-requests) follow the outer decision
+    if (requestDepth++ > 0 || !isEnabled()) {
+        return;
+    }
+
+    sampling = (requestCounter++ % sampleEvery) == 0;
+}
+
+void Tracer::endRequest()
+{
+    if (requestDepth > 0 && --requestDepth == 0) {
+        sampling = false;
+    }
+}
+
+void Tracer::addCompleteEvent(const char *name, const char *category,
+                              qint64 startNsecs, qint64 endNsecs, const QJsonObject &args)
+{
+    if (!isEnabled()) {
+        return;
+    }
+
+    if (!firstEvent) {
+        buffer.append(",\n");
+    }
+    firstEvent = false;
+
+    // Timestamps are in microseconds, fractions keep sub-microsecond spans visible
+    buffer.append("{\"name\":\"").append(name)
+          .append("\",\"cat\":\"").append(category)
+          .append("\",\"ph\":\"X\",\"ts\":").append(QByteArray::number(startNsecs / 1000.0, 'f', 3))
+          .append(",\"dur\":").append(QByteArray::number((endNsecs - startNsecs) / 1000.0, 'f', 3))
+          .append(",\"pid\":").append(QByteArray::number(pid))
+          .append(",\"tid\":").append(QByteArray::number(quintptr(QThread::currentThreadId())));
+
+    if (!args.isEmpty()) {
+        buffer.append(",\"args\":").append(QJsonDocument(args).toJson(QJsonDocument::Compact));
+    }
+    buffer.append('}');
+
+    if (buffer.size() >= FlushThreshold || endNsecs - lastFlush >= FlushInterval) {
+        flush();
+    }
+}
+
+void Tracer::flush()
+{
+    if (buffer.isEmpty()) {
+        return;
+    }
+
+    file.write(buffer);
+    file.flush();
+    buffer.clear();
+    lastFlush = clock.isValid() ? clock.nsecsElapsed() : 0;
+}
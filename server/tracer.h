@@ -0,0 +1,99 @@
+#ifndef TRACER_H
+#define TRACER_H
+
+#include <QFile>
+#include <QByteArray>
+#include <QJsonObject>
+#include <QElapsedTimer>
+
+// Opt-in request tracing written as Chrome/Perfetto trace-event JSON.
+// Only one in every N requests is sampled; spans outside a sampled
+// request cost a single branch.
+class Tracer
+{
+public:
+    static Tracer &instance();
+
+    bool open(const QString &path, int sampleEvery);
+    void close();
+
+    bool isEnabled() const { return file.isOpen(); }
+    bool isActive() const { return sampling; }
+
+    // Request scope, decides whether the spans inside it are recorded
+    void beginRequest();
+    void endRequest();
+
+    qint64 now() const { return clock.nsecsElapsed(); }
+    void addCompleteEvent(const char *name, const char *category,
+                          qint64 startNsecs, qint64 endNsecs, const QJsonObject &args);
+
+private:
+    Tracer();
+    ~Tracer();
+
+    void flush();
+
+    QFile file;
+    QByteArray buffer;
+    QElapsedTimer clock;
+    int sampleEvery;
+    quint64 requestCounter;
+    int requestDepth;
+    bool sampling;
+    bool firstEvent;
+    qint64 pid;
+    qint64 lastFlush;
+
+    // Flush by size, or by age so a killed server still leaves a usable trace
+    static const int FlushThreshold = 64 * 1024;
+    static const qint64 FlushInterval = 1000000000; // ns
+};
+
+// Records one complete ("X") event spanning its own lifetime
+class TraceSpan
+{
+public:
+    TraceSpan(const char *name, const char *category)
+        : name(name)
+        , category(category)
+        , start(Tracer::instance().isActive() ? Tracer::instance().now() : -1)
+    {
+    }
+
+    ~TraceSpan()
+    {
+        if (start >= 0) {
+            Tracer &tracer = Tracer::instance();
+            tracer.addCompleteEvent(name, category, start, tracer.now(), args);
+        }
+    }
+
+    void setArg(const QString &key, const QJsonValue &value)
+    {
+        if (start >= 0) {
+            args.insert(key, value);
+        }
+    }
+
+private:
+    Q_DISABLE_COPY(TraceSpan)
+
+    const char *name;
+    const char *category;
+    qint64 start;
+    QJsonObject args;
+};
+
+// Marks one inbound frame as a traceable request
+class TraceRequest
+{
+public:
+    TraceRequest() { Tracer::instance().beginRequest(); }
+    ~TraceRequest() { Tracer::instance().endRequest(); }
+
+private:
+    Q_DISABLE_COPY(TraceRequest)
+};
+
+#endif // TRACER_H
@@ -0,0 +1,91 @@
+#include "trafficrecorder.h"
+
+#include <QDateTime>
+#include <QtEndian>
+#include <QDebug>
+
+namespace {
+
+template <typename T>
+void appendLittleEndian(QByteArray &buffer, T value)
+{
+    char bytes[sizeof(T)];
+    qToLittleEndian(value, bytes);
+    buffer.append(bytes, sizeof(T));
+}
+
+} // namespace
+
+TrafficRecorder::TrafficRecorder()
+    : lastFlush(0)
+    , records(0)
+{
+}
+
+TrafficRecorder::~TrafficRecorder()
+{
+    close();
+}
+
+bool TrafficRecorder::open(const QString &path)
+{
+    close();
+
+    file.setFileName(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        qWarning() << "Failed to open capture file:" << path << file.errorString();
+        return false;
+    }
+
+    buffer.clear();
+    buffer.append(Magic, MagicSize);
+    appendLittleEndian<quint8>(buffer, Version);
+    appendLittleEndian<quint16>(buffer, 0);
+    appendLittleEndian<quint64>(buffer, quint64(QDateTime::currentMSecsSinceEpoch()));
+
+    clock.start();
+    lastFlush = 0;
+    records = 0;
+    return true;
+}
+
+void TrafficRecorder::close()
+{
+    if (!file.isOpen()) {
+        return;
+    }
+
+    flush();
+    file.close();
+}
+
+void TrafficRecorder::record(RecordType type, quint32 connectionId, const QByteArray &payload)
+{
+    if (!file.isOpen()) {
+        return;
+    }
+
+    qint64 now = clock.nsecsElapsed();
+    appendLittleEndian<quint64>(buffer, quint64(now / 1000));
+    appendLittleEndian<quint32>(buffer, connectionId);
+    appendLittleEndian<quint8>(buffer, type);
+    appendLittleEndian<quint32>(buffer, quint32(payload.size()));
+    buffer.append(payload);
+    ++records;
+
+    if (buffer.size() >= FlushThreshold || now - lastFlush >= FlushInterval) {
+        flush();
+    }
+}
+
+void TrafficRecorder::flush()
+{
+    if (buffer.isEmpty()) {
+        return;
+    }
+
+    file.write(buffer);
+    file.flush();
+    buffer.clear();
+    lastFlush = clock.nsecsElapsed();
+}
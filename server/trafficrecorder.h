@@ -0,0 +1,59 @@
+#ifndef TRAFFICRECORDER_H
+#define TRAFFICRECORDER_H
+
+#include <QFile>
+#include <QByteArray>
+#include <QElapsedTimer>
+
+// Captures every inbound frame to a compact binary file for later replay.
+//
+// File layout, all integers little-endian:
+//   header  "QMCAP" | u8 version | u16 reserved | u64 capture start (ms since epoch)
+//   record  u64 offset (us since start) | u32 connection id | u8 type | u32 length | payload
+// Open and close records have an empty payload; frame records hold one
+// request line without its newline.
+class TrafficRecorder
+{
+public:
+    enum RecordType : quint8 {
+        ConnectionOpened = 0,
+        FrameReceived = 1,
+        ConnectionClosed = 2
+    };
+
+    static constexpr char Magic[] = "QMCAP";
+    static constexpr int MagicSize = 5;
+    static constexpr quint8 Version = 1;
+    static constexpr int HeaderSize = 16;
+    static constexpr int RecordHeaderSize = 17;
+
+    TrafficRecorder();
+    ~TrafficRecorder();
+
+    bool open(const QString &path);
+    void close();
+    bool isRecording() const { return file.isOpen(); }
+
+    void recordOpen(quint32 connectionId) { record(ConnectionOpened, connectionId, QByteArray()); }
+    void recordFrame(quint32 connectionId, const QByteArray &frame) { record(FrameReceived, connectionId, frame); }
+    void recordClose(quint32 connectionId) { record(ConnectionClosed, connectionId, QByteArray()); }
+
+    quint64 recordCount() const { return records; }
+
+private:
+    void record(RecordType type, quint32 connectionId, const QByteArray &payload);
+    void flush();
+
+    QFile file;
+    QByteArray buffer;
+    QElapsedTimer clock;
+    qint64 lastFlush;
+    quint64 records;
+
+    // Same policy as the tracer: flush by size, or by age so a killed
+    // server still leaves a usable capture
+    static constexpr int FlushThreshold = 64 * 1024;
+    static constexpr qint64 FlushInterval = 1000000000; // ns
+};
+
+#endif // TRAFFICRECORDER_H
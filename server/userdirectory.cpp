@@ -0,0 +1,85 @@
+#include "userdirectory.h"
+
+#include <algorithm>
+
+UserDirectory::Entry UserDirectory::makeEntry(int id, const QString &username)
+{
+    // Most names are lower case already, share the string instead of copying
+    QString folded = username.toCaseFolded();
+
+    Entry entry;
+    entry.key = folded == username ? username : folded;
+    entry.username = username;
+    entry.id = id;
+    return entry;
+}
+
+void UserDirectory::build(const QList<User> &users)
+{
+    entries.clear();
+    emails.clear();
+    entries.reserve(users.size());
+    emails.reserve(users.size());
+    for (const User &user : users) {
+        entries.append(makeEntry(user.id, user.username));
+        emails.insert(user.email.toCaseFolded(), qMakePair(user.id, user.username));
+    }
+    std::sort(entries.begin(), entries.end());
+}
+
+void UserDirectory::add(const User &user)
+{
+    // A sorted insert moves the tail, cheap next to a registration
+    Entry entry = makeEntry(user.id, user.username);
+    entries.insert(std::upper_bound(entries.begin(), entries.end(), entry), entry);
+    emails.insert(user.email.toCaseFolded(), qMakePair(user.id, user.username));
+}
+
+bool UserDirectory::find(const QString &usernameOrEmail, int &id, QString &username) const
+{
+    Entry probe;
+    probe.key = usernameOrEmail.toCaseFolded();
+    probe.id = -1;
+
+    if (usernameOrEmail.contains('@')) {
+        auto it = emails.constFind(probe.key);
+        if (it == emails.constEnd()) {
+            return false;
+        }
+        id = it->first;
+        username = it->second;
+        return true;
+    }
+
+    auto range = std::equal_range(entries.begin(), entries.end(), probe);
+    if (range.first == range.second) {
+        return false;
+    }
+
+    auto match = range.first;
+    for (auto it = range.first; it != range.second; ++it) {
+        if (it->username == usernameOrEmail) {
+            match = it;
+            break;
+        }
+    }
+    id = match->id;
+    username = match->username;
+    return true;
+}
+
+QList<QPair<int, QString>> UserDirectory::search(const QString &prefix, int limit) const
+{
+    QList<QPair<int, QString>> results;
+
+    Entry probe;
+    probe.key = prefix.toCaseFolded();
+    probe.id = -1;
+
+    for (auto it = std::lower_bound(entries.begin(), entries.end(), probe);
+         it != entries.end() && results.size() < limit && it->key.startsWith(probe.key); ++it) {
+        results.append(qMakePair(it->id, it->username));
+    }
+
+    return results;
+}
@@ -0,0 +1,48 @@
+#ifndef USERDIRECTORY_H
+#define USERDIRECTORY_H
+
+#include <QHash>
+#include <QList>
+#include <QPair>
+#include <QString>
+#include <QVector>
+
+#include "user.h"
+
+// Every username in memory, sorted by its case-folded form, so prefix
+// lookups for autocomplete are a binary search plus a short scan instead
+// of a LIKE query. Emails are hashed for address book matching. Built
+// once at startup and kept current on register.
+class UserDirectory
+{
+public:
+    // Replaces the contents, takes users in any order
+    void build(const QList<User> &users);
+    void add(const User &user);
+
+    // Exact username or email, ignoring case; an exact-case username wins
+    // over one that only differs in case
+    bool find(const QString &usernameOrEmail, int &id, QString &username) const;
+
+    // Up to limit (id, username) pairs whose name starts with prefix,
+    // ignoring case, in name order
+    QList<QPair<int, QString>> search(const QString &prefix, int limit) const;
+
+    int size() const { return entries.size(); }
+
+private:
+    struct Entry {
+        QString key;        // case-folded, shares the username when equal
+        QString username;
+        int id;
+
+        bool operator<(const Entry &other) const { return key < other.key; }
+    };
+
+    static Entry makeEntry(int id, const QString &username);
+
+    QVector<Entry> entries;
+    QHash<QString, QPair<int, QString>> emails;     // folded email -> id, username
+};
+
+#endif // USERDIRECTORY_H
@@ -0,0 +1,165 @@
+#include <QtTest>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QLoggingCategory>
+#include <QSqlDatabase>
+#include <QSqlQuery>
+#include <QTcpSocket>
+#include <QTemporaryDir>
+
+#include "server.h"
+#include "database.h"
+
+// Socket that keeps everything written to it, one JSON frame per line
+class CaptureSocket : public QTcpSocket
+{
+public:
+    CaptureSocket() { setOpenMode(QIODevice::ReadWrite); }
+
+    QList<QJsonObject> frames() const
+    {
+        QList<QJsonObject> result;
+        const QList<QByteArray> lines = written.split('\n');
+        for (const QByteArray &line : lines) {
+            if (!line.isEmpty()) {
+                result.append(QJsonDocument::fromJson(line).object());
+            }
+        }
+        return result;
+    }
+
+protected:
+    qint64 writeData(const char *data, qint64 length) override
+    {
+        written.append(data, length);
+        return length;
+    }
+
+private:
+    QByteArray written;
+};
+
+// Server behaviour that needs the database, driven through handleRequest
+// on a fresh database per test.
+class ServerTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void init();
+    void cleanup();
+
+    void batchPushesAfterCommit();
+    void batchCommitFailureDropsPushes();
+
+private:
+    QJsonObject sendMessageBatch(const QString &clientMessageId) const;
+
+    QTemporaryDir workDir;
+    Database *database = nullptr;
+    int senderId = -1;
+    int receiverId = -1;
+};
+
+void ServerTest::initTestCase()
+{
+    QVERIFY(workDir.isValid());
+    QLoggingCategory::setFilterRules("messenger.request.debug=false\nmessenger.request.info=false");
+}
+
+void ServerTest::init()
+{
+    QString path = workDir.filePath(QString("%1.db").arg(QTest::currentTestFunction()));
+    QFile::remove(path);
+
+    database = new Database;
+    QVERIFY(database->initialize(path));
+
+    User sender;
+    sender.username = "sender";
+    sender.email = "sender@test.localhost";
+    sender.password = "password";
+    QVERIFY(database->addUser(sender));
+    senderId = sender.id;
+
+    User receiver;
+    receiver.username = "receiver";
+    receiver.email = "receiver@test.localhost";
+    receiver.password = "password";
+    QVERIFY(database->addUser(receiver));
+    receiverId = receiver.id;
+}
+
+void ServerTest::cleanup()
+{
+    delete database;
+    database = nullptr;
+    QSqlDatabase::removeDatabase(QSqlDatabase::defaultConnection);
+}
+
+QJsonObject ServerTest::sendMessageBatch(const QString &clientMessageId) const
+{
+    QJsonObject sendMessage;
+    sendMessage["action"] = "sendMessage";
+    sendMessage["senderId"] = senderId;
+    sendMessage["receiverId"] = receiverId;
+    sendMessage["content"] = "hello";
+    sendMessage["clientMessageId"] = clientMessageId;
+
+    QJsonObject batch;
+    batch["action"] = "batch";
+    batch["requests"] = QJsonArray{ sendMessage };
+    return batch;
+}
+
+void ServerTest::batchPushesAfterCommit()
+{
+    Server server(0, database);
+    CaptureSocket sender;
+    CaptureSocket receiver;
+    server.userConnections.insert(receiverId, &receiver);
+
+    server.handleRequest(&sender, sendMessageBatch("committed"));
+
+    const QList<QJsonObject> responses = sender.frames();
+    QCOMPARE(responses.size(), 1);
+    QCOMPARE(responses.first()["status"].toString(), QString("success"));
+    int messageId = responses.first()["responses"].toArray().first()["messageId"].toInt();
+    QVERIFY(messageId > 0);
+
+    const QList<QJsonObject> pushes = receiver.frames();
+    QCOMPARE(pushes.size(), 1);
+    QCOMPARE(pushes.first()["action"].toString(), QString("message"));
+    QCOMPARE(pushes.first()["id"].toInt(), messageId);
+}
+
+void ServerTest::batchCommitFailureDropsPushes()
+{
+    // A deferred foreign key that every new message breaks only fails at COMMIT
+    QSqlQuery query;
+    QVERIFY(query.exec("PRAGMA foreign_keys = ON"));
+    QVERIFY(query.exec("CREATE TABLE commit_guard (user_id INTEGER "
+                       "REFERENCES users(id) DEFERRABLE INITIALLY DEFERRED)"));
+    QVERIFY(query.exec("CREATE TRIGGER commit_guard_insert AFTER INSERT ON messages "
+                       "BEGIN INSERT INTO commit_guard VALUES (-1); END"));
+
+    Server server(0, database);
+    CaptureSocket sender;
+    CaptureSocket receiver;
+    server.userConnections.insert(receiverId, &receiver);
+
+    server.handleRequest(&sender, sendMessageBatch("rolled-back"));
+
+    const QList<QJsonObject> responses = sender.frames();
+    QCOMPARE(responses.size(), 1);
+    QCOMPARE(responses.first()["status"].toString(), QString("error"));
+
+    QVERIFY(receiver.frames().isEmpty());
+    QCOMPARE(server.recentMessageIds.find(senderId, "rolled-back"), -1);
+    QCOMPARE(database->findMessageByClientId(senderId, "rolled-back"), -1);
+}
+
+QTEST_GUILESS_MAIN(ServerTest)
+
+#include "servertest.moc"
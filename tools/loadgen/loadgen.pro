@@ -0,0 +1,22 @@
+QT += core network
+QT -= gui
+
+TARGET = QtMessengerLoadGen
+TEMPLATE = app
+
+CONFIG += c++17 console
+CONFIG -= app_bundle
+
+# Speaks the same protocol as the client and reports with the server's histogram
+INCLUDEPATH += ../../client ../../server
+
+SOURCES += \
+    main.cpp \
+    loadgenerator.cpp \
+    ../../client/framedecoder.cpp \
+    ../../server/latencyhistogram.cpp
+
+HEADERS += \
+    loadgenerator.h \
+    ../../client/framedecoder.h \
+    ../../server/latencyhistogram.h
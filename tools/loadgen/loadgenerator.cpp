@@ -0,0 +1,517 @@
+#include "loadgenerator.h"
+
+#include <QDateTime>
+#include <QJsonDocument>
+#include <QRandomGenerator>
+#include <QTextStream>
+
+namespace {
+
+// Every synthetic user shares it, so reruns can log in again
+const char *SyntheticPassword = "loadgen";
+
+} // namespace
+
+LoadGenerator::LoadGenerator(const Options &options, QObject *parent)
+    : QObject(parent)
+    , options(options)
+    , phase(Connecting)
+    , connectTimer(new QTimer(this))
+    , requestTimer(new QTimer(this))
+    , progressTimer(new QTimer(this))
+    , connectsIssued(0)
+    , loggedInCount(0)
+    , graphOutstanding(0)
+    , runStartNsecs(0)
+    , runEndNsecs(0)
+    , requestsIssued(0)
+    , requestsSkipped(0)
+    , inFlight(0)
+    , disconnects(0)
+{
+    for (int i = 0; i < ActionCount; ++i) {
+        completed[i] = 0;
+        errors[i] = 0;
+    }
+
+    connectTimer->setInterval(10);
+    connect(connectTimer, &QTimer::timeout, this, &LoadGenerator::onConnectTick);
+
+    // Open-loop pacing, a coarse timer would bunch requests into bursts
+    requestTimer->setTimerType(Qt::PreciseTimer);
+    requestTimer->setInterval(1);
+    connect(requestTimer, &QTimer::timeout, this, &LoadGenerator::onRequestTick);
+
+    progressTimer->setInterval(1000);
+    connect(progressTimer, &QTimer::timeout, this, &LoadGenerator::onProgressTick);
+}
+
+LoadGenerator::~LoadGenerator()
+{
+    qDeleteAll(users);
+}
+
+void LoadGenerator::start()
+{
+    paddedContent = QString(qMax(1, options.messageSize), QChar('x'));
+
+    readySlot.fill(-1, options.users);
+    for (int i = 0; i < options.users; ++i) {
+        SimUser *user = new SimUser;
+        user->index = i;
+        user->username = QString("%1_%2").arg(options.prefix).arg(i);
+        user->socket = new QTcpSocket(this);
+
+        connect(user->socket, &QTcpSocket::connected, this, [this, user]() { onUserConnected(user); });
+        connect(user->socket, &QTcpSocket::disconnected, this, [this, user]() { onUserDisconnected(user); });
+        connect(user->socket, &QTcpSocket::readyRead, this, [this, user]() { onUserReadyRead(user); });
+        connect(user->socket, QOverload<QAbstractSocket::SocketError>::of(&QTcpSocket::errorOccurred),
+                this, [this, user](QAbstractSocket::SocketError error) {
+            // Failed connects never emit disconnected
+            if (error != QAbstractSocket::ConnectionRefusedError && error != QAbstractSocket::SocketTimeoutError) {
+                return;
+            }
+            if (loggedInCount == 0 && error == QAbstractSocket::ConnectionRefusedError) {
+                fail(QString("Cannot connect to %1:%2, is the server running?").arg(options.host).arg(options.port));
+                return;
+            }
+            onUserDisconnected(user);
+        });
+
+        users.append(user);
+    }
+
+    qInfo() << "Connecting" << options.users << "users to" << options.host << ":" << options.port
+            << "at" << options.connectRate << "connections/s";
+
+    clock.start();
+    connectTimer->start();
+    onConnectTick();
+}
+
+void LoadGenerator::onConnectTick()
+{
+    // Ramp up below the server's admission limit instead of tripping it
+    int due = options.users;
+    if (options.connectRate > 0) {
+        due = qMin<qint64>(options.users, clock.elapsed() * options.connectRate / 1000 + 1);
+    }
+
+    while (connectsIssued < due) {
+        connectUser(users[connectsIssued++]);
+    }
+
+    if (connectsIssued == options.users) {
+        connectTimer->stop();
+    }
+}
+
+void LoadGenerator::connectUser(SimUser *user)
+{
+    if (phase == Done || user->socket->state() != QAbstractSocket::UnconnectedState) {
+        return;
+    }
+    user->socket->connectToHost(options.host, options.port);
+}
+
+void LoadGenerator::onUserConnected(SimUser *user)
+{
+    user->decoder.reset();
+    user->retryAfter = 0;
+
+    qint64 now = clock.nsecsElapsed();
+    if (user->userId < 0) {
+        // Registering an existing user fails harmlessly, the login below still works
+        QJsonObject request;
+        request["action"] = "register";
+        request["username"] = user->username;
+        request["email"] = user->username + "@loadgen.localhost";
+        request["password"] = SyntheticPassword;
+        send(user, Register, request, now, false);
+    }
+
+    QJsonObject login;
+    login["action"] = "login";
+    login["username"] = user->username;
+    login["password"] = SyntheticPassword;
+    send(user, Login, login, now, false);
+}
+
+void LoadGenerator::onUserDisconnected(SimUser *user)
+{
+    if (user->ready) {
+        // Swap-remove from the ready list
+        int slot = readySlot[user->index];
+        int last = readyUsers.takeLast();
+        if (last != user->index) {
+            readyUsers[slot] = last;
+            readySlot[last] = slot;
+        }
+        readySlot[user->index] = -1;
+        user->ready = false;
+    }
+
+    // Requests still queued on this connection will never be answered
+    while (!user->pending.isEmpty()) {
+        Pending pending = user->pending.dequeue();
+        ++errors[pending.action];
+        if (pending.measured) {
+            --inFlight;
+        }
+        if (pending.action == AddContact && --graphOutstanding == 0 && phase == BuildingGraph) {
+            beginRun();
+        }
+    }
+
+    if (phase == Done || phase == Draining) {
+        if (phase == Draining && inFlight == 0) {
+            finish();
+        }
+        return;
+    }
+
+    if (user->retryAfter == 0) {
+        ++disconnects;
+    }
+
+    // Honour the server's busy hint, otherwise back off for a second
+    qint64 delay = qMax<qint64>(user->retryAfter, 1000);
+    user->retryAfter = 0;
+    QTimer::singleShot(int(delay), this, [this, user]() { connectUser(user); });
+}
+
+void LoadGenerator::onUserReadyRead(SimUser *user)
+{
+    user->decoder.append(user->socket->readAll());
+
+    QJsonObject frame;
+    while (true) {
+        FrameDecoder::Result result = user->decoder.next(frame);
+        if (result == FrameDecoder::NeedMoreData) {
+            break;
+        }
+        if (result == FrameDecoder::InvalidFrame) {
+            continue;
+        }
+
+        QString action = frame["action"].toString();
+        if (action == "busy") {
+            user->retryAfter = qMax<qint64>(1, qint64(frame["retryAfter"].toDouble()));
+            continue;
+        }
+
+        // Responses come back in request order; anything else is a push
+        // such as an incoming message and is ignored
+        if (user->pending.isEmpty() || action != actionName(user->pending.head().action)) {
+            continue;
+        }
+
+        Pending pending = user->pending.dequeue();
+        handleResponse(user, pending, frame);
+
+        if (phase == Done) {
+            return;
+        }
+    }
+}
+
+void LoadGenerator::handleResponse(SimUser *user, const Pending &pending, const QJsonObject &response)
+{
+    bool success = response["status"].toString() == "success";
+
+    if (success) {
+        ++completed[pending.action];
+        latencies[pending.action].record((clock.nsecsElapsed() - pending.startNsecs) / 1000);
+    } else {
+        ++errors[pending.action];
+    }
+
+    if (pending.measured) {
+        --inFlight;
+    }
+
+    switch (pending.action) {
+    case Login:
+        if (!success) {
+            if (user->userId < 0) {
+                fail(QString("Login failed for %1: %2").arg(user->username, response["message"].toString()));
+            }
+            return;
+        }
+
+        if (user->userId < 0) {
+            user->userId = response["user"].toObject()["id"].toInt();
+            ++loggedInCount;
+        }
+
+        user->ready = true;
+        readySlot[user->index] = readyUsers.size();
+        readyUsers.append(user->index);
+
+        if (phase == Connecting && loggedInCount == options.users) {
+            beginGraph();
+        }
+        break;
+
+    case AddContact:
+        // Contacts are bidirectional; left over from an earlier run is fine too
+        if (success || response["message"].toString().contains("already")) {
+            linkUsers(user->index, pending.peer);
+        }
+        if (--graphOutstanding == 0 && phase == BuildingGraph) {
+            beginRun();
+        }
+        break;
+
+    default:
+        break;
+    }
+
+    if (phase == Draining && inFlight == 0) {
+        finish();
+    }
+}
+
+void LoadGenerator::send(SimUser *user, Action action, QJsonObject request, qint64 startNsecs, bool measured, int peer)
+{
+    QByteArray data = QJsonDocument(request).toJson(QJsonDocument::Compact);
+    data.append('\n');
+    user->socket->write(data);
+
+    user->pending.enqueue({ action, startNsecs, measured, peer });
+    if (measured) {
+        ++inFlight;
+    }
+}
+
+void LoadGenerator::linkUsers(int a, int b)
+{
+    if (!users[a]->contacts.contains(b)) {
+        users[a]->contacts.append(b);
+    }
+    if (!users[b]->contacts.contains(a)) {
+        users[b]->contacts.append(a);
+    }
+}
+
+void LoadGenerator::beginGraph()
+{
+    phase = BuildingGraph;
+    qInfo() << "All" << options.users << "users logged in after" << clock.elapsed() << "ms, building contact graph";
+
+    QRandomGenerator *random = QRandomGenerator::global();
+    int perUser = qMin(options.contactsPerUser, options.users - 1);
+
+    for (SimUser *user : users) {
+        QVector<int> chosen;
+        while (chosen.size() < perUser) {
+            int peer = random->bounded(options.users);
+            if (peer != user->index && !chosen.contains(peer)) {
+                chosen.append(peer);
+            }
+        }
+
+        for (int peer : chosen) {
+            QJsonObject request;
+            request["action"] = "addContact";
+            request["userId"] = user->userId;
+            request["contactUsername"] = users[peer]->username;
+            send(user, AddContact, request, clock.nsecsElapsed(), false, peer);
+            ++graphOutstanding;
+        }
+    }
+
+    if (graphOutstanding == 0) {
+        beginRun();
+    }
+}
+
+void LoadGenerator::beginRun()
+{
+    phase = Running;
+    qInfo() << "Running for" << options.durationSecs << "s at" << options.rate << "requests/s";
+
+    runStartNsecs = clock.nsecsElapsed();
+    requestTimer->start();
+    progressTimer->start();
+}
+
+void LoadGenerator::onRequestTick()
+{
+    qint64 elapsed = clock.nsecsElapsed() - runStartNsecs;
+    if (elapsed >= qint64(options.durationSecs) * 1000000000) {
+        beginDrain();
+        return;
+    }
+
+    // Every request has a fixed slot in the schedule and its latency is
+    // measured from that slot, so a stalled server cannot hide its backlog
+    // by slowing the generator down (coordinated omission)
+    qint64 due = qint64(elapsed * options.rate / 1e9);
+    while (requestsIssued < due) {
+        qint64 scheduled = runStartNsecs + qint64(requestsIssued * 1e9 / options.rate);
+        issueRandomRequest(scheduled);
+        ++requestsIssued;
+    }
+}
+
+void LoadGenerator::issueRandomRequest(qint64 scheduledNsecs)
+{
+    if (readyUsers.isEmpty()) {
+        ++requestsSkipped;
+        return;
+    }
+
+    QRandomGenerator *random = QRandomGenerator::global();
+    SimUser *user = users[readyUsers[random->bounded(readyUsers.size())]];
+
+    int totalWeight = options.sendWeight + options.contactsWeight + options.historyWeight;
+    int pick = random->bounded(totalWeight);
+
+    Action action = GetContacts;
+    if (pick < options.sendWeight) {
+        action = SendMessage;
+    } else if (pick >= options.sendWeight + options.contactsWeight && !user->contacts.isEmpty()) {
+        action = GetChatHistory;
+    }
+
+    QJsonObject request;
+    if (action == SendMessage) {
+        int peer = user->contacts.isEmpty() ? (user->index + 1) % options.users
+                                            : user->contacts[random->bounded(user->contacts.size())];
+        request["action"] = "sendMessage";
+        request["senderId"] = user->userId;
+        request["receiverId"] = users[peer]->userId;
+        request["content"] = paddedContent;
+        request["type"] = "text";
+        request["timestamp"] = QDateTime::currentDateTime().toString(Qt::ISODate);
+    } else if (action == GetChatHistory) {
+        int peer = user->contacts[random->bounded(user->contacts.size())];
+        request["action"] = "getChatHistory";
+        request["userId"] = user->userId;
+        request["contactId"] = users[peer]->userId;
+    } else {
+        request["action"] = "getContacts";
+        request["userId"] = user->userId;
+    }
+
+    send(user, action, request, scheduledNsecs, true);
+}
+
+void LoadGenerator::onProgressTick()
+{
+    qint64 done = completed[SendMessage] + completed[GetContacts] + completed[GetChatHistory];
+    qint64 failed = errors[SendMessage] + errors[GetContacts] + errors[GetChatHistory];
+
+    qInfo().noquote() << QString("[%1s] issued %2, completed %3, errors %4, in flight %5, users online %6")
+                         .arg((clock.nsecsElapsed() - runStartNsecs) / 1000000000)
+                         .arg(requestsIssued).arg(done).arg(failed).arg(inFlight).arg(readyUsers.size());
+}
+
+void LoadGenerator::beginDrain()
+{
+    phase = Draining;
+    runEndNsecs = clock.nsecsElapsed();
+    requestTimer->stop();
+
+    if (inFlight == 0) {
+        finish();
+        return;
+    }
+
+    // Give outstanding requests a moment, then report them as unanswered
+    QTimer::singleShot(5000, this, &LoadGenerator::finish);
+}
+
+void LoadGenerator::finish()
+{
+    if (phase == Done) {
+        return;
+    }
+
+    phase = Done;
+    connectTimer->stop();
+    requestTimer->stop();
+    progressTimer->stop();
+
+    report();
+
+    for (SimUser *user : users) {
+        user->socket->abort();
+    }
+
+    emit finished(0);
+}
+
+void LoadGenerator::fail(const QString &reason)
+{
+    if (phase == Done) {
+        return;
+    }
+
+    phase = Done;
+    connectTimer->stop();
+    requestTimer->stop();
+    progressTimer->stop();
+
+    qCritical().noquote() << reason;
+    emit finished(1);
+}
+
+void LoadGenerator::report()
+{
+    double runSecs = qMax<qint64>(1, runEndNsecs - runStartNsecs) / 1e9;
+
+    QTextStream out(stdout);
+    out << "\n";
+    out << QString::asprintf("Run: %.1f s, %lld requests issued, %lld skipped, %lld unanswered, %lld disconnects\n\n",
+                             runSecs, requestsIssued, requestsSkipped, inFlight, disconnects);
+    out << QString::asprintf("%-16s %9s %8s %10s %9s %9s %9s %9s\n",
+                             "action", "ok", "errors", "ops/s", "p50 ms", "p99 ms", "p999 ms", "max ms");
+
+    LatencyHistogram runTotal;
+    qint64 runCompleted = 0;
+    qint64 runErrors = 0;
+
+    auto printRow = [&out](const char *name, const LatencyHistogram &histogram, qint64 ok, qint64 failed, double opsPerSecond) {
+        QString rate = opsPerSecond < 0 ? QString("-") : QString::number(opsPerSecond, 'f', 1);
+        out << QString::asprintf("%-16s %9lld %8lld %10s %9.2f %9.2f %9.2f %9.2f\n",
+                                 name, ok, failed, qPrintable(rate),
+                                 histogram.percentile(50) / 1000.0, histogram.percentile(99) / 1000.0,
+                                 histogram.percentile(99.9) / 1000.0, histogram.max() / 1000.0);
+    };
+
+    for (int i = 0; i < ActionCount; ++i) {
+        if (completed[i] == 0 && errors[i] == 0) {
+            continue;
+        }
+
+        // Setup traffic is not paced, so only the run mix gets a rate
+        bool measured = i == SendMessage || i == GetContacts || i == GetChatHistory;
+        printRow(actionName(Action(i)), latencies[i], completed[i], errors[i],
+                 measured ? (completed[i] + errors[i]) / runSecs : -1.0);
+
+        if (measured) {
+            runTotal.merge(latencies[i]);
+            runCompleted += completed[i];
+            runErrors += errors[i];
+        }
+    }
+
+    printRow("total (run)", runTotal, runCompleted, runErrors, (runCompleted + runErrors) / runSecs);
+    out.flush();
+}
+
+const char *LoadGenerator::actionName(Action action)
+{
+    switch (action) {
+    case Register: return "register";
+    case Login: return "login";
+    case AddContact: return "addContact";
+    case SendMessage: return "sendMessage";
+    case GetContacts: return "getContacts";
+    case GetChatHistory: return "getChatHistory";
+    case ActionCount: break;
+    }
+    return "unknown";
+}
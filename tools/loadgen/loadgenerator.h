@@ -0,0 +1,135 @@
+#ifndef LOADGENERATOR_H
+#define LOADGENERATOR_H
+
+#include <QObject>
+#include <QTcpSocket>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QJsonObject>
+#include <QQueue>
+#include <QVector>
+
+#include "framedecoder.h"
+#include "latencyhistogram.h"
+
+// Drives a local server with synthetic users speaking the normal wire
+// protocol: connect, register, log in, build a contact graph, then issue
+// an open-loop mix of requests at a fixed rate and report latencies.
+class LoadGenerator : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Options {
+        QString host = "127.0.0.1";
+        quint16 port = 8080;
+        QString prefix = "loadgen";
+        int users = 100;
+        int contactsPerUser = 5;
+        int connectRate = 100;      // new connections per second
+        double rate = 1000.0;       // requests per second, all users together
+        int durationSecs = 30;
+        int messageSize = 64;
+        int sendWeight = 70;
+        int contactsWeight = 10;
+        int historyWeight = 20;
+    };
+
+    explicit LoadGenerator(const Options &options, QObject *parent = nullptr);
+    ~LoadGenerator();
+
+    void start();
+
+signals:
+    void finished(int exitCode);
+
+private slots:
+    void onConnectTick();
+    void onRequestTick();
+    void onProgressTick();
+
+private:
+    enum Action {
+        Register,
+        Login,
+        AddContact,
+        SendMessage,
+        GetContacts,
+        GetChatHistory,
+        ActionCount
+    };
+
+    enum Phase {
+        Connecting,
+        BuildingGraph,
+        Running,
+        Draining,
+        Done
+    };
+
+    struct Pending {
+        Action action;
+        qint64 startNsecs;
+        bool measured;      // issued during the run phase
+        int peer;           // contact being added, -1 otherwise
+    };
+
+    struct SimUser {
+        int index = 0;
+        QString username;
+        int userId = -1;
+        bool ready = false;
+        QTcpSocket *socket = nullptr;
+        FrameDecoder decoder;
+        QQueue<Pending> pending;
+        QVector<int> contacts;      // indices into users
+        qint64 retryAfter = 0;
+    };
+
+    void connectUser(SimUser *user);
+    void onUserConnected(SimUser *user);
+    void onUserDisconnected(SimUser *user);
+    void onUserReadyRead(SimUser *user);
+    void handleResponse(SimUser *user, const Pending &pending, const QJsonObject &response);
+
+    void send(SimUser *user, Action action, QJsonObject request, qint64 startNsecs, bool measured, int peer = -1);
+    void issueRandomRequest(qint64 scheduledNsecs);
+    void linkUsers(int a, int b);
+
+    void beginGraph();
+    void beginRun();
+    void beginDrain();
+    void finish();
+    void report();
+    void fail(const QString &reason);
+
+    static const char *actionName(Action action);
+
+    Options options;
+    Phase phase;
+    QVector<SimUser*> users;
+    QVector<int> readyUsers;
+    QVector<int> readySlot;         // position of each user in readyUsers, -1 if absent
+
+    QTimer *connectTimer;
+    QTimer *requestTimer;
+    QTimer *progressTimer;
+    QElapsedTimer clock;
+
+    int connectsIssued;
+    int loggedInCount;
+    int graphOutstanding;
+    qint64 runStartNsecs;
+    qint64 runEndNsecs;
+    qint64 requestsIssued;
+    qint64 requestsSkipped;
+    qint64 inFlight;
+    qint64 disconnects;
+    QString paddedContent;
+
+    LatencyHistogram latencies[ActionCount];
+    qint64 completed[ActionCount];
+    qint64 errors[ActionCount];
+};
+
+#endif // LOADGENERATOR_H
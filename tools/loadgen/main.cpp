@@ -0,0 +1,137 @@
+#include "loadgenerator.h"
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QHostAddress>
+#include <QTimer>
+
+// Parses "send=70,contacts=10,history=20"; missing entries count as 0
+static bool parseMix(const QString &spec, LoadGenerator::Options &options)
+{
+    options.sendWeight = 0;
+    options.contactsWeight = 0;
+    options.historyWeight = 0;
+
+    for (const QString &entry : spec.split(',', Qt::SkipEmptyParts)) {
+        QStringList parts = entry.trimmed().split('=');
+        bool ok = false;
+        int weight = parts.size() == 2 ? parts[1].toInt(&ok) : 0;
+        if (!ok || weight < 0) {
+            return false;
+        }
+
+        QString name = parts[0].trimmed();
+        if (name == "send") {
+            options.sendWeight = weight;
+        } else if (name == "contacts") {
+            options.contactsWeight = weight;
+        } else if (name == "history") {
+            options.historyWeight = weight;
+        } else {
+            return false;
+        }
+    }
+
+    return options.sendWeight + options.contactsWeight + options.historyWeight > 0;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    app.setApplicationName("QtMessengerLoadGen");
+    app.setApplicationVersion("1.0.0");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Qt Messenger load generator");
+    parser.addHelpOption();
+    parser.addVersionOption();
+
+    QCommandLineOption hostOption(QStringList() << "host",
+                                 "Server address, must be local (default: 127.0.0.1).",
+                                 "host", "127.0.0.1");
+    parser.addOption(hostOption);
+
+    QCommandLineOption portOption(QStringList() << "p" << "port",
+                                 "Server port (default: 8080).",
+                                 "port", "8080");
+    parser.addOption(portOption);
+
+    QCommandLineOption usersOption(QStringList() << "u" << "users",
+                                  "Number of synthetic users, one connection each (default: 100).",
+                                  "n", "100");
+    parser.addOption(usersOption);
+
+    QCommandLineOption contactsOption(QStringList() << "contacts",
+                                     "Contacts each user adds before the run (default: 5).",
+                                     "n", "5");
+    parser.addOption(contactsOption);
+
+    QCommandLineOption connectRateOption(QStringList() << "connect-rate",
+                                        "New connections per second while logging in (default: 100, 0 = all at once).",
+                                        "rate", "100");
+    parser.addOption(connectRateOption);
+
+    QCommandLineOption rateOption(QStringList() << "r" << "rate",
+                                 "Requests per second across all users (default: 1000).",
+                                 "rate", "1000");
+    parser.addOption(rateOption);
+
+    QCommandLineOption durationOption(QStringList() << "d" << "duration",
+                                     "Length of the measured run in seconds (default: 30).",
+                                     "seconds", "30");
+    parser.addOption(durationOption);
+
+    QCommandLineOption mixOption(QStringList() << "mix",
+                                "Relative weights of the request mix (default: send=70,contacts=10,history=20).",
+                                "weights", "send=70,contacts=10,history=20");
+    parser.addOption(mixOption);
+
+    QCommandLineOption messageSizeOption(QStringList() << "message-size",
+                                        "Characters per sent message (default: 64).",
+                                        "n", "64");
+    parser.addOption(messageSizeOption);
+
+    QCommandLineOption prefixOption(QStringList() << "prefix",
+                                   "Username prefix of the synthetic users (default: loadgen).",
+                                   "prefix", "loadgen");
+    parser.addOption(prefixOption);
+
+    parser.process(app);
+
+    LoadGenerator::Options options;
+    options.host = parser.value(hostOption);
+    options.port = parser.value(portOption).toUShort();
+    options.prefix = parser.value(prefixOption);
+    options.users = parser.value(usersOption).toInt();
+    options.contactsPerUser = qMax(0, parser.value(contactsOption).toInt());
+    options.connectRate = qMax(0, parser.value(connectRateOption).toInt());
+    options.rate = parser.value(rateOption).toDouble();
+    options.durationSecs = parser.value(durationOption).toInt();
+    options.messageSize = parser.value(messageSizeOption).toInt();
+
+    // Load is only ever pointed at a server on this machine
+    QHostAddress address(options.host);
+    if (options.host != "localhost" && !address.isLoopback()) {
+        qCritical() << "Refusing to generate load against non-local host" << options.host;
+        return 1;
+    }
+
+    if (options.users < 2 || options.rate <= 0 || options.durationSecs <= 0) {
+        qCritical() << "Need at least 2 users, a positive rate and a positive duration";
+        return 1;
+    }
+
+    if (!parseMix(parser.value(mixOption), options)) {
+        qCritical() << "Invalid --mix:" << parser.value(mixOption);
+        return 1;
+    }
+
+    LoadGenerator generator(options);
+    QObject::connect(&generator, &LoadGenerator::finished, &app, &QCoreApplication::exit);
+
+    // Start once the event loop runs so early failures can still quit it
+    QTimer::singleShot(0, &generator, &LoadGenerator::start);
+
+    return app.exec();
+}
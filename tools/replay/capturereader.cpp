@@ -0,0 +1,54 @@
+#include "capturereader.h"
+
+#include <QtEndian>
+#include <cstring>
+
+bool CaptureReader::open(const QString &path)
+{
+    file.setFileName(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        error = file.errorString();
+        return false;
+    }
+
+    QByteArray header = file.read(TrafficRecorder::HeaderSize);
+    if (header.size() != TrafficRecorder::HeaderSize
+            || memcmp(header.constData(), TrafficRecorder::Magic, TrafficRecorder::MagicSize) != 0) {
+        error = "Not a capture file";
+        return false;
+    }
+
+    quint8 version = quint8(header[TrafficRecorder::MagicSize]);
+    if (version != TrafficRecorder::Version) {
+        error = QString("Unsupported capture version %1").arg(version);
+        return false;
+    }
+
+    startMSecs = qint64(qFromLittleEndian<quint64>(header.constData() + 8));
+    return true;
+}
+
+bool CaptureReader::next(Record &record)
+{
+    char header[TrafficRecorder::RecordHeaderSize];
+    qint64 read = file.read(header, sizeof(header));
+    if (read <= 0) {
+        return false;
+    }
+    if (read != qint64(sizeof(header))) {
+        truncated = true;
+        return false;
+    }
+
+    record.offsetMicros = qFromLittleEndian<quint64>(header);
+    record.connectionId = qFromLittleEndian<quint32>(header + 8);
+    record.type = TrafficRecorder::RecordType(quint8(header[12]));
+    quint32 length = qFromLittleEndian<quint32>(header + 13);
+
+    record.payload = file.read(length);
+    if (record.payload.size() != int(length)) {
+        truncated = true;
+        return false;
+    }
+    return true;
+}
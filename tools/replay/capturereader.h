@@ -0,0 +1,36 @@
+#ifndef CAPTUREREADER_H
+#define CAPTUREREADER_H
+
+#include <QFile>
+#include <QByteArray>
+
+#include "trafficrecorder.h"
+
+// Sequential reader for capture files written by TrafficRecorder
+class CaptureReader
+{
+public:
+    struct Record {
+        quint64 offsetMicros = 0;
+        quint32 connectionId = 0;
+        TrafficRecorder::RecordType type = TrafficRecorder::FrameReceived;
+        QByteArray payload;
+    };
+
+    bool open(const QString &path);
+    bool next(Record &record);
+
+    QString errorString() const { return error; }
+    qint64 startMSecsSinceEpoch() const { return startMSecs; }
+
+    // Set when the file ends in the middle of a record, e.g. after a crash
+    bool isTruncated() const { return truncated; }
+
+private:
+    QFile file;
+    QString error;
+    qint64 startMSecs = 0;
+    bool truncated = false;
+};
+
+#endif // CAPTUREREADER_H
@@ -0,0 +1,60 @@
+#include "replayer.h"
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QTimer>
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    app.setApplicationName("QtMessengerReplay");
+    app.setApplicationVersion("1.0.0");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Replays traffic captured with QtMessengerServer --record");
+    parser.addHelpOption();
+    parser.addVersionOption();
+    parser.addPositionalArgument("capture", "Capture file to replay.");
+
+    QCommandLineOption hostOption(QStringList() << "host",
+                                 "Server address (default: 127.0.0.1).",
+                                 "host", "127.0.0.1");
+    parser.addOption(hostOption);
+
+    QCommandLineOption portOption(QStringList() << "p" << "port",
+                                 "Server port (default: 8080).",
+                                 "port", "8080");
+    parser.addOption(portOption);
+
+    QCommandLineOption speedOption(QStringList() << "s" << "speed",
+                                  "Replay speed relative to the recording, 0 = as fast as possible (default: 1).",
+                                  "factor", "1");
+    parser.addOption(speedOption);
+
+    QCommandLineOption inFlightOption(QStringList() << "max-in-flight",
+                                     "Unanswered frames allowed at once when replaying as fast as possible (default: 1000).",
+                                     "n", "1000");
+    parser.addOption(inFlightOption);
+
+    parser.process(app);
+
+    if (parser.positionalArguments().size() != 1) {
+        parser.showHelp(1);
+    }
+
+    Replayer::Options options;
+    options.capturePath = parser.positionalArguments().first();
+    options.host = parser.value(hostOption);
+    options.port = parser.value(portOption).toUShort();
+    options.speed = qMax(0.0, parser.value(speedOption).toDouble());
+    options.maxInFlight = qMax(1, parser.value(inFlightOption).toInt());
+
+    Replayer replayer(options);
+    QObject::connect(&replayer, &Replayer::finished, &app, &QCoreApplication::exit);
+
+    // Start once the event loop runs so early failures can still quit it
+    QTimer::singleShot(0, &replayer, &Replayer::start);
+
+    return app.exec();
+}
@@ -0,0 +1,25 @@
+QT += core network
+QT -= gui
+
+TARGET = QtMessengerReplay
+TEMPLATE = app
+
+CONFIG += c++17 console
+CONFIG -= app_bundle
+
+# Capture format from the server, framing from the client
+INCLUDEPATH += ../../client ../../server
+
+SOURCES += \
+    main.cpp \
+    replayer.cpp \
+    capturereader.cpp \
+    ../../server/latencyhistogram.cpp \
+    ../../client/framedecoder.cpp
+
+HEADERS += \
+    replayer.h \
+    capturereader.h \
+    ../../server/trafficrecorder.h \
+    ../../server/latencyhistogram.h \
+    ../../client/framedecoder.h
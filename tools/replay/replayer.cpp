@@ -0,0 +1,287 @@
+#include "replayer.h"
+
+#include <QJsonDocument>
+#include <QTextStream>
+
+Replayer::Replayer(const Options &options, QObject *parent)
+    : QObject(parent)
+    , options(options)
+    , hasNext(false)
+    , draining(false)
+    , done(false)
+    , tickTimer(new QTimer(this))
+    , drainStartNsecs(0)
+    , lastOffsetMicros(0)
+    , inFlight(0)
+    , framesSent(0)
+    , connectionsOpened(0)
+    , rejected(0)
+    , unanswered(0)
+    , anyConnected(false)
+{
+    // Recorded gaps are replayed with millisecond precision at best
+    tickTimer->setTimerType(Qt::PreciseTimer);
+    tickTimer->setInterval(1);
+    connect(tickTimer, &QTimer::timeout, this, &Replayer::onTick);
+}
+
+Replayer::~Replayer()
+{
+    qDeleteAll(connections);
+}
+
+void Replayer::start()
+{
+    if (!reader.open(options.capturePath)) {
+        fail(QString("Cannot read %1: %2").arg(options.capturePath, reader.errorString()));
+        return;
+    }
+
+    hasNext = reader.next(nextRecord);
+
+    qInfo().noquote() << QString("Replaying %1 against %2:%3 at %4")
+                         .arg(options.capturePath, options.host).arg(options.port)
+                         .arg(options.speed > 0 ? QString("%1x").arg(options.speed) : QString("full speed"));
+
+    clock.start();
+    tickTimer->start();
+}
+
+void Replayer::onTick()
+{
+    // Keep the event loop responsive at full speed
+    int budget = 10000;
+
+    while (hasNext && budget-- > 0) {
+        qint64 scheduled;
+        if (options.speed > 0) {
+            scheduled = qint64(nextRecord.offsetMicros * 1000 / options.speed);
+            if (clock.nsecsElapsed() < scheduled) {
+                break;
+            }
+        } else {
+            if (inFlight >= options.maxInFlight) {
+                break;
+            }
+            scheduled = clock.nsecsElapsed();
+        }
+
+        dispatch(nextRecord, scheduled);
+        if (done) {
+            return;
+        }
+        hasNext = reader.next(nextRecord);
+    }
+
+    if (!hasNext && !draining) {
+        draining = true;
+        drainStartNsecs = clock.nsecsElapsed();
+        if (reader.isTruncated()) {
+            qWarning() << "Capture ends in a partial record, replayed what was complete";
+        }
+    }
+
+    checkDone();
+}
+
+void Replayer::dispatch(const CaptureReader::Record &record, qint64 scheduledNsecs)
+{
+    lastOffsetMicros = record.offsetMicros;
+
+    switch (record.type) {
+    case TrafficRecorder::ConnectionOpened:
+        openConnection(record.connectionId);
+        break;
+
+    case TrafficRecorder::FrameReceived: {
+        // Captures may start while connections are already open
+        Connection *connection = connections.value(record.connectionId);
+        if (!connection) {
+            connection = openConnection(record.connectionId);
+        }
+
+        QString action = QJsonDocument::fromJson(record.payload).object()["action"].toString();
+        connection->pending.enqueue({ action, scheduledNsecs });
+        ++inFlight;
+        ++framesSent;
+
+        QByteArray data = record.payload;
+        data.append('\n');
+        if (connection->socket->state() == QAbstractSocket::ConnectedState) {
+            connection->socket->write(data);
+        } else {
+            connection->queued.append(data);
+        }
+        break;
+    }
+
+    case TrafficRecorder::ConnectionClosed:
+        if (Connection *connection = connections.value(record.connectionId)) {
+            connection->closeRequested = true;
+            maybeClose(connection);
+        }
+        break;
+    }
+}
+
+Replayer::Connection *Replayer::openConnection(quint32 id)
+{
+    Connection *connection = new Connection;
+    connection->id = id;
+    connection->socket = new QTcpSocket(this);
+    connections.insert(id, connection);
+    ++connectionsOpened;
+
+    QTcpSocket *socket = connection->socket;
+    connect(socket, &QTcpSocket::connected, this, [this, connection]() { onConnected(connection); });
+    connect(socket, &QTcpSocket::readyRead, this, [this, connection]() { onReadyRead(connection); });
+    connect(socket, &QTcpSocket::disconnected, this, [this, connection]() { onDisconnected(connection); });
+    connect(socket, QOverload<QAbstractSocket::SocketError>::of(&QTcpSocket::errorOccurred),
+            this, [this, connection](QAbstractSocket::SocketError error) {
+        if (error == QAbstractSocket::ConnectionRefusedError && !anyConnected) {
+            fail(QString("Cannot connect to %1:%2, is the server running?").arg(options.host).arg(options.port));
+        } else if (connection->socket->state() == QAbstractSocket::UnconnectedState) {
+            onDisconnected(connection);
+        }
+    });
+
+    socket->connectToHost(options.host, options.port);
+    return connection;
+}
+
+void Replayer::onConnected(Connection *connection)
+{
+    anyConnected = true;
+    if (!connection->queued.isEmpty()) {
+        connection->socket->write(connection->queued);
+        connection->queued.clear();
+    }
+}
+
+void Replayer::maybeClose(Connection *connection)
+{
+    // Hang up only once every response has been measured
+    if (connection->closeRequested && connection->pending.isEmpty()) {
+        connection->socket->disconnectFromHost();
+    }
+}
+
+void Replayer::onReadyRead(Connection *connection)
+{
+    connection->decoder.append(connection->socket->readAll());
+
+    QJsonObject frame;
+    while (true) {
+        FrameDecoder::Result result = connection->decoder.next(frame);
+        if (result == FrameDecoder::NeedMoreData) {
+            break;
+        }
+        if (result == FrameDecoder::InvalidFrame) {
+            continue;
+        }
+
+        QString action = frame["action"].toString();
+        if (action == "busy") {
+            ++rejected;
+            continue;
+        }
+
+        // Responses arrive in request order, anything else is a push
+        if (connection->pending.isEmpty() || connection->pending.head().action != action) {
+            continue;
+        }
+
+        Pending pending = connection->pending.dequeue();
+        --inFlight;
+
+        ActionStats &actionStats = stats[pending.action.isEmpty() ? QString("(invalid)") : pending.action];
+        actionStats.latency.record((clock.nsecsElapsed() - pending.startNsecs) / 1000);
+        if (frame["status"].toString() == "success") {
+            ++actionStats.ok;
+        } else {
+            ++actionStats.errors;
+        }
+    }
+
+    maybeClose(connection);
+    checkDone();
+}
+
+void Replayer::onDisconnected(Connection *connection)
+{
+    unanswered += connection->pending.size();
+    inFlight -= connection->pending.size();
+
+    // No more signals may reach the connection once it is gone
+    connections.remove(connection->id);
+    connection->socket->disconnect(this);
+    connection->socket->deleteLater();
+    delete connection;
+
+    checkDone();
+}
+
+void Replayer::checkDone()
+{
+    if (done || !draining) {
+        return;
+    }
+
+    // Give the server a few seconds for the tail, then report what is missing
+    if (inFlight == 0 || clock.nsecsElapsed() - drainStartNsecs > 10000000000LL) {
+        finish();
+    }
+}
+
+void Replayer::finish()
+{
+    done = true;
+    tickTimer->stop();
+
+    for (Connection *connection : connections) {
+        unanswered += connection->pending.size();
+        connection->pending.clear();
+        connection->socket->disconnect(this);
+        connection->socket->abort();
+    }
+    inFlight = 0;
+
+    report();
+    emit finished(0);
+}
+
+void Replayer::fail(const QString &reason)
+{
+    if (done) {
+        return;
+    }
+
+    done = true;
+    tickTimer->stop();
+    qCritical().noquote() << reason;
+    emit finished(1);
+}
+
+void Replayer::report()
+{
+    double wallSecs = qMax<qint64>(1, clock.nsecsElapsed()) / 1e9;
+    double captureSecs = lastOffsetMicros / 1e6;
+
+    QTextStream out(stdout);
+    out << "\n";
+    out << QString::asprintf("Capture: %.1f s, replayed in %.1f s (%.1fx)\n",
+                             captureSecs, wallSecs, captureSecs / wallSecs);
+    out << QString::asprintf("Connections: %lld opened, %lld rejected as busy\n", connectionsOpened, rejected);
+    out << QString::asprintf("Frames: %lld sent, %lld unanswered\n\n", framesSent, unanswered);
+    out << QString::asprintf("%-20s %9s %8s %10s %9s %9s %9s %9s\n",
+                             "action", "ok", "errors", "ops/s", "p50 ms", "p99 ms", "p999 ms", "max ms");
+
+    for (auto it = stats.constBegin(); it != stats.constEnd(); ++it) {
+        const ActionStats &s = it.value();
+        out << QString::asprintf("%-20s %9lld %8lld %10.1f %9.2f %9.2f %9.2f %9.2f\n",
+                                 qPrintable(it.key()), s.ok, s.errors, (s.ok + s.errors) / wallSecs,
+                                 s.latency.percentile(50) / 1000.0, s.latency.percentile(99) / 1000.0,
+                                 s.latency.percentile(99.9) / 1000.0, s.latency.max() / 1000.0);
+    }
+    out.flush();
+}
@@ -0,0 +1,98 @@
+#ifndef REPLAYER_H
+#define REPLAYER_H
+
+#include <QObject>
+#include <QTcpSocket>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QHash>
+#include <QMap>
+#include <QQueue>
+
+#include "capturereader.h"
+#include "framedecoder.h"
+#include "latencyhistogram.h"
+
+// Re-drives a capture against a server: every recorded connection gets its
+// own socket and its frames are sent at their recorded offsets, scaled by
+// the speed factor, or back to back with a bounded window when speed is 0.
+class Replayer : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Options {
+        QString capturePath;
+        QString host = "127.0.0.1";
+        quint16 port = 8080;
+        double speed = 1.0;         // 0 = as fast as possible
+        int maxInFlight = 1000;     // only used when speed is 0
+    };
+
+    explicit Replayer(const Options &options, QObject *parent = nullptr);
+    ~Replayer();
+
+    void start();
+
+signals:
+    void finished(int exitCode);
+
+private slots:
+    void onTick();
+
+private:
+    struct Pending {
+        QString action;
+        qint64 startNsecs;
+    };
+
+    struct Connection {
+        quint32 id = 0;
+        QTcpSocket *socket = nullptr;
+        FrameDecoder decoder;
+        QByteArray queued;          // frames sent before the socket connected
+        QQueue<Pending> pending;
+        bool closeRequested = false;
+    };
+
+    struct ActionStats {
+        LatencyHistogram latency;
+        qint64 ok = 0;
+        qint64 errors = 0;
+    };
+
+    void dispatch(const CaptureReader::Record &record, qint64 scheduledNsecs);
+    Connection *openConnection(quint32 id);
+    void maybeClose(Connection *connection);
+    void onConnected(Connection *connection);
+    void onReadyRead(Connection *connection);
+    void onDisconnected(Connection *connection);
+    void checkDone();
+    void finish();
+    void fail(const QString &reason);
+    void report();
+
+    Options options;
+    CaptureReader reader;
+    CaptureReader::Record nextRecord;
+    bool hasNext;
+    bool draining;
+    bool done;
+
+    QHash<quint32, Connection*> connections;
+    QMap<QString, ActionStats> stats;
+
+    QTimer *tickTimer;
+    QElapsedTimer clock;
+    qint64 drainStartNsecs;
+    quint64 lastOffsetMicros;
+
+    qint64 inFlight;
+    qint64 framesSent;
+    qint64 connectionsOpened;
+    qint64 rejected;
+    qint64 unanswered;
+    bool anyConnected;
+};
+
+#endif // REPLAYER_H
@@ -0,0 +1,75 @@
+#include "bulkinsert.h"
+
+#include <QSqlError>
+
+BulkInsert::BulkInsert(const QSqlDatabase &db, const QString &table, const QStringList &columns)
+    : db(db)
+    , table(table)
+    , columns(columns)
+    , rowsPerStatement(qMax(1, MaxVariables / int(columns.size())))
+    , fullBatch(db)
+    , values(rowsPerStatement * int(columns.size()))
+    , filled(0)
+    , pendingRows(0)
+    , written(0)
+{
+    fullBatch.prepare(statement(rowsPerStatement));
+}
+
+QString BulkInsert::statement(int rowCount) const
+{
+    QStringList placeholders;
+    for (int i = 0; i < columns.size(); ++i) {
+        placeholders << "?";
+    }
+    QString row = "(" + placeholders.join(", ") + ")";
+
+    QStringList rows;
+    rows.reserve(rowCount);
+    for (int i = 0; i < rowCount; ++i) {
+        rows << row;
+    }
+
+    return QString("INSERT INTO %1 (%2) VALUES %3").arg(table, columns.join(", "), rows.join(", "));
+}
+
+bool BulkInsert::endRow()
+{
+    if (++pendingRows < rowsPerStatement) {
+        return true;
+    }
+    return execute(fullBatch, pendingRows);
+}
+
+bool BulkInsert::flush()
+{
+    if (pendingRows == 0) {
+        return true;
+    }
+
+    // The last partial batch needs a statement of its own size
+    QSqlQuery tail(db);
+    if (!tail.prepare(statement(pendingRows))) {
+        error = tail.lastError().text();
+        return false;
+    }
+    return execute(tail, pendingRows);
+}
+
+bool BulkInsert::execute(QSqlQuery &query, int rowCount)
+{
+    for (int i = 0; i < filled; ++i) {
+        query.bindValue(i, values[i]);
+    }
+
+    bool ok = query.exec();
+    if (!ok) {
+        error = query.lastError().text();
+    } else {
+        written += rowCount;
+    }
+
+    filled = 0;
+    pendingRows = 0;
+    return ok;
+}
@@ -0,0 +1,45 @@
+#ifndef BULKINSERT_H
+#define BULKINSERT_H
+
+#include <QSqlDatabase>
+#include <QSqlQuery>
+#include <QStringList>
+#include <QVariant>
+#include <QVector>
+
+// Buffers rows and writes them with one prepared multi-row INSERT per
+// batch, so SQLite parses the statement once and each round trip into the
+// driver carries many rows instead of one.
+class BulkInsert
+{
+public:
+    BulkInsert(const QSqlDatabase &db, const QString &table, const QStringList &columns);
+
+    // Values are added column by column, endRow() closes the current row
+    void add(const QVariant &value) { values[filled++] = value; }
+    bool endRow();
+    bool flush();
+
+    qint64 rowsWritten() const { return written; }
+    QString lastError() const { return error; }
+
+private:
+    QString statement(int rowCount) const;
+    bool execute(QSqlQuery &query, int rowCount);
+
+    // Stay under SQLITE_MAX_VARIABLE_NUMBER of older SQLite builds
+    static constexpr int MaxVariables = 999;
+
+    QSqlDatabase db;
+    QString table;
+    QStringList columns;
+    int rowsPerStatement;
+    QSqlQuery fullBatch;
+    QVector<QVariant> values;
+    int filled;
+    int pendingRows;
+    qint64 written;
+    QString error;
+};
+
+#endif // BULKINSERT_H
@@ -0,0 +1,123 @@
+#include "seeder.h"
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+
+    app.setApplicationName("QtMessengerSeeder");
+    app.setApplicationVersion("1.0.0");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Fills a new Qt Messenger database with synthetic users, contacts and messages");
+    parser.addHelpOption();
+    parser.addVersionOption();
+    parser.addPositionalArgument("database", "SQLite file to create.");
+
+    QCommandLineOption forceOption(QStringList() << "f" << "force",
+                                  "Replace the database file if it exists.");
+    parser.addOption(forceOption);
+
+    QCommandLineOption usersOption(QStringList() << "u" << "users",
+                                  "Number of users (default: 100000).",
+                                  "n", "100000");
+    parser.addOption(usersOption);
+
+    QCommandLineOption messagesOption(QStringList() << "m" << "messages",
+                                     "Number of messages (default: 1000000).",
+                                     "n", "1000000");
+    parser.addOption(messagesOption);
+
+    QCommandLineOption seedOption(QStringList() << "seed",
+                                 "Random seed, the same seed gives the same database (default: 1).",
+                                 "n", "1");
+    parser.addOption(seedOption);
+
+    QCommandLineOption contactAlphaOption(QStringList() << "contact-alpha",
+                                         "Power-law exponent of contacts per user, > 1 (default: 2.0).",
+                                         "alpha", "2.0");
+    parser.addOption(contactAlphaOption);
+
+    QCommandLineOption minContactsOption(QStringList() << "min-contacts",
+                                        "Fewest contacts a user draws (default: 1).",
+                                        "n", "1");
+    parser.addOption(minContactsOption);
+
+    QCommandLineOption maxContactsOption(QStringList() << "max-contacts",
+                                        "Most contacts a user draws (default: 1000).",
+                                        "n", "1000");
+    parser.addOption(maxContactsOption);
+
+    QCommandLineOption activityAlphaOption(QStringList() << "activity-alpha",
+                                          "Pareto exponent of traffic per contact pair, lower is more skewed (default: 1.2).",
+                                          "alpha", "1.2");
+    parser.addOption(activityAlphaOption);
+
+    QCommandLineOption burstMeanOption(QStringList() << "burst-mean",
+                                      "Mean messages per conversation burst (default: 8).",
+                                      "n", "8");
+    parser.addOption(burstMeanOption);
+
+    QCommandLineOption burstGapOption(QStringList() << "burst-gap",
+                                     "Mean seconds between messages within a burst (default: 30).",
+                                     "seconds", "30");
+    parser.addOption(burstGapOption);
+
+    QCommandLineOption lengthMedianOption(QStringList() << "length-median",
+                                         "Median message length in characters (default: 40).",
+                                         "n", "40");
+    parser.addOption(lengthMedianOption);
+
+    QCommandLineOption lengthSigmaOption(QStringList() << "length-sigma",
+                                        "Lognormal sigma of message length (default: 1.0).",
+                                        "sigma", "1.0");
+    parser.addOption(lengthSigmaOption);
+
+    QCommandLineOption daysOption(QStringList() << "days",
+                                 "Days of history to spread messages over (default: 365).",
+                                 "n", "365");
+    parser.addOption(daysOption);
+
+    QCommandLineOption commitOption(QStringList() << "commit-every",
+                                   "Rows per transaction (default: 1000000).",
+                                   "n", "1000000");
+    parser.addOption(commitOption);
+
+    parser.process(app);
+
+    if (parser.positionalArguments().size() != 1) {
+        parser.showHelp(1);
+    }
+
+    Seeder::Options options;
+    options.path = parser.positionalArguments().first();
+    options.force = parser.isSet(forceOption);
+    options.seed = parser.value(seedOption).toUInt();
+    options.users = parser.value(usersOption).toInt();
+    options.messages = parser.value(messagesOption).toLongLong();
+    options.contactAlpha = parser.value(contactAlphaOption).toDouble();
+    options.minContacts = qMax(1, parser.value(minContactsOption).toInt());
+    options.maxContacts = qMax(options.minContacts, parser.value(maxContactsOption).toInt());
+    options.activityAlpha = parser.value(activityAlphaOption).toDouble();
+    options.burstMean = parser.value(burstMeanOption).toDouble();
+    options.burstGapSecs = parser.value(burstGapOption).toDouble();
+    options.lengthMedian = qMax(1.0, parser.value(lengthMedianOption).toDouble());
+    options.lengthSigma = qMax(0.0, parser.value(lengthSigmaOption).toDouble());
+    options.days = qMax(1, parser.value(daysOption).toInt());
+    options.commitEvery = qMax<qint64>(1, parser.value(commitOption).toLongLong());
+
+    if (options.users < 2 || options.messages < 0) {
+        qCritical() << "Need at least 2 users and a non-negative message count";
+        return 1;
+    }
+
+    if (options.contactAlpha <= 1.0 || options.activityAlpha <= 0.0) {
+        qCritical() << "--contact-alpha must be above 1 and --activity-alpha above 0";
+        return 1;
+    }
+
+    Seeder seeder(options);
+    return seeder.run() ? 0 : 1;
+}
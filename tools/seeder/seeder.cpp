@@ -0,0 +1,288 @@
+#include "seeder.h"
+#include "bulkinsert.h"
+#include "database.h"
+
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QFile>
+#include <QScopeGuard>
+#include <QSet>
+#include <QSqlError>
+#include <QSqlQuery>
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+namespace {
+
+// Words for message bodies, sliced at random offsets
+const char *Vocabulary[] = {
+    "hey", "are", "you", "coming", "tonight", "sure", "thanks", "see", "later", "the",
+    "meeting", "moved", "to", "tomorrow", "can", "call", "me", "when", "free", "ok",
+    "sounds", "good", "what", "time", "lunch", "train", "late", "sorry", "photo", "lol",
+    "project", "deadline", "weekend", "plans", "running", "home", "now", "yes", "no", "maybe"
+};
+
+} // namespace
+
+Seeder::Seeder(const Options &options)
+    : options(options)
+    , random(options.seed)
+{
+}
+
+bool Seeder::run()
+{
+    clock.start();
+
+    if (QFile::exists(options.path)) {
+        if (!options.force) {
+            return fail(options.path + " already exists, use --force to replace it");
+        }
+        QFile::remove(options.path);
+    }
+
+    // The server's own schema, so seeded files are drop-in databases
+    Database database;
+    if (!database.initialize(options.path)) {
+        return fail("Could not create " + options.path);
+    }
+    db = QSqlDatabase::database();
+
+    // Nothing is worth keeping from a half-written seed, so skip the
+    // journal and fsyncs and let SQLite cache aggressively
+    QSqlQuery pragma(db);
+    pragma.exec("PRAGMA journal_mode = OFF");
+    pragma.exec("PRAGMA synchronous = OFF");
+    pragma.exec("PRAGMA locking_mode = EXCLUSIVE");
+    pragma.exec("PRAGMA temp_store = MEMORY");
+    pragma.exec("PRAGMA cache_size = -262144");
+
+    if (!seedUsers() || !seedContacts() || !seedMessages()) {
+        return false;
+    }
+
+    qInfo("Seeded %d users, %d contact pairs and %lld messages in %.1f s",
+          options.users, int(pairs.size()), options.messages, clock.elapsed() / 1000.0);
+    return true;
+}
+
+bool Seeder::fail(const QString &reason)
+{
+    qCritical().noquote() << reason;
+    return false;
+}
+
+bool Seeder::commitIfDue(BulkInsert &insert, qint64 &lastCommit, const char *what, qint64 total)
+{
+    if (insert.rowsWritten() - lastCommit < options.commitEvery) {
+        return true;
+    }
+
+    if (!db.commit() || !db.transaction()) {
+        return fail(QString("Commit failed: %1").arg(db.lastError().text()));
+    }
+    lastCommit = insert.rowsWritten();
+
+    qInfo("%s: %lld / %lld (%.0f rows/s overall)", what, insert.rowsWritten(), total,
+          insert.rowsWritten() / qMax(0.001, clock.elapsed() / 1000.0));
+    return true;
+}
+
+bool Seeder::seedUsers()
+{
+    // Everyone can log in from the client with the password "password"
+    QString passwordHash = QString::fromLatin1(QCryptographicHash::hash("password", QCryptographicHash::Sha256).toHex());
+
+    BulkInsert insert(db, "users", { "id", "username", "email", "password" });
+    qint64 lastCommit = 0;
+
+    db.transaction();
+    for (int id = 1; id <= options.users; ++id) {
+        QString username = QString("user%1").arg(id);
+        insert.add(id);
+        insert.add(username);
+        insert.add(username + "@seed.localhost");
+        insert.add(passwordHash);
+        if (!insert.endRow() || !commitIfDue(insert, lastCommit, "users", options.users)) {
+            return fail("Inserting users failed: " + insert.lastError());
+        }
+    }
+
+    if (!insert.flush() || !db.commit()) {
+        return fail("Inserting users failed: " + insert.lastError());
+    }
+    return true;
+}
+
+int Seeder::sampleDegree()
+{
+    // Inverse transform of a Pareto tail, floored to whole contacts
+    double u = random.generateDouble();
+    double degree = options.minContacts * std::pow(1.0 - u, -1.0 / (options.contactAlpha - 1.0));
+    return int(qMin<double>(degree, options.maxContacts));
+}
+
+bool Seeder::seedContacts()
+{
+    // Configuration model: every user gets as many stubs as its degree,
+    // shuffled stubs are paired off, self and duplicate pairs are dropped
+    QVector<int> stubs;
+    for (int id = 1; id <= options.users; ++id) {
+        int degree = sampleDegree();
+        for (int i = 0; i < degree; ++i) {
+            stubs.append(id);
+        }
+    }
+    std::shuffle(stubs.begin(), stubs.end(), random);
+
+    QSet<quint64> seen;
+    seen.reserve(stubs.size() / 2);
+    for (int i = 0; i + 1 < stubs.size(); i += 2) {
+        int a = qMin(stubs[i], stubs[i + 1]);
+        int b = qMax(stubs[i], stubs[i + 1]);
+        quint64 key = (quint64(a) << 32) | quint64(b);
+        if (a == b || seen.contains(key)) {
+            continue;
+        }
+        seen.insert(key);
+        pairs.append(qMakePair(a, b));
+    }
+
+    if (pairs.isEmpty()) {
+        return fail("Not enough users to build any contacts");
+    }
+
+    BulkInsert insert(db, "contacts", { "user_id", "contact_id" });
+    qint64 lastCommit = 0;
+    qint64 total = qint64(pairs.size()) * 2;
+
+    db.transaction();
+    for (const QPair<int, int> &pair : pairs) {
+        // Contacts are stored in both directions, like Database::addContact
+        insert.add(pair.first);
+        insert.add(pair.second);
+        if (!insert.endRow()) {
+            return fail("Inserting contacts failed: " + insert.lastError());
+        }
+        insert.add(pair.second);
+        insert.add(pair.first);
+        if (!insert.endRow() || !commitIfDue(insert, lastCommit, "contacts", total)) {
+            return fail("Inserting contacts failed: " + insert.lastError());
+        }
+    }
+
+    if (!insert.flush() || !db.commit()) {
+        return fail("Inserting contacts failed: " + insert.lastError());
+    }
+
+    // A few pairs carry most of the traffic
+    cumulativeActivity.reserve(pairs.size());
+    double sum = 0;
+    for (int i = 0; i < pairs.size(); ++i) {
+        sum += std::pow(1.0 - random.generateDouble(), -1.0 / options.activityAlpha);
+        cumulativeActivity.append(sum);
+    }
+
+    return true;
+}
+
+int Seeder::sampleConversation()
+{
+    double target = random.generateDouble() * cumulativeActivity.last();
+    auto it = std::upper_bound(cumulativeActivity.begin(), cumulativeActivity.end(), target);
+    return qMin(int(it - cumulativeActivity.begin()), int(cumulativeActivity.size()) - 1);
+}
+
+bool Seeder::seedMessages()
+{
+    QString text;
+    while (text.size() < 16384) {
+        text += QString(Vocabulary[random.bounded(int(sizeof(Vocabulary) / sizeof(Vocabulary[0])))]) + ' ';
+    }
+
+    std::lognormal_distribution<double> length(std::log(options.lengthMedian), options.lengthSigma);
+    std::geometric_distribution<int> burstLength(1.0 / qMax(1.0, options.burstMean));
+    std::exponential_distribution<double> gap(1.0 / qMax(1.0, options.burstGapSecs));
+
+    qint64 end = QDateTime::currentSecsSinceEpoch();
+    qint64 begin = end - qint64(options.days) * 86400;
+    qint64 readBefore = end - 86400;     // the last day stays unread
+
+    // Indexing row by row through the search trigger is far slower than one
+    // rebuild at the end; the trigger is put back exactly as it was
+    QSqlQuery search(db);
+    QString searchTrigger;
+    if (search.exec("SELECT sql FROM sqlite_master WHERE type = 'trigger' AND name = 'messages_fts_insert'")
+        && search.next()) {
+        searchTrigger = search.value(0).toString();
+        search.finish();
+        search.exec("DROP TRIGGER messages_fts_insert");
+    }
+
+    // Any early return still indexes what was committed and restores the
+    // trigger, so a failed run never leaves search silently incomplete
+    auto restoreSearch = qScopeGuard([this, &searchTrigger]() {
+        if (searchTrigger.isEmpty()) {
+            return;
+        }
+        db.rollback();
+        QSqlQuery restore(db);
+        if (!restore.exec("INSERT INTO messages_fts(messages_fts) VALUES('rebuild')") || !restore.exec(searchTrigger)) {
+            qCritical().noquote() << "Restoring the search index failed:" << restore.lastError().text();
+        }
+    });
+
+    BulkInsert insert(db, "messages", { "sender_id", "receiver_id", "content", "type", "read", "timestamp" });
+    qint64 lastCommit = 0;
+    qint64 written = 0;
+
+    db.transaction();
+    while (written < options.messages) {
+        const QPair<int, int> &pair = pairs[sampleConversation()];
+        bool firstSends = random.bounded(2) == 0;
+        qint64 timestamp = begin + qint64(random.generateDouble() * (end - begin));
+
+        int burst = 1 + burstLength(random);
+        for (int i = 0; i < burst && written < options.messages; ++i, ++written) {
+            // Replies flip the direction most of the time
+            if (i > 0 && random.generateDouble() < 0.6) {
+                firstSends = !firstSends;
+            }
+            timestamp += qint64(gap(random));
+
+            int size = qBound(1, int(length(random)), 4000);
+            int offset = random.bounded(text.size() - qMin(size, text.size() - 1));
+
+            insert.add(firstSends ? pair.first : pair.second);
+            insert.add(firstSends ? pair.second : pair.first);
+            insert.add(text.mid(offset, size));
+            insert.add(QStringLiteral("text"));
+            insert.add(timestamp < readBefore);
+            insert.add(QDateTime::fromSecsSinceEpoch(timestamp));
+            if (!insert.endRow() || !commitIfDue(insert, lastCommit, "messages", options.messages)) {
+                return fail("Inserting messages failed: " + insert.lastError());
+            }
+        }
+    }
+
+    if (!insert.flush() || !db.commit()) {
+        return fail("Inserting messages failed: " + insert.lastError());
+    }
+    restoreSearch.dismiss();
+
+    if (!searchTrigger.isEmpty()) {
+        qInfo("Building the message search index");
+        // The trigger goes back even when the rebuild fails
+        bool rebuilt = search.exec("INSERT INTO messages_fts(messages_fts) VALUES('rebuild')");
+        QString error = search.lastError().text();
+        if (!search.exec(searchTrigger)) {
+            error = search.lastError().text();
+            rebuilt = false;
+        }
+        if (!rebuilt) {
+            return fail("Building the search index failed: " + error);
+        }
+    }
+    return true;
+}
@@ -0,0 +1,60 @@
+#ifndef SEEDER_H
+#define SEEDER_H
+
+#include <QElapsedTimer>
+#include <QPair>
+#include <QRandomGenerator>
+#include <QSqlDatabase>
+#include <QString>
+#include <QVector>
+
+class BulkInsert;
+
+// Fills a fresh messenger database with synthetic users, contacts and
+// messages. Contact degrees follow a power law, conversations arrive in
+// bursts between a few busy pairs, and message lengths are lognormal.
+class Seeder
+{
+public:
+    struct Options {
+        QString path;
+        bool force = false;
+        quint32 seed = 1;
+        int users = 100000;
+        qint64 messages = 1000000;
+        double contactAlpha = 2.0;      // P(degree = d) ~ d^-alpha
+        int minContacts = 1;
+        int maxContacts = 1000;
+        double activityAlpha = 1.2;     // skew of traffic across contact pairs
+        double burstMean = 8.0;         // messages per conversation burst
+        double burstGapSecs = 30.0;     // mean gap between messages in a burst
+        double lengthMedian = 40.0;     // characters
+        double lengthSigma = 1.0;
+        int days = 365;
+        qint64 commitEvery = 1000000;   // rows per transaction
+    };
+
+    explicit Seeder(const Options &options);
+
+    bool run();
+
+private:
+    bool seedUsers();
+    bool seedContacts();
+    bool seedMessages();
+    bool commitIfDue(BulkInsert &insert, qint64 &lastCommit, const char *what, qint64 total);
+    bool fail(const QString &reason);
+
+    int sampleDegree();
+    int sampleConversation();
+
+    Options options;
+    QRandomGenerator random;
+    QSqlDatabase db;
+    QElapsedTimer clock;
+
+    QVector<QPair<int, int>> pairs;         // contact pairs, user ids
+    QVector<double> cumulativeActivity;     // running sum of pair weights
+};
+
+#endif // SEEDER_H
@@ -0,0 +1,24 @@
+QT += core sql
+QT -= gui
+
+TARGET = QtMessengerSeeder
+TEMPLATE = app
+
+CONFIG += c++17 console
+CONFIG -= app_bundle
+
+# Creates the schema through the server's Database class
+INCLUDEPATH += ../../server
+
+SOURCES += \
+    main.cpp \
+    seeder.cpp \
+    bulkinsert.cpp \
+    ../../server/database.cpp \
+    ../../server/tracer.cpp
+
+HEADERS += \
+    seeder.h \
+    bulkinsert.h \
+    ../../server/database.h \
+    ../../server/tracer.h